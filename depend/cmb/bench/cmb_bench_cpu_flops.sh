@@ -116,9 +116,6 @@ esac
 #
 S=$( date +%s ) # Start time in seconds since epoch (Jan 1, 1970 00:00:00 UTC)
 T=$( cmb -otrk2 $SET ) # Total number of combinations in n-choose-k given $SET
-if [ ! "$AC" ]; then
-	C=$(( $T / $THREADS )) # Combinations for each thread
-fi
 
 #
 # Inform the user of what we are about to do
@@ -140,8 +137,7 @@ for n in $( seq 1 $THREADS ); do
 	if [ "$AC" ]; then # All-core stress test
 		$cmd $SET &
 	else
-		[ $n -eq $THREADS ] || cmd="$cmd -c $C"
-		$cmd -i $(( $C * ($n - 1) + 1 )) $SET &
+		$cmd --shard $n/$THREADS $SET &
 	fi
 	pids="$pids $!"
 done
@@ -160,7 +156,7 @@ printf "Total combinations in C(%d,2) is %'d\n" "$SET" "$T"
 if [ "$AC" ]; then # All-core stress test
 	printf "Each thread working on %'d combinations\n" "$T"
 else
-	printf "Each thread working on %'d combinations\n" "$C"
+	printf "Each thread working on 1/%d of the combinations\n" "$THREADS"
 fi
 
 #
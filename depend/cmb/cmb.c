@@ -10,7 +10,9 @@
 #include <cmb.h>
 #include <err.h>
 #include <errno.h>
+#include <getopt.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -35,9 +37,151 @@ static const char digit[11] = "0123456789";
 #define _Noreturn __attribute__((noreturn))
 #endif
 
+/*
+ * Range of number of items for which `-X add -F num' is solved by meet-in-
+ * the-middle (see cmb_find_add()) rather than enumerating every combination.
+ * Memory required is about 48 * 2^(max/2) bytes.
+ */
+#ifndef CMB_FIND_MITM_MIN
+#define CMB_FIND_MITM_MIN 24
+#endif
+#ifndef CMB_FIND_MITM_MAX
+#define CMB_FIND_MITM_MAX 56
+#endif
+
+/*
+ * Least number of items for which `-X add -F num' (outside the range above)
+ * and `-X multiply -F num' enumerate only the combinations that can reach num
+ * (see cmb_find_bound()).
+ */
+#ifndef CMB_FIND_BOUND_MIN
+#define CMB_FIND_BOUND_MIN 16
+#endif
+
+/*
+ * Largest table, in bytes, with which `-X add -F num' on whole numbers is
+ * solved by dynamic programming (see cmb_find_dp() and cmb_find_count()).
+ */
+#ifndef CMB_FIND_DP_MAX
+#define CMB_FIND_DP_MAX (64 * 1024 * 1024)
+#endif
+
+/*
+ * Most combinations in each unit of work for `-j num' threads; the output of
+ * a unit is held in memory until it is written (see cmb_jobs()).
+ */
+#ifndef CMB_JOBS_UNIT_MAX
+#define CMB_JOBS_UNIT_MAX (64 * 1024)
+#endif
+
+/*
+ * Subset-sum table for cmb_find_dp() and cmb_find_count(), passed as config
+ * data. Sums are tracked from lo to lo+nbits-1; with negative items summing to
+ * neg and positive items to pos, only sums from max(neg, num-pos) to min(pos,
+ * num-neg) can be part of a combination summing to `-F num'.
+ */
+struct cmb_find_dp {
+	uint8_t	show_empty;	/* `-e' given */
+	uint32_t kmax;		/* Largest set */
+	uint32_t nitems;
+	uint32_t setdone;	/* Last set size, as cmb(3) normalizes it */
+	uint32_t setinit;	/* First set size, likewise */
+	int64_t	lo;		/* Least sum tracked */
+	int64_t	target;		/* Value of `-F num' */
+	int64_t	*totals;	/* Total of the prefix up to each depth */
+	int64_t	*vals;		/* Item values */
+	size_t	nbits;		/* Number of sums tracked (zero if none) */
+	size_t	nwords;		/* Words in each bitset */
+	uint64_t *reach;	/* Bitsets by first item and set size */
+};
+
+/*
+ * State shared by `-j num' threads (see cmb_jobs()). Units of work are claimed
+ * in sequence order; unless unordered (-u), each waits for its turn to write.
+ */
+struct cmb_jobs {
+	uint8_t	ordered;		/* Write units in sequence order */
+	int	retval;			/* First non-zero result */
+	uint32_t nitems;
+	char	**items;
+	uint64_t first;			/* First sequence number */
+	uint64_t last;			/* Last sequence number plus one */
+	uint64_t unit;			/* Combinations per unit */
+	uint64_t nunits;		/* Units of work in all */
+	uint64_t next;			/* Next unit to claim */
+	uint64_t turn;			/* Next unit to write if ordered */
+	pthread_mutex_t mtx;		/* Protects next */
+	pthread_mutex_t wmtx;		/* Protects retval, turn, and stdout */
+	pthread_cond_t wcv;		/* Signaled when turn advances */
+};
+
+/*
+ * Per-thread state of `-j num'
+ */
+struct cmb_job {
+	struct cmb_config config;	/* Copy of caller's config */
+	struct cmb_jobs *jobs;		/* Shared state */
+	pthread_t tid;			/* Thread handle */
+};
+
+/*
+ * Which `-X op' results are kept given `-T num' (see cmb_top_score())
+ */
+#define CMB_TOP_LARGEST	0	/* `-T num' */
+#define CMB_TOP_SMALLEST	1	/* `-T -num' */
+#define CMB_TOP_NEAREST	2	/* `-T num' with `-F num' */
+
+/* Long options without a short equivalent */
+#define OPT_SHARD	(CHAR_MAX + 1)	/* `--shard i/n' */
+
+static const struct option longopts[] = {
+	{ "shard",	required_argument,	NULL,	OPT_SHARD },
+	{ NULL,		0,			NULL,	0 },
+};
+
+/*
+ * Summary of `-X op' results given `-H num', one per cmb_parallel(3) thread
+ * (see cmb_stats_action())
+ */
+struct cmb_stats {
+	uint64_t count;		/* Results other than NaN */
+	uint64_t nans;		/* NaN results */
+	long double min;
+	long double max;
+	long double sum;
+	uint64_t *hist;		/* Results in each bucket (second pass) */
+};
+
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 cmb_find_count_t;
+#else
+typedef uint64_t cmb_find_count_t;
+#endif
+
 /* Function prototypes */
 static void	_Noreturn cmb_usage(void);
+static int	cmb_find_add(struct cmb_config *config, uint32_t nitems,
+    char *items[]);
+static int	cmb_find_bound(struct cmb_config *config, uint32_t nitems,
+    char *items[], uint8_t mul);
+static int	cmb_find_count(struct cmb_find_dp *dp,
+    cmb_find_count_t *counts);
+static void	cmb_find_count_print(uint32_t setsize, cmb_find_count_t count,
+    uint8_t nul);
+static int	cmb_find_dp(struct cmb_config *config, uint32_t nitems,
+    char *items[], struct cmb_find_dp *dp);
+static uint8_t	cmb_find_dp_fill(struct cmb_find_dp *dp);
+static void	cmb_find_dp_free(struct cmb_find_dp *dp);
+static uint8_t	cmb_find_dp_init(struct cmb_find_dp *dp,
+    struct cmb_config *config, uint32_t nitems, char *items[]);
+static int	cmb_jobs(struct cmb_config *config, uint32_t nitems,
+    char *items[], uint32_t njobs, uint8_t ordered);
+static void *	cmb_jobs_worker(void *arg);
 static uint64_t	cmb_rand_range(uint64_t range);
+static		CMB_ACTION(cmb_stats_action);
+static int	cmb_stats_print(struct cmb_config *config, uint32_t nitems,
+    char *items[], uint32_t nbuckets, int meanprec, uint32_t nthreads);
+static		CMB_SCORE(cmb_top_score);
 static		CMB_ACTION(cmb_add);
 static		CMB_ACTION(cmb_div);
 static		CMB_ACTION(cmb_mul);
@@ -60,11 +204,17 @@ static		CMB_ACTION_BN(cmb_div_find_bn);
 static		CMB_ACTION_BN(cmb_mul_find_bn);
 static		CMB_ACTION_BN(cmb_sub_find_bn);
 #endif
+static		CMB_SCORE(cmb_add_score);
+static		CMB_SCORE(cmb_div_score);
+static		CMB_SCORE(cmb_mul_score);
+static		CMB_SCORE(cmb_sub_score);
 static size_t	numlen(const char *s);
 static size_t	rangelen(const char *s, size_t nlen, size_t slen);
 static size_t	unumlen(const char *s);
 static size_t	urangelen(const char *s, size_t nlen, size_t slen);
 static uint8_t	parse_range(const char *s, uint32_t *min, uint32_t *max);
+static uint8_t	parse_shard(const char *s, uint32_t *shard,
+    uint32_t *nshards);
 static uint8_t	parse_unum(const char *s, uint32_t *n);
 static uint8_t	parse_urange(const char *s, uint32_t *min, uint32_t *max);
 static uint32_t	range_char(uint32_t start, uint32_t stop, uint32_t idx,
@@ -86,15 +236,29 @@ struct cmb_xfdef
 	const char *opname;
 	CMB_ACTION((*action));
 	CMB_ACTION((*action_find));
+	CMB_SCORE((*score));
 };
 static struct cmb_xfdef cmb_xforms[] = {
 	/* opname    action */
-	{"multiply", cmb_mul, cmb_mul_find},
-	{"divide",   cmb_div, cmb_div_find},
-	{"add",      cmb_add, cmb_add_find},
-	{"subtract", cmb_sub, cmb_sub_find},
-	{NULL,       NULL,    NULL},
+	{"multiply", cmb_mul, cmb_mul_find, cmb_mul_score},
+	{"divide",   cmb_div, cmb_div_find, cmb_div_score},
+	{"add",      cmb_add, cmb_add_find, cmb_add_score},
+	{"subtract", cmb_sub, cmb_sub_find, cmb_sub_score},
+	{NULL,       NULL,    NULL,         NULL},
 };
+
+/*
+ * Top results (-T num)
+ */
+static int cmb_top_order = CMB_TOP_LARGEST;
+static CMB_SCORE((*cmb_xscore)); /* `-X op' result (-T num, -H num) */
+
+/*
+ * Summary of results (-H num)
+ */
+static uint32_t cmb_stats_nbuckets;
+static long double cmb_stats_lo;	/* Least result */
+static long double cmb_stats_width;	/* Of each bucket */
 #if defined(HAVE_LIBCRYPTO) && defined(HAVE_OPENSSL_BN_H)
 struct cmb_xfdef_bn
 {
@@ -115,10 +279,15 @@ static struct cmb_xfdef_bn cmb_xforms_bn[] = {
 int
 main(int argc, char *argv[])
 {
+	uint8_t find_add = FALSE;
+	uint8_t find_mul = FALSE;
 	uint8_t free_find = FALSE;
+	uint8_t opt_bound = FALSE;
+	uint8_t opt_dp = FALSE;
 	uint8_t opt_empty = FALSE;
 	uint8_t opt_file = FALSE;
 	uint8_t opt_find = FALSE;
+	uint8_t opt_mitm = FALSE;
 #ifdef HAVE_LIBCRYPTO
 	uint8_t opt_nossl = FALSE;
 #endif
@@ -127,13 +296,19 @@ main(int argc, char *argv[])
 	uint8_t opt_precision = FALSE;
 	uint8_t opt_randi = FALSE;
 	uint8_t opt_range = FALSE;
+	uint8_t opt_sample = FALSE;
+	uint8_t opt_stats = FALSE;
+	uint8_t opt_top = FALSE;
 	uint8_t opt_total = FALSE;
+	uint8_t opt_unordered = FALSE;
 	uint8_t opt_version = FALSE;
+	uint8_t opt_wstats = FALSE;
 	const char *cp;
 	char *cmdver = version;
 	char *endptr = NULL;
 	char **items = NULL;
 	char **items_tmp = NULL;
+	char ***files = NULL;
 	const char *libver = cmb_version(CMB_VERSION);
 	char *opt_transform = NULL;
 	int ch;
@@ -141,14 +316,20 @@ main(int argc, char *argv[])
 	int retval = EXIT_SUCCESS;
 	uint32_t i;
 	uint32_t n;
+	uint32_t nbuckets = 0;
+	uint32_t nfiles = 0;
 	uint32_t nitems = 0;
+	uint32_t njobs = 0;
+	uint32_t ntop = 0;
 	uint32_t rstart = 0;
 	uint32_t rstop = 0;
 	size_t config_size = sizeof(struct cmb_config);
 	size_t cp_size = sizeof(char *);
 	size_t optlen;
 	struct cmb_config *config = NULL;
+	struct cmb_find_dp dp;
 	struct cmb_xitem *xitem = NULL;
+	cmb_find_count_t *counts;
 #if defined(HAVE_LIBCRYPTO) && defined(HAVE_OPENSSL_BN_H)
 	BIGNUM *count_bn;
 #endif
@@ -157,8 +338,10 @@ main(int argc, char *argv[])
 	uint64_t nstart = 0; /* negative start */
 	uint64_t ritems = 0;
 	uint64_t ull;
+	long ncpu;
 	unsigned long ul;
 	struct timeval tv;
+	struct cmb_writer_stats wstats;
 
 	pgm = argv[0]; /* store a copy of invocation name */
 
@@ -170,13 +353,17 @@ main(int argc, char *argv[])
 	/*
 	 * Process command-line options
 	 */
-#define OPTSTRING "0c:Dd:eF:fi:k:Nn:oP:p:qrSs:tvX:z"
-	while ((ch = getopt(argc, argv, OPTSTRING)) != -1) {
+#define OPTSTRING "0bc:Dd:eF:fH:i:j:k:Nn:oP:p:qrSs:T:tuvWwX:z"
+	while ((ch = getopt_long(argc, argv, OPTSTRING, longopts,
+	    NULL)) != -1) {
 		switch(ch) {
 		case '0': /* NUL terminate */
 			config->options ^= CMB_OPT_NULPARSE;
 			opt_nulparse = TRUE;
 			break;
+		case 'b': /* binary */
+			config->format = CMB_FORMAT_BIN;
+			break;
 		case 'c': /* count */
 			if ((optlen = strlen(optarg)) == 0 ||
 			    unumlen(optarg) != optlen) {
@@ -237,6 +424,14 @@ main(int argc, char *argv[])
 			opt_file = TRUE;
 			opt_range = FALSE;
 			break;
+		case 'H': /* histogram */
+			if (!parse_unum(optarg, &nbuckets)) {
+				errx(EXIT_FAILURE, "-H: %s `%s'",
+				    strerror(errno), optarg);
+				/* NOTREACHED */
+			}
+			opt_stats = TRUE;
+			break;
 		case 'i': /* start */
 			if ((optlen = strlen(optarg)) > 0 &&
 			    strncmp("random", optarg, optlen) == 0) {
@@ -269,6 +464,17 @@ main(int argc, char *argv[])
 				}
 			}
 			break;
+		case 'j': /* jobs */
+			if (!parse_unum(optarg, &njobs)) {
+				errx(EXIT_FAILURE, "-j: %s `%s'",
+				    strerror(errno), optarg);
+				/* NOTREACHED */
+			}
+			if (njobs == 0) {
+				ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+				njobs = ncpu > 0 ? (uint32_t)ncpu : 1;
+			}
+			break;
 		case 'k': /* size */
 			if (!parse_range(optarg, &(config->size_min),
 			    &(config->size_max))) {
@@ -317,12 +523,33 @@ main(int argc, char *argv[])
 		case 's': /* suffix */
 			config->suffix = optarg;
 			break;
+		case 'T': /* top */
+			cmb_top_order = *optarg == '-' ?
+			    CMB_TOP_SMALLEST : CMB_TOP_LARGEST;
+			if (!parse_unum(*optarg == '-' ? &optarg[1] : optarg,
+			    &ntop)) {
+				errx(EXIT_FAILURE, "-T: %s `%s'",
+				    strerror(errno), optarg);
+				/* NOTREACHED */
+			}
+			opt_top = TRUE;
+			break;
 		case 't': /* total */
 			opt_total = TRUE;
 			break;
+		case 'u': /* unordered */
+			opt_unordered = TRUE;
+			break;
 		case 'v': /* version */
 			opt_version = TRUE;
 			break;
+		case 'W': /* writer with metrics */
+			opt_wstats = TRUE;
+			/* FALLTHROUGH */
+		case 'w': /* writer */
+			bzero(&wstats, sizeof(wstats));
+			config->writer = &wstats;
+			break;
 		case 'X': /* transform */
 			opt_transform = optarg;
 			break;
@@ -330,6 +557,14 @@ main(int argc, char *argv[])
 			opt_nulprint = TRUE;
 			config->options ^= CMB_OPT_NULPRINT;
 			break;
+		case OPT_SHARD: /* shard */
+			if (!parse_shard(optarg, &config->shard,
+			    &config->nshards)) {
+				errx(EXIT_FAILURE, "--shard: %s `%s'",
+				    strerror(errno), optarg);
+				/* NOTREACHED */
+			}
+			break;
 		default: /* unhandled argument (based on switch) */
 			cmb_usage();
 			/* NOTREACHED */
@@ -373,6 +608,30 @@ main(int argc, char *argv[])
 		/* NOTREACHED */
 	}
 
+	/*
+	 * `-X op' required if given `-T num'; keep results nearest `-F num'
+	 */
+	if (opt_top && opt_transform == NULL) {
+		errx(EXIT_FAILURE, "`-X op' required when using `-T num'");
+		/* NOTREACHED */
+	}
+	if (opt_top && opt_find)
+		cmb_top_order = CMB_TOP_NEAREST;
+	if (opt_total)
+		opt_top = FALSE;
+
+	/*
+	 * `-X op' required if given `-H num'
+	 */
+	if (opt_stats && opt_transform == NULL) {
+		errx(EXIT_FAILURE, "`-X op' required when using `-H num'");
+		/* NOTREACHED */
+	}
+	if (opt_total)
+		opt_stats = FALSE;
+	if (opt_stats)
+		opt_top = FALSE;
+
 	/*
 	 * `-X op' required if given `-P num'
 	 */
@@ -381,6 +640,42 @@ main(int argc, char *argv[])
 		/* NOTREACHED */
 	}
 
+	/*
+	 * `-j num' required if given `-u'
+	 */
+	if (opt_unordered && njobs == 0) {
+		errx(EXIT_FAILURE, "`-j num' required when using `-u'");
+		/* NOTREACHED */
+	}
+	if (opt_total)
+		njobs = 0;
+
+	/*
+	 * `-b' records are item numbers; `-j num' would write a header for
+	 * each unit and `-X op' results are text
+	 */
+	if (config->format == CMB_FORMAT_BIN && !opt_total) {
+		if (njobs > 1) {
+			errx(EXIT_FAILURE, "`-b' cannot be used with "
+			    "`-j num'");
+			/* NOTREACHED */
+		}
+		if (opt_transform != NULL) {
+			errx(EXIT_FAILURE, "`-b' cannot be used with `-X op'");
+			/* NOTREACHED */
+		}
+	}
+
+	/*
+	 * `--shard i/n' divides the combinations selected by `-c num' and
+	 * `-i num'; a random start would differ in each shard
+	 */
+	if (config->nshards > 1 && opt_randi) {
+		errx(EXIT_FAILURE, "`--shard i/n' cannot be used with "
+		    "`-i random'");
+		/* NOTREACHED */
+	}
+
 	/*
 	 * `-f' required if given `-0'
 	 */
@@ -389,6 +684,62 @@ main(int argc, char *argv[])
 		/* NOTREACHED */
 	}
 
+	/*
+	 * `-i random' with `-c num' draws num distinct random combinations
+	 * with cmb_sample(3) instead of starting at a random combination
+	 */
+	if (opt_randi && !opt_top && !opt_stats) {
+#if defined(HAVE_LIBCRYPTO) && defined(HAVE_OPENSSL_BN_H)
+		if (config->count_bn != NULL) {
+			if (BN_num_bytes(config->count_bn) <=
+			    (int)sizeof(BN_ULONG))
+				config->count = BN_get_word(config->count_bn);
+			else
+				config->count = UINT64_MAX;
+			BN_free(config->count_bn);
+			config->count_bn = NULL;
+		}
+#endif
+		if (config->count != 0) {
+			opt_sample = TRUE;
+#ifdef HAVE_LIBCRYPTO
+			opt_nossl = TRUE; /* cmb_sample(3) is 64-bit */
+#endif
+		}
+	}
+
+	/*
+	 * cmb_top(3), cmb_parallel(3), and `-j num' threads are limited to
+	 * 64-bits; convert `-c num' and `-i num'
+	 */
+#ifdef HAVE_LIBCRYPTO
+	if (njobs > 1)
+		opt_nossl = TRUE;
+#endif
+#if defined(HAVE_LIBCRYPTO) && defined(HAVE_OPENSSL_BN_H)
+	if ((opt_top || opt_stats || njobs > 1) && config->count_bn != NULL) {
+		if (BN_num_bytes(config->count_bn) <= (int)sizeof(BN_ULONG))
+			config->count = BN_get_word(config->count_bn);
+		else
+			config->count = UINT64_MAX;
+		BN_free(config->count_bn);
+		config->count_bn = NULL;
+	}
+	if ((opt_top || opt_stats || njobs > 1) &&
+	    config->start_bn != NULL) {
+		if (BN_num_bytes(config->start_bn) <= (int)sizeof(BN_ULONG))
+			ull = BN_get_word(config->start_bn);
+		else
+			ull = UINT64_MAX;
+		if (BN_is_negative(config->start_bn))
+			nstart = ull;
+		else
+			config->start = ull;
+		BN_free(config->start_bn);
+		config->start_bn = NULL;
+	}
+#endif
+
 	/*
 	 * Calculate number of items
 	 */
@@ -418,9 +769,9 @@ main(int argc, char *argv[])
 	}
 
 	/*
-	 * Print total for num items and exit if given `-t -r'
+	 * Print total for num items and exit if given `-t -r' (without `-F')
 	 */
-	if (opt_total && opt_range) {
+	if (opt_total && opt_range && !opt_find) {
 #if defined(HAVE_LIBCRYPTO) && defined(HAVE_OPENSSL_BN_H)
 		if (!opt_nossl) {
 			char *count_str;
@@ -457,6 +808,11 @@ main(int argc, char *argv[])
 	 */
 	if (opt_file) {
 		/* ... as a series of files if given `-f' */
+		if (nitems > 0 &&
+		    (files = calloc(nitems, sizeof(char **))) == NULL) {
+			errx(EXIT_FAILURE, "Out of memory?!");
+			/* NOTREACHED */
+		}
 		for (n = 0; n < nitems; n++) {
 			items_tmp = cmb_parse_file(config, argv[n], &i, 0);
 			if (items_tmp == NULL && errno != 0) {
@@ -474,6 +830,7 @@ main(int argc, char *argv[])
 				/* NOTREACHED */
 			}
 			(void)memcpy(&items[fitems-i], items_tmp, i * cp_size);
+			files[nfiles++] = items_tmp;
 		}
 		nitems = (uint32_t)fitems;
 	} else if (opt_range) {
@@ -524,11 +881,12 @@ main(int argc, char *argv[])
 		}
 		ch = -1;
 #if defined(HAVE_LIBCRYPTO) && defined(HAVE_OPENSSL_BN_H)
-		if (opt_nossl) {
+		if (opt_nossl || opt_top || opt_stats) {
 			while ((cp = cmb_xforms[++ch].opname) != NULL) {
 				if (strncmp(cp, opt_transform, optlen) != 0)
 					continue;
-				if (opt_find)
+				cmb_xscore = cmb_xforms[ch].score;
+				if (opt_find && !opt_top && !opt_stats)
 					config->action =
 					    cmb_xforms[ch].action_find;
 				else
@@ -557,7 +915,8 @@ main(int argc, char *argv[])
 		while ((cp = cmb_xforms[++ch].opname) != NULL) {
 			if (strncmp(cp, opt_transform, optlen) != 0)
 				continue;
-			if (opt_find)
+			cmb_xscore = cmb_xforms[ch].score;
+			if (opt_find && !opt_top && !opt_stats)
 				config->action = cmb_xforms[ch].action_find;
 			else
 				config->action = cmb_xforms[ch].action;
@@ -570,6 +929,12 @@ main(int argc, char *argv[])
 		}
 #endif
 
+		/*
+		 * Have cmb(3) pass item numbers so transformations can carry
+		 * running totals across combinations instead of recalculating
+		 */
+		config->options |= CMB_OPT_INDICES;
+
 		/*
 		 * Convert items into array of struct pointers
 		 * NB: Transformation function does not perform conversions
@@ -607,6 +972,8 @@ main(int argc, char *argv[])
 						cmb_transform_precision = len;
 				}
 			}
+			if (opt_file)
+				free(items);
 			items = items_tmp;
 		}
 	}
@@ -638,7 +1005,7 @@ main(int argc, char *argv[])
 		} else if (cmb_transform_precision > 0) {
 			len = snprintf(NULL, 0, "%.*Lf",
 			    cmb_transform_precision,
-			    cmb_transform_find->as.ld);
+			    cmb_transform_find->as.ld) + 1;
 			cmb_transform_find->cp = malloc((unsigned long)len);
 			if (cmb_transform_find->cp == NULL) {
 				errx(EXIT_FAILURE, "Out of memory?!");
@@ -649,12 +1016,141 @@ main(int argc, char *argv[])
 				"%.*Lf", cmb_transform_precision,
 				cmb_transform_find->as.ld);
 		}
+
+		/*
+		 * Results rounding to num differ from it by at most
+		 * 10^-precision; skip formatting those that are further away
+		 */
+		if (cmb_transform_precision > 0) {
+			cmb_transform_find_tolerance = 2;
+			for (i = 0; i < (uint32_t)cmb_transform_precision; i++)
+				cmb_transform_find_tolerance /= 10;
+		}
+	}
+
+	if (opt_find) {
+		find_add = config->action == cmb_add_find;
+		find_mul = config->action == cmb_mul_find;
+#if defined(HAVE_LIBCRYPTO) && defined(HAVE_OPENSSL_BN_H)
+		find_add |= config->action_bn == cmb_add_find_bn;
+		find_mul |= config->action_bn == cmb_mul_find_bn;
+#endif
+	}
+
+	/*
+	 * Count combinations of each size that `-X add' sums to `-F num' if
+	 * given `-t'; requires whole numbers
+	 */
+	if (opt_find && opt_total) {
+		if (!find_add || !cmb_find_dp_init(&dp, config, nitems, items))
+		{
+			errx(EXIT_FAILURE, "-t: %s with `-F num' (%s)",
+			    strerror(EINVAL), "requires `-X add' on integers");
+			/* NOTREACHED */
+		}
+		if ((counts = calloc(dp.kmax + 1,
+		    sizeof(cmb_find_count_t))) == NULL) {
+			errx(EXIT_FAILURE, "Out of memory?!");
+			/* NOTREACHED */
+		}
+		if ((errno = cmb_find_count(&dp, counts)) != 0) {
+			err(EXIT_FAILURE, "-t");
+			/* NOTREACHED */
+		}
+		if (opt_silent)
+			exit(EXIT_SUCCESS);
+		if (dp.show_empty && dp.setinit <= dp.setdone)
+			cmb_find_count_print(0, counts[0], opt_nulprint);
+		for (i = dp.setinit;; i = i < dp.setdone ? i + 1 : i - 1) {
+			cmb_find_count_print(i, counts[i], opt_nulprint);
+			if (i == dp.setdone)
+				break;
+		}
+		if (dp.show_empty && dp.setinit > dp.setdone)
+			cmb_find_count_print(0, counts[0], opt_nulprint);
+		free(counts);
+		cmb_find_dp_free(&dp);
+		exit(EXIT_SUCCESS);
+	}
+
+	/*
+	 * If every combination would otherwise be enumerated (no `-c num',
+	 * `-i num', or `--shard i/n'), solve `-X add -F num' by dynamic
+	 * programming on whole numbers or meet-in-the-middle, or it and
+	 * `-X multiply -F num' by pruning combinations that cannot reach num
+	 */
+	if (opt_randi || nstart != 0 || config->start != 0 ||
+	    config->count != 0 || config->nshards > 1)
+		find_add = find_mul = FALSE;
+#if defined(HAVE_LIBCRYPTO) && defined(HAVE_OPENSSL_BN_H)
+	if (config->start_bn != NULL || config->count_bn != NULL)
+		find_add = find_mul = FALSE;
+#endif
+	if (find_add && cmb_find_dp_init(&dp, config, nitems, items)) {
+		if (cmb_find_dp_fill(&dp))
+			opt_dp = TRUE;
+		else
+			cmb_find_dp_free(&dp);
+	}
+	if (opt_dp) {
+		/* Chosen above */
+	} else if (find_add && nitems >= CMB_FIND_MITM_MIN &&
+	    nitems <= CMB_FIND_MITM_MAX) {
+		opt_mitm = TRUE;
+	} else if ((find_add || find_mul) && nitems >= CMB_FIND_BOUND_MIN) {
+		/* Products are monotone only in non-negative items */
+		opt_bound = TRUE;
+		for (n = 0; n < nitems; n++) {
+			memcpy(&xitem, &items[n], sizeof(char *));
+			if (isnan(xitem->as.ld) ||
+			    (find_mul && xitem->as.ld < 0))
+				opt_bound = FALSE;
+		}
 	}
 
 	/*
 	 * Calculate combinations
 	 */
-	if (opt_total) {
+	if (opt_dp) {
+		retval = cmb_find_dp(config, nitems, items, &dp);
+		cmb_find_dp_free(&dp);
+	} else if (opt_mitm) {
+		retval = cmb_find_add(config, nitems, items);
+	} else if (opt_bound) {
+		if ((retval = cmb_find_bound(config, nitems, items,
+		    find_mul)) != 0) {
+			errno = retval;
+			err(EXIT_FAILURE, NULL);
+			/* NOTREACHED */
+		}
+	} else if (opt_top || opt_stats) {
+		if (opt_randi || nstart != 0) {
+			count = cmb_count(config, nitems);
+			if (errno) {
+				err(EXIT_FAILURE, NULL);
+				/* NOTREACHED */
+			}
+			if (opt_randi && gettimeofday(&tv, NULL) == 0) {
+				srand48((long)tv.tv_usec);
+				config->start = cmb_rand_range(count) + 1;
+			} else if (nstart != 0)
+				config->start = count > nstart ?
+				    count - nstart + 1 : 0;
+		}
+		if (opt_stats) {
+			retval = cmb_stats_print(config, nitems, items, nbuckets,
+			    opt_precision ? cmb_transform_precision :
+			    MAX(cmb_transform_precision, 6), njobs);
+		} else {
+			config->score = cmb_top_score;
+			retval = cmb_top(config, nitems, items, ntop, njobs);
+		}
+		if (retval != 0) {
+			errno = retval;
+			err(EXIT_FAILURE, NULL);
+			/* NOTREACHED */
+		}
+	} else if (opt_total) {
 #if defined(HAVE_LIBCRYPTO) && defined(HAVE_OPENSSL_BN_H)
 		if (!opt_nossl) {
 			char *count_str;
@@ -705,6 +1201,17 @@ main(int argc, char *argv[])
 		}
 		retval = cmb_bn(config, nitems, items);
 #endif
+	} else if (opt_sample) {
+		ull = 0;
+		if (gettimeofday(&tv, NULL) == 0)
+			ull = ((uint64_t)tv.tv_sec << 20) ^ (uint64_t)tv.tv_usec;
+		ull ^= (uint64_t)getpid() << 40;
+		config->unique = TRUE;
+		retval = cmb_sample(config, nitems, items, config->count, ull);
+		if (errno) {
+			err(EXIT_FAILURE, NULL);
+			/* NOTREACHED */
+		}
 	} else {
 		if (opt_randi) {
 			count = cmb_count(config, nitems);
@@ -727,17 +1234,35 @@ main(int argc, char *argv[])
 			else
 				config->start = 0;
 		}
-		retval = cmb(config, nitems, items);
+		if (njobs > 1)
+			retval = cmb_jobs(config, nitems, items, njobs,
+			    !opt_unordered);
+		else
+			retval = cmb(config, nitems, items);
 		if (errno) {
 			err(EXIT_FAILURE, NULL);
 			/* NOTREACHED */
 		}
 	}
 
+	/*
+	 * Backpressure of `-w' writer thread
+	 */
+	if (opt_wstats) {
+		fprintf(stderr, "writer: %"PRIu64" buffers, %"PRIu64" bytes, "
+		    "%"PRIu64" writes\n", wstats.buffers, wstats.bytes,
+		    wstats.writes);
+		fprintf(stderr, "writer: %"PRIu64" stalls, %.6fs stalled, "
+		    "%.6fs writing, %.6fs idle\n", wstats.stalls,
+		    (double)wstats.stall_ns / 1e9,
+		    (double)wstats.write_ns / 1e9,
+		    (double)wstats.idle_ns / 1e9);
+	}
+
 	/*
 	 * Clean up
 	 */
-	if (opt_file || opt_range) {
+	if (opt_range) {
 		for (n = 0; n < nitems; n++)
 			free(items[n]);
 		free(items);
@@ -749,6 +1274,12 @@ main(int argc, char *argv[])
 			free(xitem);
 		}
 		free(items);
+	} else if (opt_file)
+		free(items);
+	if (opt_file) {
+		for (n = 0; n < nfiles; n++)
+			cmb_parse_free(files[n]);
+		free(files);
 	}
 	if (opt_find) {
 		if (free_find)
@@ -757,6 +1288,7 @@ main(int argc, char *argv[])
 		if (cmb_transform_find_buf != NULL)
 			free(cmb_transform_find_buf);
 	}
+	free(cmb_transform_totals);
 	free(config);
 
 	return (retval);
@@ -774,6 +1306,8 @@ cmb_usage(void)
 	fprintf(stderr, "OPTIONS:\n");
 	fprintf(stderr, OPTFMT, "-0",
 	    "Read items terminated by NUL when given `-f'.");
+	fprintf(stderr, OPTFMT, "-b",
+	    "Binary output of item numbers (see cmb_bin_open(3)).");
 	fprintf(stderr, OPTFMT, "-c num",
 	    "Produce num combinations (default `0' for all).");
 	fprintf(stderr, OPTFMT, "-D",
@@ -785,8 +1319,12 @@ cmb_usage(void)
 	    "Find `-X op' results matching num.");
 	fprintf(stderr, OPTFMT, "-f",
 	    "Treat arguments as files to read items from; `-' for stdin.");
+	fprintf(stderr, OPTFMT, "-H num",
+	    "Print summary of `-X op' results with num-bucket histogram.");
 	fprintf(stderr, OPTFMT, "-i num",
 	    "Skip the first num-1 combinations.");
+	fprintf(stderr, OPTFMT, "-j num",
+	    "Use num threads (`0' for one per CPU), output in order.");
 	fprintf(stderr, OPTFMT, "-k size",
 	    "Number or range (`min..max' or `min-max') of items.");
 	fprintf(stderr, OPTFMT, "-N", "Show combination sequence numbers.");
@@ -803,17 +1341,189 @@ cmb_usage(void)
 	    "Treat arguments as ranges of up-to ", UINT_MAX, " items.");
 	fprintf(stderr, OPTFMT, "-S", "Silent (for performance benchmarks).");
 	fprintf(stderr, OPTFMT, "-s text", "Suffix text for each line.");
+	fprintf(stderr, OPTFMT, "-T num",
+	    "Only the num largest `-X op' results (-num for smallest).");
 	fprintf(stderr, OPTFMT, "-t",
 	    "Print number of combinations and exit.");
+	fprintf(stderr, OPTFMT, "-u",
+	    "Write output of `-j num' threads as it is ready (unordered).");
 	fprintf(stderr, OPTFMT, "-v",
 	    "Print version info to stdout and exit.");
+	fprintf(stderr, OPTFMT, "-W",
+	    "Same as `-w' but print writer metrics to stderr.");
+	fprintf(stderr, OPTFMT, "-w",
+	    "Write output from a second thread while calculating.");
 	fprintf(stderr, OPTFMT, "-X op",
 	    "Perform math on items where `op' is add, sub, div, or mul.");
 	fprintf(stderr, OPTFMT, "-z",
 	    "Print combinations NUL terminated (use with `xargs -0').");
+	fprintf(stderr, OPTFMT, "--shard i/n",
+	    "Produce only shard i of n equal parts of the combinations.");
 	exit(EXIT_FAILURE);
 }
 
+/*
+ * Takes pointer to `struct cmb_config' options, number of items, array of
+ * items, number of threads, and whether output is to be in order. Same as
+ * cmb(3) but combinations are produced by njobs threads (-j num), each taking
+ * the next unit of consecutive combinations and producing it into memory (see
+ * `stream' in cmb(3)). Units are written to stdout in sequence order, for
+ * output identical to cmb(3), or else as soon as each is done (-u).
+ */
+static int
+cmb_jobs(struct cmb_config *config, uint32_t nitems, char *items[],
+    uint32_t njobs, uint8_t ordered)
+{
+	int error;
+	uint32_t n;
+	uint64_t avail;
+	uint64_t first = 1;
+	uint64_t total;
+	struct cmb_job *job;
+	struct cmb_jobs jobs;
+
+	errno = 0;
+
+	/* Determine the range of sequence numbers to produce */
+	if ((total = cmb_count(config, nitems)) == 0) {
+		if (errno != 0)
+			return (errno);
+		return (cmb(config, nitems, items)); /* Nothing to divide */
+	}
+	if (config->nshards > 1) {
+		if ((error = cmb_shard_range(config, nitems, &first,
+		    &avail)) != 0)
+			return (error);
+		if (avail == 0)
+			return (0);
+	} else {
+		if (config->start > 1)
+			first = config->start;
+		if (first > total)
+			return (0);
+		avail = total - first + 1;
+		if (config->count != 0 && config->count < avail)
+			avail = config->count;
+	}
+
+	/* Several units per thread so that none is left idle for long */
+	bzero(&jobs, sizeof(jobs));
+	jobs.ordered = ordered;
+	jobs.nitems = nitems;
+	jobs.items = items;
+	jobs.first = first;
+	jobs.last = first + avail;
+	jobs.unit = avail / ((uint64_t)njobs * 4);
+	if (jobs.unit < 1)
+		jobs.unit = 1;
+	else if (jobs.unit > CMB_JOBS_UNIT_MAX)
+		jobs.unit = CMB_JOBS_UNIT_MAX;
+	jobs.nunits = (avail + jobs.unit - 1) / jobs.unit;
+	if (njobs > jobs.nunits)
+		njobs = (uint32_t)jobs.nunits;
+	pthread_mutex_init(&jobs.mtx, NULL);
+	pthread_mutex_init(&jobs.wmtx, NULL);
+	pthread_cond_init(&jobs.wcv, NULL);
+
+	/* Launch threads */
+	if ((job = calloc(njobs, sizeof(struct cmb_job))) == NULL) {
+		errx(EXIT_FAILURE, "Out of memory?!");
+		/* NOTREACHED */
+	}
+	for (n = 0; n < njobs; n++) {
+		job[n].config = *config;
+		job[n].config.nshards = 0; /* range is already narrowed */
+		job[n].config.thread = n;
+		job[n].jobs = &jobs;
+		if (pthread_create(&job[n].tid, NULL, cmb_jobs_worker,
+		    &job[n]) != 0) {
+			errx(EXIT_FAILURE, "Unable to create thread?!");
+			/* NOTREACHED */
+		}
+	}
+	for (n = 0; n < njobs; n++)
+		pthread_join(job[n].tid, NULL);
+
+	/* Clean up */
+	pthread_cond_destroy(&jobs.wcv);
+	pthread_mutex_destroy(&jobs.wmtx);
+	pthread_mutex_destroy(&jobs.mtx);
+	free(job);
+
+	return (errno = jobs.retval);
+}
+
+/*
+ * cmb_jobs() thread. Produces each claimed unit of work into memory and
+ * writes it to stdout, waiting for its turn if output is ordered. The memory
+ * stream is rewound rather than reopened for each unit so that its buffer is
+ * allocated only once.
+ */
+static void *
+cmb_jobs_worker(void *arg)
+{
+	int retval = 0;
+	uint64_t u;
+	size_t len = 0;
+	char *buf = NULL;
+	FILE *stream = NULL;
+	struct cmb_job *job = arg;
+	struct cmb_jobs *jobs = job->jobs;
+	struct cmb_config *config = &job->config;
+
+	if (!opt_silent && (stream = open_memstream(&buf, &len)) == NULL) {
+		err(EXIT_FAILURE, NULL);
+		/* NOTREACHED */
+	}
+	config->stream = stream;
+
+	for (;;) {
+		pthread_mutex_lock(&jobs->mtx);
+		u = jobs->next;
+		if (u < jobs->nunits)
+			jobs->next++;
+		pthread_mutex_unlock(&jobs->mtx);
+		if (u >= jobs->nunits)
+			break;
+		config->start = jobs->first + u * jobs->unit;
+		config->count = MIN(jobs->unit, jobs->last - config->start);
+
+		/* Produce the unit */
+		if (stream != NULL)
+			rewind(stream);
+		retval = cmb(config, jobs->nitems, jobs->items);
+		if (retval == 0 && errno != 0)
+			retval = errno;
+		if (stream != NULL && fflush(stream) != 0 && retval == 0)
+			retval = errno;
+
+		/* Write it; nothing after a unit that failed if ordered */
+		pthread_mutex_lock(&jobs->wmtx);
+		while (jobs->ordered && jobs->turn != u)
+			pthread_cond_wait(&jobs->wcv, &jobs->wmtx);
+		if (jobs->retval == 0 && len > 0 &&
+		    fwrite(buf, 1, len, stdout) != len && retval == 0)
+			retval = errno;
+		if (jobs->retval == 0)
+			jobs->retval = retval;
+		retval = jobs->retval;
+		jobs->turn++;
+		pthread_cond_broadcast(&jobs->wcv);
+		pthread_mutex_unlock(&jobs->wmtx);
+		if (retval != 0)
+			break; /* units claimed by others are still written */
+	}
+	if (stream != NULL)
+		fclose(stream);
+	free(buf);
+
+	/* Running totals and find results are kept per thread */
+	free(cmb_transform_totals);
+	free(cmb_transform_find_buf);
+
+	return (NULL);
+}
+
 /*
  * Return pseudo-random 64-bit unsigned integer in range 0 <= return <= range.
  */
@@ -828,22 +1538,865 @@ cmb_rand_range(uint64_t range)
 	return (res % range);
 }
 
-static size_t
-numlen(const char *s)
+/*
+ * Half-sums for cmb_find_add(): the sum of each subset of up to 32 items (as
+ * a double) and the subset as a bitmask, sorted by sum.
+ */
+struct cmb_halfsums {
+	double	*sums;
+	uint32_t *masks;
+	size_t	len;
+};
+
+/*
+ * Takes array of item values and number of items (at most 32). Returns the
+ * sums of all subsets in ascending order. Each item doubles the list by
+ * merging it with a copy of itself shifted by the item, so that no sorting is
+ * required; O(2^nitems).
+ */
+static void
+cmb_find_halfsums(struct cmb_halfsums *h, const double *vals, uint32_t nvals)
 {
-	if (s == NULL || *s == '\0')
-		return (0);
-	else if (*s == '-')
-		return (strspn(&s[1], digit) + 1);
-	else
-		return (strspn(s, digit));
+	double d;
+	double *sums;
+	double *tsums;
+	size_t i;
+	size_t j;
+	size_t k;
+	size_t len;
+	size_t size = (size_t)1 << nvals;
+	uint32_t bit;
+	uint32_t n;
+	uint32_t *masks;
+	uint32_t *tmasks;
+
+	if ((sums = malloc(sizeof(double) * size)) == NULL ||
+	    (tsums = malloc(sizeof(double) * size)) == NULL ||
+	    (masks = malloc(sizeof(uint32_t) * size)) == NULL ||
+	    (tmasks = malloc(sizeof(uint32_t) * size)) == NULL) {
+		errx(EXIT_FAILURE, "Out of memory?!");
+		/* NOTREACHED */
+	}
+	sums[0] = 0;
+	masks[0] = 0;
+	for (n = 0, len = 1; n < nvals; n++, len *= 2) {
+		d = vals[n];
+		bit = (uint32_t)1 << n;
+		for (i = j = k = 0; i < len || j < len; k++) {
+			if (j >= len || (i < len && sums[i] <= sums[j] + d)) {
+				tsums[k] = sums[i];
+				tmasks[k] = masks[i++];
+			} else {
+				tsums[k] = sums[j] + d;
+				tmasks[k] = masks[j++] | bit;
+			}
+		}
+		memcpy(sums, tsums, sizeof(double) * len * 2);
+		memcpy(masks, tmasks, sizeof(uint32_t) * len * 2);
+	}
+	free(tsums);
+	free(tmasks);
+	h->sums = sums;
+	h->masks = masks;
+	h->len = len;
 }
 
-static size_t
-rangelen(const char *s, size_t nlen, size_t slen)
-{
-	size_t rlen;
-	const char *cp = s;
+/*
+ * Combinations found by cmb_find_add() or cmb_find_bound() for confirmation by
+ * cmb_find_print(). Each is a row of width uint32_t's: the number of items
+ * followed by the item numbers in ascending order.
+ */
+struct cmb_find_matches {
+	uint32_t *rows;
+	size_t	nrows;
+	size_t	size;		/* Rows allocated */
+	uint32_t width;		/* One more than the largest set */
+};
+
+/* Order of set sizes and direction of cmb_find_cmp() */
+static uint8_t cmb_find_ascending;
+static uint32_t cmb_find_nitems;
+
+/*
+ * Sort combinations (as rows of `struct cmb_find_matches') in the order cmb(3)
+ * produces them: by set size in the direction of `-k', then lexicographically.
+ */
+static int
+cmb_find_cmp(const void *a, const void *b)
+{
+	uint32_t ka;
+	uint32_t kb;
+	uint32_t n;
+	const uint32_t *x = a;
+	const uint32_t *y = b;
+
+	ka = x[0];
+	kb = y[0];
+	if (!cmb_find_ascending) {
+		ka = ka == 0 ? cmb_find_nitems + 1 : cmb_find_nitems - ka;
+		kb = kb == 0 ? cmb_find_nitems + 1 : cmb_find_nitems - kb;
+	}
+	if (ka != kb)
+		return (ka < kb ? -1 : 1);
+	for (n = 1; n <= x[0]; n++) {
+		if (x[n] != y[n])
+			return (x[n] < y[n] ? -1 : 1);
+	}
+	return (0);
+}
+
+/*
+ * Takes pointer to `struct cmb_find_matches', number of items, and array of
+ * item numbers (in ascending order). Appends the combination.
+ */
+static void
+cmb_find_match(struct cmb_find_matches *m, uint32_t setsize,
+    const uint32_t *setnums)
+{
+	uint32_t *row;
+
+	if (m->nrows == m->size) {
+		m->size = m->size == 0 ? 1024 : m->size * 2;
+		m->rows = realloc(m->rows,
+		    sizeof(uint32_t) * m->width * m->size);
+		if (m->rows == NULL) {
+			errx(EXIT_FAILURE, "Out of memory?!");
+			/* NOTREACHED */
+		}
+	}
+	row = &m->rows[m->nrows++ * m->width];
+	row[0] = setsize;
+	memcpy(&row[1], setnums, sizeof(uint32_t) * setsize);
+}
+
+/*
+ * Takes pointer to `struct cmb_config' options, number of items, array of
+ * `struct cmb_xitem *' items, and pointer to `struct cmb_find_matches'
+ * candidates (freed). Passes the candidates in cmb(3) order to the find action
+ * selected in config, which confirms each exactly as if enumerated. Sequence
+ * numbers (if `-N') are calculated by rank.
+ */
+static int
+cmb_find_print(struct cmb_config *config, uint32_t nitems, char *items[],
+    struct cmb_find_matches *m)
+{
+	int retval = 0;
+	size_t i;
+	uint32_t setsize;
+	uint32_t *setnums;
+	uint64_t seq = 0;
+#if defined(HAVE_LIBCRYPTO) && defined(HAVE_OPENSSL_BN_H)
+	BIGNUM *seq_bn = NULL;
+#endif
+
+	cmb_find_nitems = nitems;
+	qsort(m->rows, m->nrows, sizeof(uint32_t) * m->width, cmb_find_cmp);
+	for (i = 0; i < m->nrows && retval == 0; i++) {
+		setsize = m->rows[i * m->width];
+		setnums = &m->rows[i * m->width + 1];
+		config->indices = setsize > 0 ? setnums : NULL;
+		config->changed = 0;
+#if defined(HAVE_LIBCRYPTO) && defined(HAVE_OPENSSL_BN_H)
+		if (config->action_bn != NULL) {
+			if ((config->options & CMB_OPT_NUMBERS) != 0)
+				seq_bn = cmb_rank_bn(config, nitems, setsize,
+				    setnums);
+			retval = config->action_bn(config, seq_bn, setsize,
+			    items);
+			BN_free(seq_bn);
+			seq_bn = NULL;
+			continue;
+		}
+#endif
+		if ((config->options & CMB_OPT_NUMBERS) != 0)
+			seq = cmb_rank(config, nitems, setsize, setnums);
+		retval = config->action(config, seq, setsize, items);
+	}
+	free(m->rows);
+	m->rows = NULL;
+	m->nrows = m->size = 0;
+
+	return (retval);
+}
+
+/*
+ * Takes pointer to `struct cmb_config' options, number of items (at most 64),
+ * and array of `struct cmb_xitem *' items. Finds the combinations that `-X add'
+ * sums to `-F num' by meet-in-the-middle: the sorted subset sums of each half
+ * of the items are merged from opposite ends, so time and memory are about
+ * 2^(nitems/2) instead of 2^nitems. Candidates (found in double precision,
+ * within rounding error of num) are passed in cmb(3) order to the find action
+ * selected in config, which confirms each exactly as if enumerated.
+ */
+static int
+cmb_find_add(struct cmb_config *config, uint32_t nitems, char *items[])
+{
+	uint8_t show_empty = FALSE;
+	uint32_t kmax;
+	uint32_t kmin;
+	uint32_t klo;
+	uint32_t n;
+	uint32_t nlo;
+	uint32_t setdone = nitems;
+	uint32_t setinit = 1;
+	uint32_t setsize;
+	uint32_t setnums[64];
+	double absum = 0;
+	double d;
+	double target;
+	double vals[64];
+	double window;
+	size_t i;
+	size_t j;
+	size_t m;
+	uint64_t mask;
+	struct cmb_find_matches matches = { .rows = NULL };
+	struct cmb_halfsums hi;
+	struct cmb_halfsums lo;
+	struct cmb_xitem *xitem;
+
+	/* Set sizes as cmb(3) normalizes them */
+	if ((config->options & CMB_OPT_EMPTY) != 0)
+		show_empty = TRUE;
+	if (config->size_min != 0 || config->size_max != 0) {
+		setinit = config->size_min;
+		setdone = config->size_max;
+	}
+	if (setinit == 0)
+		setinit = 1;
+	if (setdone == 0)
+		setdone = 1;
+	/* Nothing if out of range, as cmb(3); cmb_bn(3) takes the largest set */
+	if (!show_empty && setinit > nitems && setdone > nitems) {
+#if defined(HAVE_LIBCRYPTO) && defined(HAVE_OPENSSL_BN_H)
+		if (config->action_bn == NULL)
+#endif
+			return (0);
+	}
+	if (setinit > nitems)
+		setinit = nitems;
+	if (setdone > nitems)
+		setdone = nitems;
+	cmb_find_ascending = setinit <= setdone;
+	kmin = MIN(setinit, setdone);
+	kmax = MAX(setinit, setdone);
+	matches.width = kmax + 1;
+
+	/*
+	 * Values in double precision; the window allows for the rounding of
+	 * any sum (and the tolerance of `-P num'), as the find action decides
+	 */
+	for (n = 0; n < nitems; n++) {
+		memcpy(&xitem, &items[n], sizeof(char *));
+		vals[n] = (double)xitem->as.ld;
+		absum += fabs(vals[n]);
+	}
+	target = (double)cmb_transform_find->as.ld;
+	window = (absum + fabs(target)) * 0x1p-40 +
+	    (double)cmb_transform_find_tolerance;
+
+	/* Sorted subset sums of each half */
+	nlo = nitems / 2;
+	cmb_find_halfsums(&lo, vals, nlo);
+	cmb_find_halfsums(&hi, &vals[nlo], nitems - nlo);
+
+	/*
+	 * For each low half-sum in ascending order, the high half-sums
+	 * completing it are a window moving down from the top
+	 */
+	j = hi.len;
+	for (i = 0; i < lo.len; i++) {
+		d = target - lo.sums[i];
+		while (j > 0 && hi.sums[j - 1] > d + window)
+			j--;
+		klo = (uint32_t)__builtin_popcount(lo.masks[i]);
+		for (m = j; m > 0 && hi.sums[m - 1] >= d - window; m--) {
+			setsize = klo +
+			    (uint32_t)__builtin_popcount(hi.masks[m - 1]);
+			if (setsize == 0 ? !show_empty :
+			    setsize < kmin || setsize > kmax)
+				continue;
+			mask = lo.masks[i] |
+			    ((uint64_t)hi.masks[m - 1] << nlo);
+			for (n = 0; mask != 0; mask &= mask - 1)
+				setnums[n++] = (uint32_t)__builtin_ctzll(mask);
+			cmb_find_match(&matches, setsize, setnums);
+		}
+	}
+	free(lo.sums);
+	free(lo.masks);
+	free(hi.sums);
+	free(hi.masks);
+
+	/* Confirm and print matches in the order cmb(3) would */
+	return (cmb_find_print(config, nitems, items, &matches));
+}
+
+/*
+ * Item value and original item number, for sorting by value.
+ */
+struct cmb_find_item {
+	long double val;
+	uint32_t num;
+};
+
+static int
+cmb_find_item_cmp(const void *a, const void *b)
+{
+	const struct cmb_find_item *x = a;
+	const struct cmb_find_item *y = b;
+
+	if (x->val != y->val)
+		return (x->val < y->val ? -1 : 1);
+	return (x->num < y->num ? -1 : x->num > y->num);
+}
+
+/*
+ * State for cmb_find_prune() and cmb_find_collect(), passed as config data.
+ * Items are in ascending order of value, so the least total of combinations
+ * beginning with a prefix completes it with the items immediately following,
+ * and the greatest with the largest items.
+ */
+struct cmb_find_sorted {
+	uint8_t	mul;		/* `-X multiply' rather than `-X add' */
+	long double target;	/* Value of `-F num' */
+	long double window;	/* Allowance for rounding (and `-P num') */
+	long double *vals;	/* Item values in ascending order */
+	long double *sums;	/* Sum of the first n values */
+	long double *best;	/* Total of the largest n values */
+	long double *totals;	/* Total of the prefix up to each depth */
+	uint32_t *order;	/* Original item number of each value */
+	uint32_t *setnums;	/* Original item numbers of a combination */
+	struct cmb_find_matches matches;
+};
+
+/*
+ * Bound for `-X add' (any values) and `-X multiply' (non-negative values) on
+ * items sorted by value. Skips prefixes whose least total exceeds `-F num',
+ * along with those ending in a greater item, and prefixes whose greatest total
+ * falls short of it. The total of each prefix extends that of its parent,
+ * which cmb(3) always passes first.
+ */
+static
+CMB_BOUND(cmb_find_prune)
+{
+	uint32_t c = setnums[depth - 1];
+	uint32_t n;
+	uint32_t r = setsize - depth;
+	long double hi;
+	long double lo;
+	long double total;
+	struct cmb_find_sorted *fs = config->data;
+
+	total = fs->vals[c];
+	if (depth > 1)
+		total = fs->mul ? fs->totals[depth - 2] * total :
+		    fs->totals[depth - 2] + total;
+	fs->totals[depth - 1] = total;
+
+	if (fs->mul) {
+		for (lo = total, n = c + 1; n <= c + r; n++)
+			lo *= fs->vals[n];
+		hi = total * fs->best[r];
+	} else {
+		lo = total + (fs->sums[c + 1 + r] - fs->sums[c + 1]);
+		hi = total + fs->best[r];
+	}
+	if (lo > fs->target + fs->window)
+		return (CMB_BOUND_SKIPALL);
+	if (hi < fs->target - fs->window)
+		return (CMB_BOUND_SKIP);
+	return (CMB_BOUND_DESCEND);
+}
+
+/*
+ * Records each combination not pruned, by original item numbers, for
+ * cmb_find_print().
+ */
+static
+CMB_ACTION(cmb_find_collect)
+{
+	uint32_t k;
+	uint32_t m;
+	uint32_t n;
+	struct cmb_find_sorted *fs = config->data;
+
+	(void)seq;
+	(void)items;
+
+	for (n = 0; n < nitems; n++) {
+		k = fs->order[config->indices[n]];
+		for (m = n; m > 0 && fs->setnums[m - 1] > k; m--)
+			fs->setnums[m] = fs->setnums[m - 1];
+		fs->setnums[m] = k;
+	}
+	cmb_find_match(&fs->matches, nitems, fs->setnums);
+
+	return (0);
+}
+
+#if defined(HAVE_LIBCRYPTO) && defined(HAVE_OPENSSL_BN_H)
+static
+CMB_ACTION_BN(cmb_find_collect_bn)
+{
+	(void)seq;
+
+	return (cmb_find_collect(config, 0, nitems, items));
+}
+#endif
+
+/*
+ * Takes pointer to `struct cmb_config' options, number of items, array of
+ * `struct cmb_xitem *' items, and whether the find action is `-X multiply'
+ * (items must then be non-negative) rather than `-X add'. Finds combinations
+ * by enumerating the items sorted by value depth-first, with cmb_find_prune()
+ * as the bound function skipping every prefix that cannot reach `-F num'. If
+ * sorting reordered the items, candidates are collected and passed to the find
+ * action in the order of the original items by cmb_find_print(); otherwise
+ * they are passed as enumerated.
+ */
+static int
+cmb_find_bound(struct cmb_config *config, uint32_t nitems, char *items[],
+    uint8_t mul)
+{
+	uint8_t collect = FALSE;
+	int retval;
+	uint32_t n;
+	uint32_t setdone = nitems;
+	uint32_t setinit = 1;
+	long double absum = 0;
+	char **sitems;
+	struct cmb_config cfg;
+	struct cmb_find_item *sorted;
+	struct cmb_find_sorted fs = { .mul = mul, .matches = { .rows = NULL } };
+	struct cmb_xitem *xitem;
+
+	/* Sort by value, keeping the original item numbers */
+	if ((sorted = malloc(sizeof(*sorted) * nitems)) == NULL ||
+	    (sitems = malloc(sizeof(char *) * nitems)) == NULL ||
+	    (fs.vals = malloc(sizeof(long double) * nitems)) == NULL ||
+	    (fs.sums = malloc(sizeof(long double) * (nitems + 1))) == NULL ||
+	    (fs.best = malloc(sizeof(long double) * (nitems + 1))) == NULL ||
+	    (fs.totals = malloc(sizeof(long double) * nitems)) == NULL ||
+	    (fs.order = malloc(sizeof(uint32_t) * nitems)) == NULL ||
+	    (fs.setnums = malloc(sizeof(uint32_t) * nitems)) == NULL) {
+		errx(EXIT_FAILURE, "Out of memory?!");
+		/* NOTREACHED */
+	}
+	for (n = 0; n < nitems; n++) {
+		memcpy(&xitem, &items[n], sizeof(char *));
+		sorted[n].val = xitem->as.ld;
+		sorted[n].num = n;
+		absum += fabsl(xitem->as.ld);
+	}
+	qsort(sorted, nitems, sizeof(*sorted), cmb_find_item_cmp);
+	fs.sums[0] = 0;
+	fs.best[0] = mul ? 1 : 0;
+	for (n = 0; n < nitems; n++) {
+		fs.vals[n] = sorted[n].val;
+		fs.order[n] = sorted[n].num;
+		if (fs.order[n] != n)
+			collect = TRUE;
+		sitems[n] = items[fs.order[n]];
+		fs.sums[n + 1] = fs.sums[n] + fs.vals[n];
+		fs.best[n + 1] = mul ? fs.best[n] * sorted[nitems - 1 - n].val :
+		    fs.best[n] + sorted[nitems - 1 - n].val;
+	}
+	free(sorted);
+
+	/*
+	 * The window allows for the rounding of any total, as computed here
+	 * and by the find action (and the tolerance of `-P num')
+	 */
+	fs.target = cmb_transform_find->as.ld;
+	if (mul)
+		fs.window = (fabsl(fs.target) + cmb_transform_find_tolerance) *
+		    0x1p-40L;
+	else
+		fs.window = (absum + fabsl(fs.target)) * 0x1p-40L;
+	fs.window += cmb_transform_find_tolerance;
+
+	/* Enumerate in place if already sorted */
+	if (!collect) {
+		config->bound = cmb_find_prune;
+		config->data = &fs;
+#if defined(HAVE_LIBCRYPTO) && defined(HAVE_OPENSSL_BN_H)
+		if (config->action_bn != NULL)
+			retval = cmb_bn(config, nitems, items);
+		else
+#endif
+		retval = cmb(config, nitems, items);
+		config->bound = NULL;
+		config->data = NULL;
+		goto cmb_find_bound_return;
+	}
+
+	/* Collect candidates from the sorted items */
+	if (config->size_min != 0 || config->size_max != 0) {
+		setinit = config->size_min;
+		setdone = config->size_max;
+	}
+	if (setinit == 0)
+		setinit = 1;
+	if (setdone == 0)
+		setdone = 1;
+	if (setinit > nitems)
+		setinit = nitems;
+	if (setdone > nitems)
+		setdone = nitems;
+	cmb_find_ascending = setinit <= setdone;
+	fs.matches.width = MAX(setinit, setdone) + 1;
+	cfg = *config;
+	cfg.bound = cmb_find_prune;
+	cfg.data = &fs;
+	cfg.options |= CMB_OPT_INDICES;
+	cfg.action = cmb_find_collect;
+#if defined(HAVE_LIBCRYPTO) && defined(HAVE_OPENSSL_BN_H)
+	if (config->action_bn != NULL) {
+		cfg.action_bn = cmb_find_collect_bn;
+		retval = cmb_bn(&cfg, nitems, sitems);
+	} else
+#endif
+	retval = cmb(&cfg, nitems, sitems);
+	if (retval == 0)
+		retval = cmb_find_print(config, nitems, items, &fs.matches);
+	free(fs.matches.rows);
+
+cmb_find_bound_return:
+	free(sitems);
+	free(fs.vals);
+	free(fs.sums);
+	free(fs.best);
+	free(fs.totals);
+	free(fs.order);
+	free(fs.setnums);
+
+	return (retval);
+}
+
+/*
+ * Takes pointer to `struct cmb_find_dp' (written-to), pointer to `struct
+ * cmb_config' options, number of items, and array of `struct cmb_xitem *'
+ * items. Returns FALSE unless every item and `-F num' is a whole number of at
+ * most 2^32 in magnitude (so that no sum overflows), TRUE otherwise.
+ */
+static uint8_t
+cmb_find_dp_init(struct cmb_find_dp *dp, struct cmb_config *config,
+    uint32_t nitems, char *items[])
+{
+	uint32_t n;
+	int64_t hi;
+	int64_t neg = 0;
+	int64_t pos = 0;
+	long double ld;
+	struct cmb_xitem *xitem;
+
+	memset(dp, 0, sizeof(*dp));
+	ld = cmb_transform_find->as.ld;
+	if (nitems == 0 || !(fabsl(ld) <= UINT32_MAX) ||
+	    ld != (long double)(int64_t)ld)
+		return (FALSE);
+	dp->target = (int64_t)ld;
+	if ((dp->vals = malloc(sizeof(int64_t) * nitems)) == NULL ||
+	    (dp->totals = malloc(sizeof(int64_t) * nitems)) == NULL) {
+		errx(EXIT_FAILURE, "Out of memory?!");
+		/* NOTREACHED */
+	}
+	for (n = 0; n < nitems; n++) {
+		memcpy(&xitem, &items[n], sizeof(char *));
+		ld = xitem->as.ld;
+		if (!(fabsl(ld) <= UINT32_MAX) ||
+		    ld != (long double)(int64_t)ld) {
+			free(dp->vals);
+			free(dp->totals);
+			return (FALSE);
+		}
+		dp->vals[n] = (int64_t)ld;
+		if (dp->vals[n] < 0)
+			neg += dp->vals[n];
+		else
+			pos += dp->vals[n];
+	}
+	dp->nitems = nitems;
+
+	/* Set sizes as cmb(3) normalizes them */
+	if ((config->options & CMB_OPT_EMPTY) != 0)
+		dp->show_empty = TRUE;
+	dp->setinit = 1;
+	dp->setdone = nitems;
+	if (config->size_min != 0 || config->size_max != 0) {
+		dp->setinit = MAX(MIN(config->size_min, nitems), 1);
+		dp->setdone = MAX(MIN(config->size_max, nitems), 1);
+	}
+	dp->kmax = MAX(dp->setinit, dp->setdone);
+
+	dp->lo = MAX(neg, dp->target - pos);
+	hi = MIN(pos, dp->target - neg);
+	if (dp->lo <= hi)
+		dp->nbits = (size_t)(hi - dp->lo) + 1;
+	dp->nwords = (dp->nbits + 63) / 64;
+
+	return (TRUE);
+}
+
+static void
+cmb_find_dp_free(struct cmb_find_dp *dp)
+{
+	free(dp->vals);
+	free(dp->totals);
+	free(dp->reach);
+}
+
+/*
+ * Bitset of sums reachable with k of the items from i on.
+ */
+static inline uint64_t *
+cmb_find_dp_row(struct cmb_find_dp *dp, uint32_t i, uint32_t k)
+{
+	return (&dp->reach[((size_t)i * (dp->kmax + 1) + k) * dp->nwords]);
+}
+
+/*
+ * Takes pointer to `struct cmb_find_dp', first item, number of items, and
+ * sum. Returns TRUE if k of the items from i on sum to it, FALSE otherwise.
+ */
+static inline uint8_t
+cmb_find_dp_has(struct cmb_find_dp *dp, uint32_t i, uint32_t k, int64_t sum)
+{
+	uint64_t p;
+
+	if (sum < dp->lo || sum - dp->lo >= (int64_t)dp->nbits)
+		return (FALSE);
+	p = (uint64_t)(sum - dp->lo);
+	return ((cmb_find_dp_row(dp, i, k)[p / 64] >> (p % 64) & 1) != 0);
+}
+
+/*
+ * Takes bitset (written-to), bitset, number of words, and shift. ORs src
+ * shifted toward higher bits by shift (lower if negative) into dst a word at
+ * a time, dropping bits shifted past either end.
+ */
+static void
+cmb_find_dp_shor(uint64_t *dst, const uint64_t *src, size_t nwords,
+    int64_t shift)
+{
+	size_t j;
+	size_t ws;
+	unsigned bs;
+
+	ws = (size_t)(shift < 0 ? -shift : shift) / 64;
+	bs = (unsigned)((shift < 0 ? -shift : shift) % 64);
+	if (ws >= nwords)
+		return;
+	if (shift >= 0) {
+		for (j = nwords - 1; j > ws; j--)
+			dst[j] |= src[j - ws] << bs |
+			    (bs == 0 ? 0 : src[j - ws - 1] >> (64 - bs));
+		dst[ws] |= src[0] << bs;
+	} else {
+		for (j = 0; j + ws + 1 < nwords; j++)
+			dst[j] |= src[j + ws] >> bs |
+			    (bs == 0 ? 0 : src[j + ws + 1] << (64 - bs));
+		dst[j] |= src[j + ws] >> bs;
+	}
+}
+
+/*
+ * Takes pointer to `struct cmb_find_dp'. Fills the table of sums reachable
+ * with each number of items (up to the largest set) from each item on, last
+ * item first, in O(nitems * kmax * nbits / 64). Returns FALSE if the table
+ * would exceed CMB_FIND_DP_MAX bytes, TRUE otherwise.
+ */
+static uint8_t
+cmb_find_dp_fill(struct cmb_find_dp *dp)
+{
+	uint32_t i;
+	uint32_t k;
+	size_t len;
+	uint64_t *row;
+	uint64_t mask;
+
+	if (dp->nwords > CMB_FIND_DP_MAX / sizeof(uint64_t) /
+	    (dp->kmax + 1) / ((size_t)dp->nitems + 1))
+		return (FALSE);
+	len = (size_t)(dp->nitems + 1) * (dp->kmax + 1) * dp->nwords;
+	if ((dp->reach = calloc(len == 0 ? 1 : len,
+	    sizeof(uint64_t))) == NULL) {
+		errx(EXIT_FAILURE, "Out of memory?!");
+		/* NOTREACHED */
+	}
+	if (dp->nbits == 0)
+		return (TRUE);
+
+	/* Bits past the last sum would come back down with negative items */
+	mask = dp->nbits % 64 == 0 ? ~(uint64_t)0 :
+	    ((uint64_t)1 << dp->nbits % 64) - 1;
+
+	/* None of no items sum to zero */
+	if (dp->lo <= 0 && -dp->lo < (int64_t)dp->nbits)
+		cmb_find_dp_row(dp, dp->nitems, 0)[-dp->lo / 64] |=
+		    (uint64_t)1 << (-dp->lo % 64);
+	for (i = dp->nitems; i-- > 0;) {
+		for (k = 0; k <= dp->kmax; k++) {
+			row = cmb_find_dp_row(dp, i, k);
+			memcpy(row, cmb_find_dp_row(dp, i + 1, k),
+			    sizeof(uint64_t) * dp->nwords);
+			if (k == 0 || k > dp->nitems - i)
+				continue;
+			cmb_find_dp_shor(row, cmb_find_dp_row(dp, i + 1, k - 1),
+			    dp->nwords, dp->vals[i]);
+			row[dp->nwords - 1] &= mask;
+		}
+	}
+
+	return (TRUE);
+}
+
+/*
+ * Bound for `-X add' on whole numbers; exact, so only prefixes of matching
+ * combinations are descended into. The total of each prefix extends that of
+ * its parent, which cmb(3) always passes first.
+ */
+static
+CMB_BOUND(cmb_find_reach)
+{
+	uint32_t c = setnums[depth - 1];
+	uint32_t r = setsize - depth;
+	int64_t total;
+	struct cmb_find_dp *dp = config->data;
+
+	total = depth > 1 ? dp->totals[depth - 2] : 0;
+	if (!cmb_find_dp_has(dp, c, r + 1, dp->target - total))
+		return (CMB_BOUND_SKIPALL);
+	total += dp->vals[c];
+	dp->totals[depth - 1] = total;
+	if (!cmb_find_dp_has(dp, c + 1, r, dp->target - total))
+		return (CMB_BOUND_SKIP);
+	return (CMB_BOUND_DESCEND);
+}
+
+/*
+ * Takes pointer to `struct cmb_config' options, number of items, array of
+ * `struct cmb_xitem *' items, and pointer to filled `struct cmb_find_dp'.
+ * Finds the combinations that `-X add' sums to `-F num', with cmb_find_reach()
+ * as the bound function, in O(nitems) per combination found (not counting the
+ * table). Combinations are passed to the find action as enumerated.
+ */
+static int
+cmb_find_dp(struct cmb_config *config, uint32_t nitems, char *items[],
+    struct cmb_find_dp *dp)
+{
+	int retval;
+
+	config->bound = cmb_find_reach;
+	config->data = dp;
+#if defined(HAVE_LIBCRYPTO) && defined(HAVE_OPENSSL_BN_H)
+	if (config->action_bn != NULL)
+		retval = cmb_bn(config, nitems, items);
+	else
+#endif
+	retval = cmb(config, nitems, items);
+	config->bound = NULL;
+	config->data = NULL;
+
+	return (retval);
+}
+
+/*
+ * Takes pointer to `struct cmb_find_dp' and pointer to array of kmax+1 counts
+ * (written-to). Counts the combinations of each size that sum to `-F num',
+ * adding one item at a time, in O(nitems * kmax * nbits). Returns zero on
+ * success, ERANGE if a count overflows, or ENOMEM if the table would exceed
+ * CMB_FIND_DP_MAX bytes.
+ */
+static int
+cmb_find_count(struct cmb_find_dp *dp, cmb_find_count_t *counts)
+{
+	uint32_t i;
+	uint32_t k;
+	int64_t v;
+	size_t p;
+	size_t q;
+	cmb_find_count_t *dst;
+	cmb_find_count_t *src;
+	cmb_find_count_t *table;
+
+	memset(counts, 0, sizeof(cmb_find_count_t) * (dp->kmax + 1));
+	if (dp->nbits == 0)
+		return (0);
+	if (dp->nbits > CMB_FIND_DP_MAX / sizeof(cmb_find_count_t) /
+	    (dp->kmax + 1))
+		return (ENOMEM);
+	if ((table = calloc((size_t)(dp->kmax + 1) * dp->nbits,
+	    sizeof(cmb_find_count_t))) == NULL) {
+		errx(EXIT_FAILURE, "Out of memory?!");
+		/* NOTREACHED */
+	}
+
+	/* One combination of no items sums to zero */
+	if (dp->lo <= 0 && -dp->lo < (int64_t)dp->nbits)
+		table[-dp->lo] = 1;
+	for (i = 0; i < dp->nitems; i++) {
+		v = dp->vals[i];
+		for (k = MIN(i + 1, dp->kmax); k > 0; k--) {
+			dst = &table[k * dp->nbits];
+			src = &table[(k - 1) * dp->nbits];
+			for (p = 0; p < dp->nbits; p++) {
+				q = p - (size_t)v;
+				if (q >= dp->nbits || src[q] == 0)
+					continue;
+				if (dst[p] > (cmb_find_count_t)~0 - src[q]) {
+					free(table);
+					return (ERANGE);
+				}
+				dst[p] += src[q];
+			}
+		}
+	}
+	if (dp->target >= dp->lo && dp->target - dp->lo < (int64_t)dp->nbits) {
+		for (k = 0; k <= dp->kmax; k++)
+			counts[k] = table[k * dp->nbits +
+			    (size_t)(dp->target - dp->lo)];
+	}
+	free(table);
+
+	return (0);
+}
+
+/*
+ * Takes set size, count, and whether to terminate with NUL rather than
+ * newline. Prints the set size and count for `-t -F num'.
+ */
+static void
+cmb_find_count_print(uint32_t setsize, cmb_find_count_t count, uint8_t nul)
+{
+	char buf[40];
+	char *cp = &buf[sizeof(buf) - 1];
+
+	*cp = '\0';
+	do {
+		*--cp = digit[count % 10];
+		count /= 10;
+	} while (count != 0);
+	printf("%u %s%c", setsize, cp, nul ? '\0' : '\n');
+}
+
+static size_t
+numlen(const char *s)
+{
+	if (s == NULL || *s == '\0')
+		return (0);
+	else if (*s == '-')
+		return (strspn(&s[1], digit) + 1);
+	else
+		return (strspn(s, digit));
+}
+
+static size_t
+rangelen(const char *s, size_t nlen, size_t slen)
+{
+	size_t rlen;
+	const char *cp = s;
 
 	if (nlen == 0)
 		return (0);
@@ -977,7 +2530,7 @@ parse_unum(const char *s, uint32_t *n)
 		return (FALSE);
 	}
 
-	ull = strtoull(optarg, (char **)NULL, 10);
+	ull = strtoull(s, (char **)NULL, 10);
 	if (errno != 0)
 		return (FALSE);
 	else if (ull > UINT_MAX) {
@@ -990,6 +2543,38 @@ parse_unum(const char *s, uint32_t *n)
 	return (TRUE);
 }
 
+static uint8_t
+parse_shard(const char *s, uint32_t *shard, uint32_t *nshards)
+{
+	size_t nlen;
+	uint64_t ull;
+
+	errno = 0;
+
+	if (s == NULL || (nlen = unumlen(s)) == 0 || s[nlen] != '/') {
+		errno = EINVAL;
+		return (FALSE);
+	}
+
+	ull = strtoull(s, (char **)NULL, 10);
+	if (errno != 0)
+		return (FALSE);
+	else if (ull > UINT_MAX) {
+		errno = ERANGE;
+		return (FALSE);
+	}
+	if (!parse_unum(&s[nlen + 1], nshards))
+		return (FALSE);
+	if (ull < 1 || ull > *nshards) {
+		errno = EINVAL;
+		return (FALSE);
+	}
+
+	*shard = (uint32_t)ull;
+
+	return (TRUE);
+}
+
 static uint8_t
 parse_urange(const char *s, uint32_t *min, uint32_t *max)
 {
@@ -1173,3 +2758,162 @@ static CMB_TRANSFORM_OP_FIND_BN(/, cmb_div_find_bn);
 static CMB_TRANSFORM_OP_FIND_BN(+, cmb_add_find_bn);
 static CMB_TRANSFORM_OP_FIND_BN(-, cmb_sub_find_bn);
 #endif
+
+/*
+ * Score transformation functions
+ */
+static CMB_TRANSFORM_OP_SCORE(*, cmb_mul_score);
+static CMB_TRANSFORM_OP_SCORE(/, cmb_div_score);
+static CMB_TRANSFORM_OP_SCORE(+, cmb_add_score);
+static CMB_TRANSFORM_OP_SCORE(-, cmb_sub_score);
+
+/*
+ * Score a combination for cmb_top(3) given `-T num' by its `-X op' result;
+ * the lowest scores are kept, so largest results are kept by negating them and
+ * those nearest to `-F num' by their distance from it.
+ */
+static CMB_SCORE(cmb_top_score)
+{
+	long double total = cmb_xscore(config, seq, nitems, items);
+
+	switch (cmb_top_order) {
+	case CMB_TOP_LARGEST:
+		return (-total);
+	case CMB_TOP_NEAREST:
+		return (fabsl(total - cmb_transform_find->as.ld));
+	default:
+		return (total);
+	}
+}
+
+/*
+ * Accumulate the `-X op' result of a combination into the summary of the
+ * calling thread given `-H num'. The first pass finds count, min, max and sum;
+ * the second counts results into buckets spanning min to max.
+ */
+static CMB_ACTION(cmb_stats_action)
+{
+	uint64_t b;
+	long double total = cmb_xscore(config, seq, nitems, items);
+	struct cmb_stats *stats = config->data;
+
+	stats = &stats[config->thread];
+	if (isnan(total)) {
+		if (stats->hist == NULL)
+			stats->nans++;
+		return (0);
+	}
+	if (stats->hist != NULL) {
+		b = 0;
+		if (cmb_stats_width > 0)
+			b = (uint64_t)((total - cmb_stats_lo) / cmb_stats_width);
+		if (b >= cmb_stats_nbuckets)
+			b = cmb_stats_nbuckets - 1;
+		stats->hist[b]++;
+		return (0);
+	}
+	if (stats->count == 0 || total < stats->min)
+		stats->min = total;
+	if (stats->count == 0 || total > stats->max)
+		stats->max = total;
+	stats->sum += total;
+	stats->count++;
+	return (0);
+}
+
+/*
+ * Print count, min, max and mean of the `-X op' results of all combinations
+ * and, given buckets, a histogram of them (-H num) without producing any
+ * combination. Each of nthreads (zero for one per CPU) cmb_parallel(3) threads
+ * keeps its own summary, merged at the end; the histogram takes a second pass
+ * once min and max are known.
+ */
+static int
+cmb_stats_print(struct cmb_config *config, uint32_t nitems, char *items[],
+    uint32_t nbuckets, int meanprec, uint32_t nthreads)
+{
+	uint32_t b;
+	uint32_t n;
+	int retval;
+	long ncpu;
+	struct cmb_stats all;
+	struct cmb_stats *stats;
+
+	if (nthreads == 0) {
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = ncpu > 0 ? (uint32_t)ncpu : 1;
+	}
+	if ((stats = calloc(nthreads, sizeof(struct cmb_stats))) == NULL) {
+		errx(EXIT_FAILURE, "Out of memory?!");
+		/* NOTREACHED */
+	}
+	config->action = cmb_stats_action;
+	config->data = stats;
+	if ((retval = cmb_parallel(config, nitems, items, nthreads)) != 0) {
+		free(stats);
+		return (retval);
+	}
+
+	/* Merge the summaries */
+	bzero(&all, sizeof(all));
+	for (n = 0; n < nthreads; n++) {
+		all.nans += stats[n].nans;
+		if (stats[n].count == 0)
+			continue;
+		if (all.count == 0 || stats[n].min < all.min)
+			all.min = stats[n].min;
+		if (all.count == 0 || stats[n].max > all.max)
+			all.max = stats[n].max;
+		all.sum += stats[n].sum;
+		all.count += stats[n].count;
+	}
+
+	/* Histogram of finite results */
+	if (nbuckets > 0 && all.count > 0 && !isinf(all.min) &&
+	    !isinf(all.max)) {
+		cmb_stats_nbuckets = nbuckets;
+		cmb_stats_lo = all.min;
+		cmb_stats_width = (all.max - all.min) / nbuckets;
+		for (n = 0; n < nthreads; n++) {
+			if ((stats[n].hist =
+			    calloc(nbuckets, sizeof(uint64_t))) == NULL) {
+				errx(EXIT_FAILURE, "Out of memory?!");
+				/* NOTREACHED */
+			}
+		}
+		if ((retval = cmb_parallel(config, nitems, items,
+		    nthreads)) == 0) {
+			all.hist = stats[0].hist;
+			for (n = 1; n < nthreads; n++) {
+				for (b = 0; b < nbuckets; b++)
+					all.hist[b] += stats[n].hist[b];
+			}
+		}
+	}
+
+	if (retval == 0 && !opt_silent) {
+		printf("count %"PRIu64"\n", all.count + all.nans);
+		if (all.nans > 0)
+			printf("nan %"PRIu64"\n", all.nans);
+		if (all.count > 0) {
+			/* Adding zero turns -0 into 0 */
+			printf("min %.*Lf\n", cmb_transform_precision,
+			    all.min + 0.0L);
+			printf("max %.*Lf\n", cmb_transform_precision,
+			    all.max + 0.0L);
+			printf("mean %.*Lf\n", meanprec, all.sum / all.count);
+		}
+		for (b = 0; all.hist != NULL && b < nbuckets; b++) {
+			printf("%.*Lf..%.*Lf %"PRIu64"\n",
+			    meanprec, all.min + b * cmb_stats_width,
+			    meanprec, b == nbuckets - 1 ? all.max :
+			    all.min + (b + 1) * cmb_stats_width, all.hist[b]);
+		}
+	}
+
+	for (n = 0; n < nthreads; n++)
+		free(stats[n].hist);
+	free(stats);
+
+	return (retval);
+}
@@ -4,7 +4,9 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
 #include <err.h>
 #include <errno.h>
@@ -12,11 +14,15 @@
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 #include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "cmb.h"
@@ -40,12 +46,40 @@
 #define PATH_MAX 1024
 #endif
 
-#ifndef CMB_PARSE_FRAGSIZE
-#define CMB_PARSE_FRAGSIZE 512
+/*
+ * cmb_parallel() divides the work into units of at most GRAIN_MAX
+ * combinations, aiming for SPLIT units per thread.
+ */
+#ifndef CMB_PARALLEL_SPLIT
+#define CMB_PARALLEL_SPLIT 64
+#endif
+#ifndef CMB_PARALLEL_GRAIN_MAX
+#define CMB_PARALLEL_GRAIN_MAX (64 * 1024)
+#endif
+
+/*
+ * Output buffer size for cmb_print() and cmb_print_bn() when called by cmb()
+ * and cmb_bn() (see `struct cmb_out').
+ */
+#ifndef CMB_PRINT_BUFSIZE
+#define CMB_PRINT_BUFSIZE BUFSIZE_SMALL
+#endif
+
+/*
+ * Exact counts of combinations are calculated in the widest native unsigned
+ * integer available; cmb_count_bn() and cmb_bn() only fall back to bn(3)
+ * arithmetic beyond that.
+ */
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 cmb_count_t;
+#else
+typedef uint64_t cmb_count_t;
 #endif
+#define CMB_COUNT_MAX	((cmb_count_t)~(cmb_count_t)0)
+#define CMB_COUNT_BITS	(sizeof(cmb_count_t) * 8)
 
-static const char version[] = "libcmb 3.5.6";
-static const char version_long[] = "$Version: libcmb 3.5.6 $";
+static const char version[] = "libcmb 4.0.0";
+static const char version_long[] = "$Version: libcmb 4.0.0 $";
 
 /*
  * Build info
@@ -57,10 +91,13 @@ struct cmb_build_info cmb_build_info = {
 /*
  * Globals
  */
-int cmb_transform_find_buf_size = 0;
+CMB_THREAD_LOCAL int cmb_transform_find_buf_size = 0;
 int cmb_transform_precision = 0;
-char *cmb_transform_find_buf = NULL;
+CMB_THREAD_LOCAL char *cmb_transform_find_buf = NULL;
 struct cmb_xitem *cmb_transform_find = NULL;
+long double cmb_transform_find_tolerance = 0;
+CMB_THREAD_LOCAL long double *cmb_transform_totals = NULL;
+CMB_THREAD_LOCAL uint32_t cmb_transform_totals_size = 0;
 
 #if CMB_DEBUG
 __attribute__((__format__ (__printf__, 1, 0)))
@@ -107,7 +144,8 @@ cmb_version(int type)
  * Takes pointer to `struct cmb_config' options, file path to read items from,
  * pointer to uint32_t (written-to, containing number of items read), and
  * uint32_t to optionally maximum number of items read from file. Returns
- * allocated array of char * items read from file.
+ * allocated array of char * items read from file (to be released with
+ * cmb_parse_free()).
  */
 char **
 cmb_parse_file(struct cmb_config *config, char *path, uint32_t *nitems,
@@ -143,11 +181,26 @@ cmb_parse_file(struct cmb_config *config, char *path, uint32_t *nitems,
 	return (cmb_parse(config, fd, nitems, max));
 }
 
+/*
+ * Items returned by cmb_parse() point into a single buffer holding the input
+ * with each delimiter replaced by NUL. The buffer is either a private (copy-
+ * on-write) mapping of a regular file or heap memory filled by read(2). The
+ * items array is allocated exactly once and NULL terminated; this trailer
+ * follows the terminator so that cmb_parse_free() can release the buffer
+ * while the array itself remains at the start of its allocation (and may
+ * still be released by free(3)).
+ */
+struct cmb_parse_buf {
+	char *data;	/* input buffer */
+	size_t maplen;	/* length of mapping (0 if data was allocated) */
+};
+
 /*
  * Takes pointer to `struct cmb_config' options, file descriptor to read items
  * from, pointer to uint32_t (written-to, containing number of items read), and
  * uint32_t to optionally maximum number of items read from file. Returns
- * allocated array of char * items read from file.
+ * allocated array of char * items read from file (to be released with
+ * cmb_parse_free()).
  */
 char **
 cmb_parse(struct cmb_config *config, int fd, uint32_t *nitems, uint32_t max)
@@ -156,19 +209,24 @@ cmb_parse(struct cmb_config *config, int fd, uint32_t *nitems, uint32_t max)
 #if CMB_DEBUG
 	uint8_t debug = FALSE;
 #endif
-	uint32_t _nitems;
-	char **items = NULL;
-	char *b, *buf;
+	uint8_t term;
+	uint64_t _nitems;
+	uint64_t total;
+	char *buf = NULL;
+	char *end;
 	char *p;
-	uint64_t n;
+	char *q;
+	char **items;
+	long pagesize;
 	size_t bufsize, buflen;
 	size_t datasize = 0;
-	size_t fragsize = sizeof(char *) * CMB_PARSE_FRAGSIZE;
-	size_t itemsize = fragsize;
+	size_t maplen = 0;
 	ssize_t r = 1;
+	struct cmb_parse_buf pb;
 	struct stat sb;
 
 	errno = 0;
+	*nitems = 0;
 
 	/* Process config options */
 	if (config != NULL) {
@@ -183,58 +241,86 @@ cmb_parse(struct cmb_config *config, int fd, uint32_t *nitems, uint32_t max)
 #endif
 	}
 
-	/* Use output block size as buffer size if available */
-	if (fstat(fd, &sb) != 0) {
-		if (S_ISREG(sb.st_mode)) {
-			if (sysconf(_SC_PHYS_PAGES) >
-			    PHYSPAGES_THRESHOLD)
-				bufsize = MIN(BUFSIZE_MAX, MAXPHYS * 8);
-			else
-				bufsize = BUFSIZE_SMALL;
-		} else
-			bufsize = (size_t)MAX(sb.st_blksize,
-			    (blksize_t)sysconf(_SC_PAGESIZE));
-	} else
-		bufsize = MIN(BUFSIZE_MAX, MAXPHYS * 8);
+	/*
+	 * Map regular files privately so delimiters can be replaced with NUL
+	 * in place without copying the data. A terminator for the last item
+	 * is written past the end of the file, which requires slack in the
+	 * last page unless the file ends in a delimiter or newline.
+	 */
+	pagesize = sysconf(_SC_PAGESIZE);
+	if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0 &&
+	    (uint64_t)sb.st_size < SIZE_MAX) {
+		datasize = (size_t)sb.st_size;
+		buf = mmap(NULL, datasize, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		    fd, 0);
+		if (buf == MAP_FAILED)
+			buf = NULL;
+		else if (pagesize > 0 && datasize % (size_t)pagesize == 0 &&
+		    buf[datasize - 1] != '\n' && buf[datasize - 1] != d) {
+			munmap(buf, datasize);
+			buf = NULL;
+		} else {
+			maplen = datasize;
+#ifdef POSIX_MADV_SEQUENTIAL
+			(void)posix_madvise(buf, maplen,
+			    POSIX_MADV_SEQUENTIAL);
+#endif
+		}
+#if CMB_DEBUG
+		if (debug && buf != NULL)
+			cmb_debug("%s: mapped fd=%u datasize=%lu",
+			    __func__, fd, datasize);
+#endif
+	}
 
-	/* Initialize buffer/pointers */
+	/* Otherwise, read the file until EOF */
+	if (buf == NULL) {
+		/* Use output block size as buffer size if available */
+		if (fstat(fd, &sb) == 0 && !S_ISREG(sb.st_mode))
+			bufsize = (size_t)MAX(sb.st_blksize,
+			    (blksize_t)pagesize);
+		else if (sysconf(_SC_PHYS_PAGES) > PHYSPAGES_THRESHOLD)
+			bufsize = MIN(BUFSIZE_MAX, MAXPHYS * 8);
+		else
+			bufsize = BUFSIZE_SMALL;
 #if CMB_DEBUG
-	if (debug)
-		cmb_debug("%s: reading fd=%u bufsize=%lu",
-		    __func__, fd, bufsize);
+		if (debug)
+			cmb_debug("%s: reading fd=%u bufsize=%lu",
+			    __func__, fd, bufsize);
 #endif
-	if ((buf = malloc(bufsize)) == NULL)
-		return (NULL);
-	buflen = bufsize;
-	if ((items = malloc(itemsize)) == NULL)
-		return (NULL);
 
-	/* Read the file until EOF */
-	b = buf;
-	*nitems = _nitems = 0;
-	while (r != 0) {
-		r = read(fd, b, bufsize);
+		/* Leave room for the next read(2) plus one terminating NUL */
+		datasize = 0;
+		buflen = bufsize + 1;
+		if ((buf = malloc(buflen)) == NULL) {
+			close(fd);
+			return (NULL);
+		}
+		while (r != 0) {
+			r = read(fd, &buf[datasize], bufsize);
 
-		/* Test for Error/EOF */
-		if (r <= 0)
-			break;
+			/* Test for Error/EOF */
+			if (r <= 0)
+				break;
 
-		/* Resize the buffer if necessary */
-		datasize += (size_t)r;
-		if (buflen - datasize < bufsize) {
-			buflen += bufsize;
+			/* Grow the buffer geometrically if necessary */
+			datasize += (size_t)r;
+			if (buflen - datasize <= bufsize) {
+				buflen = MAX(buflen * 2, datasize + bufsize + 1);
 #if CMB_DEBUG
-			if (debug)
-				cmb_debug("%s: increasing buffer to %lu bytes",
-				    __func__, buflen);
+				if (debug)
+					cmb_debug("%s: increasing buffer to "
+					    "%lu bytes", __func__, buflen);
 #endif
-			if ((buf = realloc(buf, buflen)) == NULL) {
-				free(buf);
-				free(items);
-				return (NULL);
+				if ((p = realloc(buf, buflen)) == NULL) {
+					free(buf);
+					close(fd);
+					return (NULL);
+				}
+				buf = p;
 			}
 		}
-		b = &buf[datasize];
+		buf[datasize] = '\0';
 	}
 
 	if (datasize == 0) {
@@ -244,39 +330,57 @@ cmb_parse(struct cmb_config *config, int fd, uint32_t *nitems, uint32_t max)
 			    __func__, *nitems, datasize);
 #endif
 		free(buf);
-		free(items);
+		close(fd);
 		return (NULL);
 	}
+	end = buf + datasize;
+
+	/*
+	 * chomp trailing newline; write a terminator past the data for the
+	 * last item if it is not followed by a delimiter
+	 */
+	term = FALSE;
+	if (end[-1] == '\n')
+		end[-1] = '\0';
+	else if (end[-1] != d)
+		term = TRUE;
+
+	/* Count items so that the array is allocated exactly once */
+	total = 0;
+	for (p = buf; p < end; p = q + 1) {
+		if ((q = memchr(p, d, (size_t)(end - p))) == NULL) {
+			total++;
+			break;
+		}
+		total++;
+		if (max > 0 && total >= max)
+			break;
+	}
+	if (total >= 0xffffffff) {
+		errno = EFBIG;
+		goto cmb_parse_error;
+	}
 
-	/* chomp trailing newline */
-	if (buf[datasize-1] == '\n')
-		buf[datasize-1] = '\0';
+	items = malloc(sizeof(char *) * (total + 1) +
+	    sizeof(struct cmb_parse_buf));
+	if (items == NULL)
+		goto cmb_parse_error;
+	if (term)
+		*end = '\0';
 
 	/* Look for delimiter */
-	p = buf;
-	for (n = 0; n < datasize; n++) {
-		if (buf[n] != d)
-			continue;
-		items[_nitems++] = p;
-		buf[n] = '\0';
-		p = buf + n + 1;
-		if (max > 0 && _nitems >= max)
-			goto cmb_parse_return;
-		if (_nitems >= 0xffffffff) {
-			items = NULL;
-			errno = EFBIG;
-			goto cmb_parse_return;
-		} else if (_nitems % CMB_PARSE_FRAGSIZE == 0) {
-			itemsize += fragsize;
-			if ((items = realloc(items, itemsize)) == NULL)
-				goto cmb_parse_return;
-		}
-	}
-	if (p < buf + datasize)
+	for (_nitems = 0, p = buf; _nitems < total; p = q + 1) {
 		items[_nitems++] = p;
+		if ((q = memchr(p, d, (size_t)(end - p))) == NULL)
+			break;
+		*q = '\0';
+	}
+	items[_nitems] = NULL;
+	pb.data = buf;
+	pb.maplen = maplen;
+	memcpy(&items[_nitems + 1], &pb, sizeof(pb));
 
-cmb_parse_return:
-	*nitems = _nitems;
+	*nitems = (uint32_t)_nitems;
 #if CMB_DEBUG
 	if (debug)
 		cmb_debug("%s: nitems=%u datasize=%lu",
@@ -284,28 +388,187 @@ cmb_parse_return:
 #endif
 	close(fd);
 	return (items);
+
+cmb_parse_error:
+	if (maplen != 0)
+		munmap(buf, maplen);
+	else
+		free(buf);
+	close(fd);
+	return (NULL);
 }
 
 /*
- * Takes pointer to `struct cmb_config' options and number of items. Returns
- * total number of combinations according to config options.
+ * Takes array of items returned by cmb_parse() or cmb_parse_file() and
+ * releases both the array and the storage for the items.
  */
-uint64_t
-cmb_count(struct cmb_config *config, uint32_t nitems)
+void
+cmb_parse_free(char **items)
+{
+	char **cp;
+	struct cmb_parse_buf pb;
+
+	if (items == NULL)
+		return;
+	for (cp = items; *cp != NULL; cp++)
+		;
+	memcpy(&pb, cp + 1, sizeof(pb));
+	if (pb.maplen != 0)
+		munmap(pb.data, pb.maplen);
+	else
+		free(pb.data);
+	free(items);
+}
+
+/*
+ * Greatest common divisor (Euclid).
+ */
+static inline uint64_t
+cmb_gcd(uint64_t a, uint64_t b)
+{
+	uint64_t t;
+
+	while (b != 0) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	return (a);
+}
+
+/*
+ * Takes a binomial coefficient and returns (b * x) / y, where the result is
+ * known to be an integer. Common factors are removed before multiplying so
+ * that intermediate products never exceed the result. On overflow, sets errno
+ * to ERANGE and returns zero.
+ */
+static inline uint64_t
+cmb_muldiv(uint64_t b, uint64_t x, uint64_t y)
+{
+	uint64_t g;
+
+	g = cmb_gcd(b, y);
+	b /= g;
+	x /= y / g;
+	if (x != 0 && b > UINT64_MAX / x) {
+		errno = ERANGE;
+		return (0);
+	}
+	return (b * x);
+}
+
+/*
+ * Takes n and k. Returns the exact binomial coefficient C(n,k); the number of
+ * k-item combinations of n items. On overflow, sets errno to ERANGE and
+ * returns zero.
+ */
+static uint64_t
+cmb_binomial(uint32_t n, uint32_t k)
+{
+	uint32_t i;
+	uint64_t b = 1;
+
+	if (k > n)
+		return (0);
+	if (k > n - k)
+		k = n - k;
+	for (i = 1; i <= k; i++) {
+		if ((b = cmb_muldiv(b, n - k + i, i)) == 0)
+			return (0);
+	}
+	return (b);
+}
+
+/*
+ * Same as cmb_muldiv() but for cmb_count_t and 32-bit multiplier/divisor.
+ */
+static inline cmb_count_t
+cmb_count_muldiv(cmb_count_t b, uint32_t x, uint32_t y)
+{
+	uint64_t g;
+
+	g = cmb_gcd(y, (uint64_t)(b % y));
+	b /= g;
+	x /= (uint32_t)(y / g);
+	if (x != 0 && b > CMB_COUNT_MAX / x) {
+		errno = ERANGE;
+		return (0);
+	}
+	return (b * x);
+}
+
+/*
+ * Memoized row of Pascal's triangle. Holds C(n,k) for k below len; the rest
+ * of the row is either known by symmetry, C(n,k) = C(n,n-k), or does not fit
+ * in cmb_count_t. Since C(n,k) >= 2^k for k <= n/2, len never exceeds the
+ * number of bits in cmb_count_t.
+ */
+static struct cmb_pascal {
+	pthread_mutex_t mtx;
+	uint8_t valid;
+	uint32_t n;
+	uint32_t len;
+	cmb_count_t row[CMB_COUNT_BITS];
+} cmb_pascal_row = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/*
+ * Takes n and k (at most n). Returns the exact binomial coefficient C(n,k)
+ * from the memoized row for n, calculating the row first if the last call was
+ * for a different n. On overflow, sets errno to ERANGE and returns zero.
+ */
+static cmb_count_t
+cmb_pascal(uint32_t n, uint32_t k)
+{
+	cmb_count_t b;
+	struct cmb_pascal *p = &cmb_pascal_row;
+
+	if (k > n - k)
+		k = n - k;
+
+	pthread_mutex_lock(&p->mtx);
+	if (!p->valid || p->n != n) {
+		p->row[0] = 1;
+		for (p->len = 1; p->len <= n / 2 && p->len < CMB_COUNT_BITS;
+		    p->len++)
+		{
+			b = cmb_count_muldiv(p->row[p->len - 1],
+			    n - p->len + 1, p->len);
+			if (b == 0)
+				break;
+			p->row[p->len] = b;
+		}
+		p->n = n;
+		p->valid = TRUE;
+	}
+	b = k < p->len ? p->row[k] : 0;
+	pthread_mutex_unlock(&p->mtx);
+
+	if (b == 0)
+		errno = ERANGE;
+	return (b);
+}
+
+/*
+ * Takes pointer to `struct cmb_config' options, number of items, and pointer
+ * to cmb_count_t (written-to). Calculates the exact total number of
+ * combinations according to config options. Returns zero on success, ERANGE
+ * if the total does not fit in cmb_count_t.
+ */
+static int
+cmb_count_total(struct cmb_config *config, uint32_t nitems,
+    cmb_count_t *total)
 {
 	uint8_t show_empty = FALSE;
-	int8_t nextset = 1;
 	uint32_t curset;
-	uint32_t i = nitems;
-	uint32_t k;
-	uint32_t p;
 	uint32_t setdone = nitems;
 	uint32_t setinit = 1;
-	uint64_t count = 0;
-	long double z = 1;
-	uint64_t ncombos;
+	uint32_t t;
+	cmb_count_t count = 0;
+	cmb_count_t ncombos;
 
-	errno = 0;
+	*total = 0;
 	if (nitems == 0)
 		return (0);
 
@@ -335,148 +598,265 @@ cmb_count(struct cmb_config *config, uint32_t nitems)
 	if (setdone > nitems)
 		setdone = nitems;
 
-	/* Check for integer overflow */
-	if ((setinit > setdone && setinit - setdone >= 64) ||
-	    (setinit < setdone && setdone - setinit >= 64)) {
-		errno = ERANGE;
-		return (0);
+	/* The order of sets does not matter when counting */
+	if (setinit > setdone) {
+		t = setinit;
+		setinit = setdone;
+		setdone = t;
 	}
 
 	/* If entire set is requested, return 2^N[-1] */
-	if ((setinit == 1 && setdone == nitems) ||
-	    (setinit == nitems && setdone == 1)) {
-		if (show_empty) {
-			if (nitems >= 64) {
-				errno = ERANGE;
-				return (0);
-			}
-			return (1 << nitems);
-		} else
-			return (ULLONG_MAX >> (64 - nitems));
+	if (setinit == 1 && setdone == nitems) {
+		if (nitems > CMB_COUNT_BITS ||
+		    (nitems == CMB_COUNT_BITS && show_empty))
+			return (ERANGE);
+		if (nitems == CMB_COUNT_BITS)
+			*total = CMB_COUNT_MAX;
+		else
+			*total = ((cmb_count_t)1 << nitems) -
+			    (show_empty ? 0 : 1);
+		return (0);
 	}
 
-	/* Set the direction of flow (incrementing vs. decrementing) */
-	if (setinit > setdone)
-		nextset = -1;
+	if (show_empty)
+		count++;
+	for (curset = setinit; curset <= setdone; curset++) {
+		if ((ncombos = cmb_pascal(nitems, curset)) == 0 ||
+		    ncombos > CMB_COUNT_MAX - count)
+			return (ERANGE);
+		count += ncombos;
+	}
+	*total = count;
+
+	return (0);
+}
+
+/*
+ * Takes number of items, number of items in the set, zero-based rank of a
+ * combination within that set, and array to be populated with positional
+ * arguments. Same as cmb_unrank_set() but for CMB_ORDER_REVDOOR order, in
+ * which the t-item combinations of m items are those of the first m-1 items,
+ * followed by those taking t-1 of the first m-1 items (in reverse order) plus
+ * the last item; O(nitems).
+ */
+static void
+cmb_unrank_revdoor(uint32_t nitems, uint32_t setsize, uint64_t rank,
+    uint32_t setnums[])
+{
+	uint32_t m = nitems;
+	uint32_t t = setsize;
+	uint64_t b0;
+	uint64_t b1;
+
+	if (t == 0)
+		return;
+
+	b1 = cmb_binomial(m - 1, t);	/* Combinations without last item */
+	b0 = cmb_binomial(m - 1, t - 1);	/* Combinations with last item */
+	while (t > 0 && t < m) {
+		if (rank < b1) {
+			b1 = cmb_muldiv(b1, m - 1 - t, m - 1); /* C(m-2,t) */
+			b0 = cmb_muldiv(b0, m - t, m - 1); /* C(m-2,t-1) */
+		} else {
+			setnums[t - 1] = m - 1;
+			rank = b0 - 1 - (rank - b1);
+			b1 = cmb_muldiv(b0, m - t, m - 1); /* C(m-2,t-1) */
+			b0 = cmb_muldiv(b0, t - 1, m - 1); /* C(m-2,t-2) */
+			t--;
+		}
+		m--;
+	}
+	for (; t > 0; t--)
+		setnums[t - 1] = t - 1;
+}
+
+/*
+ * Takes number of items, number of items in the set, and array of positional
+ * arguments. Returns the zero-based rank of the combination within the set in
+ * CMB_ORDER_REVDOOR order; the inverse of cmb_unrank_revdoor(). O(nitems).
+ */
+static uint64_t
+cmb_rank_revdoor(uint32_t nitems, uint32_t setsize, uint32_t setnums[])
+{
+	uint8_t reverse = FALSE;
+	uint32_t m = nitems;
+	uint32_t t = setsize;
+	uint64_t b0;
+	uint64_t b1;
+	uint64_t rank = 0;
+
+	if (t == 0)
+		return (0);
 
 	/*
-	 * Loop over each `set' in the configured direction until we are done
+	 * Each time the last item is taken, the rank within the remainder
+	 * counts backward from the end of the block; accumulate modulo 2^64
+	 * with alternating sign.
 	 */
-	if (show_empty)
-		count++;
-	p = nextset > 0 ? setinit - 1 : setinit;
-	for (k = 1; k <= p; k++)
-		z = (z * i--) / k;
-	for (curset = setinit;
-	    nextset > 0 ? curset <= setdone : curset >= setdone;
-	    curset += (uint32_t)nextset)
-	{
-		/* Calculate number of combinations (incrementing) */
-		if (nextset > 0)
-			z = (z * i--) / k++;
+	b1 = cmb_binomial(m - 1, t);
+	b0 = cmb_binomial(m - 1, t - 1);
+	while (t > 0 && t < m) {
+		if (setnums[t - 1] != m - 1) {
+			b1 = cmb_muldiv(b1, m - 1 - t, m - 1);
+			b0 = cmb_muldiv(b0, m - t, m - 1);
+		} else {
+			if (reverse)
+				rank -= b1 + b0 - 1;
+			else
+				rank += b1 + b0 - 1;
+			reverse = !reverse;
+			b1 = cmb_muldiv(b0, m - t, m - 1);
+			b0 = cmb_muldiv(b0, t - 1, m - 1);
+			t--;
+		}
+		m--;
+	}
 
-		/* Add number of combinations in this set to total */
-		if ((ncombos = (uint64_t)z) == 0) {
-			errno = ERANGE;
-			return (0);
+	return (rank);
+}
+
+/*
+ * Takes enumeration order (CMB_ORDER_*), number of items, number of items in
+ * the set, zero-based rank of a combination within that set, and array to be
+ * populated with positional arguments. Fills setnums with the combination
+ * found at rank in the order produced by cmb(); for the default lexicographic
+ * order, using the combinatorial number system. O(nitems).
+ *
+ * NB: rank must be less than C(nitems,setsize).
+ */
+static void
+cmb_unrank_set(uint8_t order, uint32_t nitems, uint32_t setsize,
+    uint64_t rank, uint32_t setnums[])
+{
+	uint32_t c = 0;
+	uint32_t j;
+	uint32_t m;
+	uint32_t n;
+	uint64_t b;
+
+	if (order == CMB_ORDER_REVDOOR) {
+		cmb_unrank_revdoor(nitems, setsize, rank, setnums);
+		return;
+	}
+	if (setsize == 0)
+		return;
+
+	/*
+	 * b is the number of combinations that begin with item c given the
+	 * positions already chosen; C(nitems-1-c, setsize-1-n). Walk forward,
+	 * skipping over each block of combinations that rank lies beyond.
+	 */
+	b = cmb_binomial(nitems - 1, setsize - 1);
+	for (n = 0; n < setsize; n++) {
+		j = setsize - 1 - n;
+		while (rank >= b) {
+			rank -= b;
+			m = nitems - 1 - c++;
+			b = cmb_muldiv(b, m - j, m); /* C(m-1,j) */
 		}
-		if (ncombos > ULLONG_MAX - count) {
-			errno = ERANGE;
-			return (0);
+		setnums[n] = c;
+		if (j > 0) {
+			m = nitems - 1 - c;
+			b = cmb_muldiv(b, j, m); /* C(m-1,j-1) */
 		}
-		count += ncombos;
+		c++;
+	}
+}
 
-		/* Calculate number of combinations (decrementing) */
-		if (nextset < 0)
-			z = (z * --k) / ++i;
+/*
+ * Takes enumeration order (CMB_ORDER_*), number of items, number of items in
+ * the set, and array of positional arguments. Returns the zero-based rank of
+ * the combination within the set; the inverse of cmb_unrank_set(). O(nitems).
+ */
+static uint64_t
+cmb_rank_set(uint8_t order, uint32_t nitems, uint32_t setsize,
+    uint32_t setnums[])
+{
+	uint32_t c = 0;
+	uint32_t j;
+	uint32_t m;
+	uint32_t n;
+	uint64_t b;
+	uint64_t rank = 0;
+
+	if (order == CMB_ORDER_REVDOOR)
+		return (cmb_rank_revdoor(nitems, setsize, setnums));
+	if (setsize == 0)
+		return (0);
+
+	b = cmb_binomial(nitems - 1, setsize - 1);
+	for (n = 0; n < setsize; n++) {
+		j = setsize - 1 - n;
+		while (c < setnums[n]) {
+			rank += b;
+			m = nitems - 1 - c++;
+			b = cmb_muldiv(b, m - j, m); /* C(m-1,j) */
+		}
+		if (j > 0) {
+			m = nitems - 1 - c;
+			b = cmb_muldiv(b, j, m); /* C(m-1,j-1) */
+		}
+		c++;
 	}
 
-	return (count);
+	return (rank);
 }
 
 /*
- * Takes pointer to `struct cmb_config' options, number of items, and array of
- * `char *' items. Calculates combinations according to options and either
- * prints combinations to stdout (default) or runs `action' if passed-in as
- * function pointer member of `config' argument.
+ * Takes number of items, number of items in the set, and array of positional
+ * arguments. Returns non-zero if the array does not describe a valid
+ * combination (positions must be strictly increasing and less than nitems).
+ */
+static int
+cmb_setnums_invalid(uint32_t nitems, uint32_t setsize, uint32_t setnums[])
+{
+	uint32_t n;
+
+	if (setsize > nitems || (setsize > 0 && setnums == NULL))
+		return (TRUE);
+	for (n = 0; n < setsize; n++) {
+		if (setnums[n] >= nitems)
+			return (TRUE);
+		if (n > 0 && setnums[n] <= setnums[n - 1])
+			return (TRUE);
+	}
+	return (FALSE);
+}
+
+/*
+ * Takes pointer to `struct cmb_config' options, number of items, sequence
+ * number (as passed to action() by cmb()), pointer to uint32_t (written-to,
+ * containing number of items in the combination), and array of at least
+ * size_max (or nitems) uint32_t to be populated with the positional arguments
+ * of the combination. Returns zero on success, otherwise an errno value
+ * (EINVAL if seq is out of range; ERANGE if the set containing seq has more
+ * than 2^64 combinations).
  */
 int
-cmb(struct cmb_config *config, uint32_t nitems, char *items[])
+cmb_unrank(struct cmb_config *config, uint32_t nitems, uint64_t seq,
+    uint32_t *setsize, uint32_t setnums[])
 {
-#if CMB_DEBUG
-	uint8_t debug = FALSE;
-#endif
-	uint8_t docount = FALSE;
-	uint8_t doseek = FALSE;
+	uint8_t order = CMB_ORDER_LEX;
 	uint8_t show_empty = FALSE;
-	uint8_t show_numbers = FALSE;
 	int8_t nextset = 1;
-	int retval = 0;
 	uint32_t curset;
-	uint32_t i = nitems;
-	uint32_t k;
-	uint32_t n;
-	uint32_t p;
-	uint32_t seed;
 	uint32_t setdone = nitems;
 	uint32_t setinit = 1;
-	uint32_t setmax;
-	uint32_t setnums_last;
-	uint32_t setpos;
-	uint32_t setpos_backend;
-	uint64_t combo;
-	uint64_t count = 0;
 	uint64_t ncombos;
-	uint64_t seek = 0;
-	uint64_t seq = 1;
-	long double z = 1;
-	char **curitems;
-	uint32_t *setnums;
-	uint32_t *setnums_backend;
-	CMB_ACTION((*action)) = cmb_print;
 
 	errno = 0;
+	if (setsize == NULL || seq == 0)
+		return (errno = EINVAL);
 
 	/* Process config options */
 	if (config != NULL) {
-		if (config->action != NULL)
-			action = config->action;
-		if (config->count != 0) {
-			docount = TRUE;
-			count = config->count;
-		}
-		if ((config->options & CMB_OPT_DEBUG) != 0) {
-#if CMB_DEBUG
-			debug = TRUE;
-#else
-			warnx("libcmb not compiled with debug support!");
-#endif
-		}
 		if ((config->options & CMB_OPT_EMPTY) != 0)
 			show_empty = TRUE;
-		if ((config->options & CMB_OPT_NUMBERS) != 0)
-			show_numbers = TRUE;
+		order = config->order;
 		if (config->size_min != 0 || config->size_max != 0) {
 			setinit = config->size_min;
 			setdone = config->size_max;
 		}
-		if (config->start > 1) {
-			doseek = TRUE;
-			seek = config->start;
-#if CMB_DEBUG
-			if (show_numbers || debug)
-#else
-			if (show_numbers)
-#endif
-				seq = seek;
-		}
-	}
-
-	if (!show_empty) {
-		if (nitems == 0)
-			return (0);
-		else if (cmb_count(config, nitems) == 0)
-			return (errno);
 	}
 
 	/* Adjust values to be non-zero (mathematical constraint) */
@@ -485,6 +865,10 @@ cmb(struct cmb_config *config, uint32_t nitems, char *items[])
 	if (setdone == 0)
 		setdone = 1;
 
+	/* Return EINVAL if the request is out of range */
+	if (!show_empty && setinit > nitems && setdone > nitems)
+		return (errno = EINVAL);
+
 	/* Enforce limits so we don't run over bounds */
 	if (setinit > nitems)
 		setinit = nitems;
@@ -495,402 +879,4779 @@ cmb(struct cmb_config *config, uint32_t nitems, char *items[])
 	if (setinit > setdone)
 		nextset = -1;
 
-	/* Show the empty set consisting of a single combination of no-items */
+	/* The empty set is first when incrementing */
 	if (nextset > 0 && show_empty) {
-#if CMB_DEBUG
-		if (debug)
-			cmb_debug(">>> 0-item combinations <<<");
-#endif
-		if (!doseek) {
-			retval = action(config, seq++, 0, NULL);
-			if (retval != 0)
-				return (retval);
-			if (docount && --count == 0)
-				return (retval);
-		} else {
-			seek--;
-			if (seek == 1)
-				doseek = FALSE;
+		if (seq == 1) {
+			*setsize = 0;
+			return (0);
 		}
+		seq--;
 	}
 
-	if (nitems == 0)
-		return (0);
-
-	/* Allocate memory */
-	setmax = setdone > setinit ? setdone : setinit;
-	if ((curitems = (char **)malloc(sizeof(char *) * setmax)) == NULL)
-		errx(EXIT_FAILURE, "Out of memory?!");
-	if ((setnums = (uint32_t *)malloc(sizeof(uint32_t) * setmax)) == NULL)
-		errx(EXIT_FAILURE, "Out of memory?!");
-	if ((setnums_backend =
-	    (uint32_t *)malloc(sizeof(uint32_t) * setmax)) == NULL)
-		errx(EXIT_FAILURE, "Out of memory?!");
-
-	/*
-	 * Loop over each `set' in the configured direction until we are done.
-	 * NB: Each `set' can represent a single item or multiple items.
-	 */
-	p = nextset > 0 ? setinit - 1 : setinit;
-	for (k = 1; k <= p; k++)
-		z = (z * i--) / k;
-	for (curset = setinit;
-	    nextset > 0 ? curset <= setdone : curset >= setdone;
+	/* Find the set containing seq and unrank within it */
+	for (curset = setinit; nitems > 0 &&
+	    (nextset > 0 ? curset <= setdone : curset >= setdone);
 	    curset += (uint32_t)nextset)
 	{
-#if CMB_DEBUG
-		if (debug)
-			cmb_debug(">>> %u-item combinations <<<", curset);
-#endif
+		if ((ncombos = cmb_binomial(nitems, curset)) == 0)
+			return (errno);
+		if (seq > ncombos) {
+			seq -= ncombos;
+			continue;
+		}
+		if (setnums == NULL)
+			return (errno = EINVAL);
+		cmb_unrank_set(order, nitems, curset, seq - 1, setnums);
+		*setsize = curset;
+		return (0);
+	}
 
-		/* Calculate number of combinations (incrementing) */
-		if (nextset > 0)
-			z = (z * i--) / k++;
+	/* The empty set is last when decrementing */
+	if (nextset < 0 && show_empty && seq == 1) {
+		*setsize = 0;
+		return (0);
+	}
 
-		/* Cast number of combinations in set to integer */
-		if ((ncombos = (uint64_t)z) == 0)
-			return (errno = ERANGE);
+	return (errno = EINVAL);
+}
 
-		/* Jump to next set if requested start is beyond this one */
-		if (doseek) {
-			if (seek > ncombos) {
-				seek -= ncombos;
-				if (nextset < 0)
-					z = (z * --k) / ++i;
-				continue;
-			} else if (seek == 1) {
-				doseek = FALSE;
-			}
-		}
+/*
+ * Takes pointer to `struct cmb_config' options, number of items, number of
+ * items in the combination, and array of positional arguments. Returns the
+ * sequence number (as passed to action() by cmb()) of the combination. On
+ * error, returns zero and sets errno (EINVAL if the combination is invalid or
+ * is not part of the configured sets; ERANGE if the sequence number does not
+ * fit in 64 bits).
+ */
+uint64_t
+cmb_rank(struct cmb_config *config, uint32_t nitems, uint32_t setsize,
+    uint32_t setnums[])
+{
+	uint8_t order = CMB_ORDER_LEX;
+	uint8_t show_empty = FALSE;
+	int8_t nextset = 1;
+	uint32_t curset;
+	uint32_t setdone = nitems;
+	uint32_t setinit = 1;
+	uint64_t ncombos;
+	uint64_t rank;
+	uint64_t seq = 1;
 
-		/* Fill array with the initial positional arguments */
-#if CMB_DEBUG
-		if (debug)
-			fprintf(stderr, CMB_DEBUG_PREFIX "setnums=[");
-#endif
-		for (n = 0; n < curset; n++) {
-#if CMB_DEBUG
-			if (debug) {
-				if (n == curset - 1)
-					fprintf(stderr, "\033[31m%u\033[m", n);
-				else
-					fprintf(stderr, "%u", n);
-				if (n + 1 < curset)
-					fprintf(stderr, ",");
-			}
-#endif
-			curitems[n] = items[n];
-		}
-#if CMB_DEBUG
-		if (debug)
-			fprintf(stderr, "] seq=%"PRIu64"\n", seq);
-#endif
+	errno = 0;
+	if (cmb_setnums_invalid(nitems, setsize, setnums)) {
+		errno = EINVAL;
+		return (0);
+	}
 
-		/* Produce results with the first set of items */
-		if (!doseek) {
-			retval = action(config, seq++, curset, curitems);
-			if (retval != 0)
-				break;
-			if (docount && --count == 0)
-				break;
+	/* Process config options */
+	if (config != NULL) {
+		if ((config->options & CMB_OPT_EMPTY) != 0)
+			show_empty = TRUE;
+		order = config->order;
+		if (config->size_min != 0 || config->size_max != 0) {
+			setinit = config->size_min;
+			setdone = config->size_max;
 		}
+	}
 
-		/*
-		 * Prefill two arrays used for matrix calculations.
-		 *
-		 * The first array (setnums) is a linear sequence starting at
-		 * one (1) and ending at N (where N is the same integer as the
-		 * current set we're operating on). For example, if we are
-		 * currently on a set-of-2, setnums is 1, 2.
-		 *
-		 * The second array (setnums_backend) is a linear sequence
-		 * starting at nitems-N and ending at nitems (again, N is the
-		 * same integer as the current set we are operating on; nitems
-		 * is the total number of items). For example, if we are
-		 * operating on a set-of-2, and nitems is 8, setnums_backend is
-		 * set to 7, 8.
-		 */
-		for (n = 0; n < curset; n++)
-			setnums[n] = n;
-		p = 0;
-		for (n = curset; n > 0; n--)
-			setnums_backend[p++] = nitems - n;
+	/* Adjust values to be non-zero (mathematical constraint) */
+	if (setinit == 0)
+		setinit = 1;
+	if (setdone == 0)
+		setdone = 1;
 
-		/*
-		 * Process remaining self-similar combinations in the set.
-		 */
-		for (combo = 1; combo < ncombos; combo++) {
-			setnums_last = curset;
-
-			/*
-			 * Using self-similarity (matrix) theorem, determine
-			 * (by comparing the [sliding] setnums to the stored
-			 * setnums_backend) the number of arguments that remain
-			 * available for shifting into a new setnums value
-			 * (for later mapping into curitems).
-			 *
-			 * In essence, determine when setnums has slid into
-			 * setnums_backend in which case we can mathematically
-			 * use the last item to find the next-new item.
-			 */
-			for (n = curset; n > 0; n--) {
-				setpos = setnums[n - 1];
-				setpos_backend = setnums_backend[n - 1];
-				/*
-				 * If setpos is equal to or greater than
-				 * setpos_backend then we keep iterating over
-				 * the current set's list of argument positions
-				 * until otherwise; each time incrementing the
-				 * amount of numbers we must produce from
-				 * formulae rather than stored position.
-				 */
-				setnums_last = n - 1;
-				if (setpos < setpos_backend)
-					break;
-			}
+	/* Enforce limits so we don't run over bounds */
+	if (setinit > nitems)
+		setinit = nitems;
+	if (setdone > nitems)
+		setdone = nitems;
 
-			/*
-			 * The next few stanzas are dedicated to rebuilding the
-			 * setnums array for mapping positional items
-			 * [immediately following] into curitems.
-			 */
-
-			/*
-			 * Get the generator number used to populate unknown
-			 * positions in the matrix (using self-similarity).
-			 */
-			seed = setnums[setnums_last];
-
-			/*
-			 * Use the generator number to populate any position
-			 * numbers that weren't carried over from previous
-			 * combination run -- using self-similarity theorem.
-			 */
-			for (n = setnums_last; n <= curset; n++)
-				setnums[n] = seed + n - setnums_last + 1;
-#if CMB_DEBUG
-			if (debug) {
-				fprintf(stderr, CMB_DEBUG_PREFIX "setnums=[");
-				for (n = 0; n < curset; n++) {
-					if (n == setnums_last) {
-						fprintf(stderr,
-						    "\033[31m%u\033[m",
-						    setnums[n]);
-					} else {
-						fprintf(stderr, "%u",
-						    setnums[n]);
-					}
-					if (n + 1 < curset)
-						fprintf(stderr, ",");
-				}
-				fprintf(stderr, "] seq=%"PRIu64"\n", seq);
-			}
-#endif
+	/* Set the direction of flow (incrementing vs. decrementing) */
+	if (setinit > setdone)
+		nextset = -1;
 
-			/* Now map new setnums into values stored in items */
-			for (n = 0; n < curset; n++)
-				curitems[n] = items[setnums[n]];
+	/* The empty set is first when incrementing */
+	if (nextset > 0 && show_empty) {
+		if (setsize == 0)
+			return (1);
+		seq++;
+	}
 
-			/* Produce results with this set of items */
-			if (doseek) {
-				seek--;
-				if (seek == 1)
-					doseek = FALSE;
-			}
-			if (!doseek || seek == 1) {
-				doseek = FALSE;
-				retval = action(config, seq++, curset,
-				    curitems);
-				if (retval != 0)
-					goto cmb_return;
-				if (docount && --count == 0)
-					goto cmb_return;
+	/* Sum the sizes of all sets preceding the one containing setnums */
+	for (curset = setinit; nitems > 0 &&
+	    (nextset > 0 ? curset <= setdone : curset >= setdone);
+	    curset += (uint32_t)nextset)
+	{
+		if (curset == setsize) {
+			if (cmb_binomial(nitems, setsize) == 0)
+				return (0);
+			rank = cmb_rank_set(order, nitems, setsize, setnums);
+			if (rank > UINT64_MAX - seq) {
+				errno = ERANGE;
+				return (0);
 			}
+			return (seq + rank);
+		}
+		if ((ncombos = cmb_binomial(nitems, curset)) == 0)
+			return (0);
+		if (ncombos > UINT64_MAX - seq) {
+			errno = ERANGE;
+			return (0);
+		}
+		seq += ncombos;
+	}
 
-		} /* for combo */
+	/* The empty set is last when decrementing */
+	if (nextset < 0 && show_empty && setsize == 0)
+		return (seq);
 
-		/* Calculate number of combinations (decrementing) */
-		if (nextset < 0)
-			z = (z * --k) / ++i;
+	errno = EINVAL;
+	return (0);
+}
 
-	} /* for curset */
+/*
+ * Takes pointer to `struct cmb_config' options and number of items. Returns
+ * total number of combinations according to config options.
+ */
+uint64_t
+cmb_count(struct cmb_config *config, uint32_t nitems)
+{
+	cmb_count_t count;
 
-	/* Show the empty set consisting of a single combination of no-items */
-	if (nextset < 0 && show_empty) {
-		if ((!doseek || seek == 1) && (!docount || count > 0)) {
-			retval = action(config, seq++, 0, NULL);
-		}
+	if ((errno = cmb_count_total(config, nitems, &count)) != 0)
+		return (0);
+	if (count > UINT64_MAX) {
+		errno = ERANGE;
+		return (0);
 	}
 
-cmb_return:
-	free(curitems);
-	free(setnums);
-	free(setnums_backend);
-
-	return (retval);
+	return ((uint64_t)count);
 }
 
-CMB_ACTION(cmb_print)
+/*
+ * Takes pointer to `struct cmb_config' options, number of items, and pointers
+ * to cmb_count_t (written-to). Narrows the sequence numbers selected by start
+ * and count to those of shard number `shard' of `nshards', the first
+ * (remaining % nshards) shards being one combination longer than the rest.
+ * Sets count to zero if the shard is empty. Returns zero on success, EINVAL
+ * if shard is out of range, or ERANGE if the total does not fit.
+ */
+static int
+cmb_shard_span(struct cmb_config *config, uint32_t nitems,
+    cmb_count_t *first, cmb_count_t *count)
 {
-	uint8_t nul = FALSE;
-	uint8_t show_numbers = FALSE;
-	uint32_t n;
-	const char *delimiter = " ";
-	const char *prefix = NULL;
-	const char *suffix = NULL;
+	int error;
+	uint32_t i = config->shard - 1;
+	uint32_t n = config->nshards;
+	cmb_count_t avail;
+	cmb_count_t q;
+	cmb_count_t r;
+	cmb_count_t total;
 
-	/* Process config options */
-	if (config != NULL) {
-		if (config->delimiter != NULL)
-			delimiter = config->delimiter;
-		if ((config->options & CMB_OPT_NULPRINT) != 0)
-			nul = TRUE;
-		if ((config->options & CMB_OPT_NUMBERS) != 0)
-			show_numbers = TRUE;
-		prefix = config->prefix;
-		suffix = config->suffix;
-	}
+	*first = 1;
+	*count = 0;
+	if (config->shard < 1 || config->shard > n)
+		return (EINVAL);
+	if ((error = cmb_count_total(config, nitems, &total)) != 0)
+		return (error);
+	if (nitems == 0 && (config->options & CMB_OPT_EMPTY) != 0)
+		total = 1;
+	if (config->start > 1)
+		*first = config->start;
+	if (*first > total)
+		return (0);
 
-	if (show_numbers)
-		printf("%"PRIu64" ", seq);
-	if (prefix != NULL)
-		printf("%s", prefix);
-	for (n = 0; n < nitems; n++) {
-		printf("%s", items[n]);
-		if (n < nitems - 1)
-			printf("%s", delimiter);
-	}
-	if (suffix != NULL)
-		printf("%s", suffix);
-	if (nul)
-		printf("%c", 0);
-	else
-		printf("\n");
+	avail = total - *first + 1;
+	if (config->count != 0 && config->count < avail)
+		avail = config->count;
+	q = avail / n;
+	r = avail % n;
+	*first += q * i + (i < r ? i : r);
+	*count = q + (i < r ? 1 : 0);
 
 	return (0);
 }
 
-#ifdef HAVE_OPENSSL_BN_H
 /*
- * Takes pointer to `struct cmb_config' options and number of items. Returns
- * total number of combinations according to config options. Numbers formatted
- * as openssl bn(3) BIGNUM type.
+ * Takes pointer to `struct cmb_config' options, number of items, and pointers
+ * to uint64_t (written-to). Returns the first sequence number and number of
+ * combinations of shard number `shard' of `nshards' (see cmb_shard_span()).
+ * Returns zero on success, EINVAL if shard is out of range, or ERANGE if
+ * either does not fit in 64 bits.
  */
-BIGNUM *
-cmb_count_bn(struct cmb_config *config, uint32_t nitems)
+int
+cmb_shard_range(struct cmb_config *config, uint32_t nitems, uint64_t *first,
+    uint64_t *count)
 {
-	uint8_t show_empty = FALSE;
-	int8_t nextset = 1;
-	uint32_t curset;
-	uint32_t i = nitems;
-	uint32_t k;
+	int error;
+	cmb_count_t span;
+	cmb_count_t start;
+
+	*first = 1;
+	*count = 0;
+	if ((error = cmb_shard_span(config, nitems, &start, &span)) != 0)
+		return (errno = error);
+	if (start > UINT64_MAX || span > UINT64_MAX)
+		return (errno = ERANGE);
+	*first = (uint64_t)start;
+	*count = (uint64_t)span;
+
+	return (0);
+}
+
+/*
+ * Takes number of items in the set, and arrays of current and final item
+ * numbers for each position. Advances setnums to the next combination in
+ * lexicographic order and returns the lowest position that changed.
+ */
+static inline uint32_t
+cmb_next_lex(uint32_t setsize, uint32_t setnums[], uint32_t setnums_backend[])
+{
+	uint32_t n;
+	uint32_t seed;
+	uint32_t setnums_last;
+	uint32_t setpos;
+	uint32_t setpos_backend;
+
+	setnums_last = setsize;
+
+	/*
+	 * Using self-similarity (matrix) theorem, determine (by comparing the
+	 * [sliding] setnums to the stored setnums_backend) the number of
+	 * arguments that remain available for shifting into a new setnums
+	 * value (for later mapping into curitems).
+	 *
+	 * In essence, determine when setnums has slid into setnums_backend in
+	 * which case we can mathematically use the last item to find the
+	 * next-new item.
+	 */
+	for (n = setsize; n > 0; n--) {
+		setpos = setnums[n - 1];
+		setpos_backend = setnums_backend[n - 1];
+		/*
+		 * If setpos is equal to or greater than setpos_backend then we
+		 * keep iterating over the current set's list of argument
+		 * positions until otherwise; each time incrementing the amount
+		 * of numbers we must produce from formulae rather than stored
+		 * position.
+		 */
+		setnums_last = n - 1;
+		if (setpos < setpos_backend)
+			break;
+	}
+
+	/*
+	 * The next few stanzas are dedicated to rebuilding the setnums array
+	 * for mapping positional items [immediately following] into curitems.
+	 */
+
+	/*
+	 * Get the generator number used to populate unknown positions in the
+	 * matrix (using self-similarity).
+	 */
+	seed = setnums[setnums_last];
+
+	/*
+	 * Use the generator number to populate any position numbers that
+	 * weren't carried over from previous combination run -- using
+	 * self-similarity theorem.
+	 */
+	for (n = setnums_last; n < setsize; n++)
+		setnums[n] = seed + n - setnums_last + 1;
+
+	return (setnums_last);
+}
+
+/*
+ * Returns the bit number of the most significant bit set in x (non-zero).
+ */
+static inline uint32_t
+cmb_msb(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return (63 - (uint32_t)__builtin_clzll(x));
+#else
+	uint32_t n = 0;
+
+	while ((x >>= 1) != 0)
+		n++;
+	return (n);
+#endif
+}
+
+/*
+ * Takes number of items (at most 64), number of items in the set, a pointer
+ * to the combination as a bitmask (bit N set if item N is in the set), and
+ * array of positional arguments. Advances both to the next combination in
+ * lexicographic order and returns the lowest position that changed.
+ *
+ * Unlike Gosper's hack (which walks combinations in colexicographic order),
+ * this keeps the order and sequence numbers of cmb_next_lex() while finding
+ * the position to advance in constant time rather than by comparing setnums
+ * against setnums_backend.
+ *
+ * NB: Must not be called for the last combination in the set.
+ */
+static inline uint32_t
+cmb_next_mask(uint32_t nitems, uint32_t setsize, uint64_t *mask,
+    uint32_t setnums[])
+{
+	uint32_t high;
+	uint32_t n;
+	uint32_t run;
+	uint32_t setnums_last;
+	uint64_t all;
+
+	all = nitems < 64 ? ((uint64_t)1 << nitems) - 1 : UINT64_MAX;
+
+	/* Highest item not in the set; all items above it are in the set */
+	high = cmb_msb(~*mask & all);
+	run = nitems - 1 - high;
+
+	/* Next highest item moves up by one, followed by the run */
+	high = cmb_msb(*mask & (((uint64_t)1 << high) - 1));
+	*mask = (*mask & (((uint64_t)1 << high) - 1)) |
+	    ((UINT64_MAX >> (63 - run)) << (high + 1));
+
+	setnums_last = setsize - 1 - run;
+	for (n = setnums_last; n < setsize; n++)
+		setnums[n] = high + 1 + n - setnums_last;
+
+	return (setnums_last);
+}
+
+/*
+ * Takes number of items, number of items in the set, array of positional
+ * arguments, and pointers to uint32_t (written-to). Advances setnums to the
+ * next combination in revolving-door order (Knuth, TAOCP 7.2.1.3, Algorithm
+ * R), in which exactly one item leaves and one item enters the combination.
+ * Sets the item numbers that left and entered and returns the lowest position
+ * that changed. setnums remains sorted.
+ *
+ * NB: Must not be called for the last combination in the set.
+ */
+static inline uint32_t
+cmb_next_revdoor(uint32_t nitems, uint32_t setsize, uint32_t setnums[],
+    uint32_t *left, uint32_t *entered)
+{
+	uint8_t decrease;
+	uint32_t j;
+	uint32_t next;
+
+	/* Easy case; the lowest item moves up (odd) or down (even) */
+	*left = setnums[0];
+	if ((decrease = (setsize & 1) != 0)) {
+		next = setsize > 1 ? setnums[1] : nitems;
+		if (setnums[0] + 1 < next) {
+			*entered = ++setnums[0];
+			return (0);
+		}
+	} else if (setnums[0] > 0) {
+		*entered = --setnums[0];
+		return (0);
+	}
+
+	/* Alternately try to decrease and increase each following item */
+	for (j = 1; j < setsize; j++, decrease = !decrease) {
+		if (decrease) {
+			/* setnums[j] is one past setnums[j-1] */
+			if (setnums[j] <= j)
+				continue;
+			*left = setnums[j];
+			*entered = j - 1;
+			setnums[j] = setnums[j - 1];
+			setnums[j - 1] = j - 1;
+			return (j - 1);
+		} else {
+			/* setnums[j-1] is j-1 */
+			next = j + 1 < setsize ? setnums[j + 1] : nitems;
+			if (setnums[j] + 1 >= next)
+				continue;
+			*left = j - 1;
+			*entered = setnums[j] + 1;
+			setnums[j - 1] = setnums[j];
+			setnums[j]++;
+			return (j - 1);
+		}
+	}
+
+	return (setsize); /* NOTREACHED */
+}
+
+/*
+ * Output engine used in place of cmb_print() and cmb_print_bn() when called
+ * by cmb() and cmb_bn(). Each combination is assembled with memcpy(3) from
+ * precomputed item lengths, rebuilding only the positions from the first
+ * that changed. Sequence numbers are kept in decimal and incremented in place.
+ * Complete lines are collected in a large buffer and written to stdout with
+ * writev(2), so the output is identical to calling cmb_print() each time.
+ * Given config writer, a second buffer is written by a thread of its own (see
+ * cmb_out_writer()) while the first is filled. With CMB_FORMAT_BIN, line is
+ * instead the item numbers of the current record (see cmb_out_put_bin()).
+ */
+struct cmb_out {
+	char	*buf;		/* Pending output */
+	size_t	len;		/* Bytes pending in buf */
+	size_t	bufsize;	/* Size of buf (and wbuf) */
+	char	**items;	/* Items to print */
+	size_t	*lens;		/* Length of each item */
+	char	*line;		/* Current combination (prefix through eol) */
+	size_t	*offs;		/* Offset in line of each position */
+	const char *delimiter;	/* Item separator */
+	size_t	delimlen;	/* Length of delimiter */
+	const char *suffix;	/* Suffix for each combination */
+	size_t	suffixlen;	/* Length of suffix */
+	char	eol;		/* NUL or newline */
+	uint8_t	numbers;	/* Show sequence numbers */
+	char	*num;		/* Sequence number in decimal */
+	size_t	numlen;		/* Digits in num */
+	size_t	numsize;	/* Allocated size of num */
+	uint64_t numnext;	/* Sequence number following num */
+	uint8_t	binary;		/* CMB_FORMAT_BIN records */
+	uint8_t	width;		/* Bytes per item number in a record */
+	uint8_t	rankbig;	/* Sequence number too large for a record */
+	uint32_t slots;		/* Item numbers per record */
+	uint32_t setsize;	/* Items in the current record */
+	size_t	recsize;	/* Bytes per record */
+	uint64_t rank;		/* Sequence number of the next record */
+	FILE	*stream;	/* Destination (see cmb_out_flush()) */
+	uint8_t	writer;		/* Use a writer thread */
+	uint8_t	wrunning;	/* Writer thread started */
+	uint8_t	wdone;		/* No more buffers for the writer thread */
+	int	werror;		/* First write error of the writer thread */
+	char	*wbuf;		/* Buffer being written by the writer thread */
+	size_t	wlen;		/* Bytes in wbuf (zero if writer is idle) */
+	pthread_t wtid;		/* Writer thread */
+	pthread_mutex_t wmtx;	/* Protects wbuf, wlen, wdone, werror */
+	pthread_cond_t wcv;	/* Signaled when wlen or wdone changes */
+	struct cmb_writer_stats wstats; /* Metrics of the run */
+	struct cmb_writer_stats *wtotal; /* Where to add them (config writer) */
+};
+
+/* Serializes writes to stdout from cmb_parallel() workers */
+static pthread_mutex_t cmb_out_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/* Pairs of decimal digits for cmb_utoa() */
+static const char cmb_digits[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233"
+    "34353637383940414243444546474849505152535455565758596061626364656667"
+    "6869707172737475767778798081828384858687888990919293949596979899";
+
+/*
+ * Takes uint64_t and buffer of at least 20 bytes. Writes the number in decimal
+ * (not NUL terminated) two digits at a time. Returns number of digits.
+ */
+static size_t
+cmb_utoa(uint64_t n, char *buf)
+{
+	size_t d;
+	size_t len;
+	char tmp[20];
+	char *cp = tmp + sizeof(tmp);
+
+	while (n >= 100) {
+		d = (size_t)(n % 100) * 2;
+		n /= 100;
+		*--cp = cmb_digits[d + 1];
+		*--cp = cmb_digits[d];
+	}
+	if (n >= 10) {
+		d = (size_t)n * 2;
+		*--cp = cmb_digits[d + 1];
+		*--cp = cmb_digits[d];
+	} else
+		*--cp = (char)('0' + n);
+	len = (size_t)(tmp + sizeof(tmp) - cp);
+	memcpy(buf, cp, len);
+
+	return (len);
+}
+
+/*
+ * Takes pointer to `struct cmb_out', number of items, array of items, and
+ * number of items in the smallest and largest set. Sets up CMB_FORMAT_BIN
+ * records and places the header and items at the start of the buffer.
+ */
+static void
+cmb_out_alloc_bin(struct cmb_out *out, uint32_t nitems, char *items[],
+    uint32_t setmin, uint32_t setmax)
+{
+	uint32_t n;
+	size_t itemslen = 0;
+	size_t hdrlen;
+	char *cp;
+	struct cmb_bin_header hdr;
+
+	if (nitems <= UINT8_MAX)
+		out->width = 1;
+	else if (nitems <= UINT16_MAX)
+		out->width = 2;
+	else
+		out->width = 4;
+	out->slots = MAX(setmax, 1);
+	out->setsize = UINT32_MAX; /* fill unused slots on first record */
+	out->recsize = (size_t)out->slots * out->width;
+	if (out->numbers)
+		out->recsize += sizeof(uint64_t);
+	for (n = 0; n < nitems; n++)
+		itemslen += out->lens[n] + 1;
+	hdrlen = (sizeof(hdr) + itemslen + 7) & ~(size_t)7;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CMB_BIN_MAGIC, sizeof(hdr.magic));
+	hdr.version = CMB_BIN_VERSION;
+	hdr.width = out->width;
+	hdr.flags = out->numbers ? CMB_BIN_RANK : 0;
+	hdr.byteorder = CMB_BIN_BYTEORDER;
+	hdr.nitems = nitems;
+	hdr.size_min = setmin;
+	hdr.size_max = setmax;
+	hdr.recsize = (uint32_t)out->recsize;
+	hdr.items_off = sizeof(hdr);
+	hdr.items_len = itemslen;
+	hdr.records_off = hdrlen;
+
+	out->bufsize = MAX(MAX(out->bufsize, hdrlen), out->recsize);
+	if ((out->buf = malloc(out->bufsize)) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	memcpy(out->buf, &hdr, sizeof(hdr));
+	cp = out->buf + sizeof(hdr);
+	for (n = 0; n < nitems; n++) {
+		memcpy(cp, items[n], out->lens[n] + 1);
+		cp += out->lens[n] + 1;
+	}
+	memset(cp, 0, hdrlen - (size_t)(cp - out->buf));
+	out->len = hdrlen;
+}
+
+/*
+ * Takes pointer to `struct cmb_config' options, number of items, array of
+ * items, and number of items in the smallest and largest set. Returns an
+ * allocated output engine for cmb_out_put().
+ */
+static struct cmb_out *
+cmb_out_alloc(struct cmb_config *config, uint32_t nitems, char *items[],
+    uint32_t setmin, uint32_t setmax)
+{
+	uint32_t n;
+	size_t linesize;
+	size_t maxlen = 0;
+	size_t prefixlen = 0;
+	const char *prefix = NULL;
+	struct cmb_out *out;
+
+	if ((out = calloc(1, sizeof(struct cmb_out))) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	out->delimiter = " ";
+	out->eol = '\n';
+	out->stream = stdout;
+
+	/* Process config options */
+	if (config != NULL) {
+		if (config->delimiter != NULL)
+			out->delimiter = config->delimiter;
+		if ((config->options & CMB_OPT_NULPRINT) != 0)
+			out->eol = '\0';
+		if ((config->options & CMB_OPT_NUMBERS) != 0)
+			out->numbers = TRUE;
+		prefix = config->prefix;
+		out->suffix = config->suffix;
+		if (config->stream != NULL)
+			out->stream = config->stream;
+		out->wtotal = config->writer;
+		if (config->format == CMB_FORMAT_BIN)
+			out->binary = TRUE;
+		if ((config->options & CMB_OPT_EMPTY) != 0)
+			setmin = 0;
+	}
+	if (out->wtotal != NULL && out->stream == stdout)
+		out->writer = TRUE;
+	out->delimlen = strlen(out->delimiter);
+	if (prefix != NULL)
+		prefixlen = strlen(prefix);
+	if (out->suffix != NULL)
+		out->suffixlen = strlen(out->suffix);
+
+	/* Precompute item lengths */
+	out->items = items;
+	if ((out->lens = malloc(sizeof(size_t) * (nitems + 1))) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	for (n = 0; n < nitems; n++) {
+		out->lens[n] = strlen(items[n]);
+		if (out->lens[n] > maxlen)
+			maxlen = out->lens[n];
+	}
+
+	/* Allocate for the longest possible line (or record) */
+	linesize = prefixlen + (maxlen + out->delimlen) * setmax +
+	    out->suffixlen + 1;
+	if (out->binary)
+		linesize = MAX(linesize, (size_t)MAX(setmax, 1) * 4);
+	if ((out->line = malloc(linesize)) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	if ((out->offs = malloc(sizeof(size_t) * (setmax + 1))) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	if (prefix != NULL)
+		memcpy(out->line, prefix, prefixlen);
+	out->offs[0] = prefixlen;
+
+	out->bufsize = CMB_PRINT_BUFSIZE;
+	if (out->binary)
+		cmb_out_alloc_bin(out, nitems, items, setmin, setmax);
+	else if ((out->buf = malloc(out->bufsize)) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	if (out->writer) {
+		if ((out->wbuf = malloc(out->bufsize)) == NULL)
+			errx(EXIT_FAILURE, "Out of memory?!");
+		pthread_mutex_init(&out->wmtx, NULL);
+		pthread_cond_init(&out->wcv, NULL);
+	}
+	if (out->numbers) {
+		out->numsize = 32;
+		if ((out->num = malloc(out->numsize)) == NULL)
+			errx(EXIT_FAILURE, "Out of memory?!");
+	}
+
+	return (out);
+}
+
+static void cmb_out_stop(struct cmb_out *out);
+
+static void
+cmb_out_free(struct cmb_out *out)
+{
+	if (out == NULL)
+		return;
+	if (out->wbuf != NULL) {
+		cmb_out_stop(out);
+		pthread_mutex_destroy(&out->wmtx);
+		pthread_cond_destroy(&out->wcv);
+		free(out->wbuf);
+	}
+	free(out->buf);
+	free(out->lens);
+	free(out->line);
+	free(out->offs);
+	free(out->num);
+	free(out);
+}
+
+/*
+ * Returns monotonic time in nanoseconds for `struct cmb_writer_stats'.
+ */
+static uint64_t
+cmb_out_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return (0);
+	return ((uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec);
+}
+
+/*
+ * Takes array of iovec structures, number of them, and optional pointer to a
+ * count of writev(2) calls. Writes them all to stdout, after any pending
+ * stdio(3) output. The array is modified. Returns zero on success, otherwise
+ * errno.
+ */
+static int
+cmb_out_write(struct iovec *v, int iovcnt, uint64_t *nwrites)
+{
+	int error = 0;
+	ssize_t r;
+
+	pthread_mutex_lock(&cmb_out_mtx);
+	fflush(stdout); /* Preserve order with stdio(3) output */
+	while (iovcnt > 0) {
+		if (v->iov_len == 0) {
+			v++;
+			iovcnt--;
+			continue;
+		}
+		if (nwrites != NULL)
+			(*nwrites)++;
+		if ((r = writev(fileno(stdout), v, iovcnt)) == -1) {
+			if (errno == EINTR)
+				continue;
+			error = errno;
+			break;
+		}
+		for (; iovcnt > 0 && (size_t)r >= v->iov_len; v++, iovcnt--)
+			r -= (ssize_t)v->iov_len;
+		if (iovcnt > 0) {
+			v->iov_base = (char *)v->iov_base + r;
+			v->iov_len -= (size_t)r;
+		}
+	}
+	pthread_mutex_unlock(&cmb_out_mtx);
+
+	return (error);
+}
+
+/*
+ * Writer thread of `struct cmb_out'. Writes each buffer passed in wbuf by
+ * cmb_out_pass() and marks it written by zeroing wlen, until wdone is set.
+ * After a write error, later buffers are discarded (cmb_out_pass() returns
+ * the error to stop calculation).
+ */
+static void *
+cmb_out_writer(void *arg)
+{
+	int error;
+	uint64_t t;
+	struct cmb_out *out = (struct cmb_out *)arg;
+	struct iovec iov;
+
+	pthread_mutex_lock(&out->wmtx);
+	for (;;) {
+		t = cmb_out_ns();
+		while (out->wlen == 0 && !out->wdone)
+			pthread_cond_wait(&out->wcv, &out->wmtx);
+		out->wstats.idle_ns += cmb_out_ns() - t;
+		if (out->wlen == 0)
+			break;
+		iov.iov_base = out->wbuf;
+		iov.iov_len = out->wlen;
+		error = out->werror;
+		pthread_mutex_unlock(&out->wmtx);
+
+		t = cmb_out_ns();
+		if (error == 0)
+			error = cmb_out_write(&iov, 1, &out->wstats.writes);
+		t = cmb_out_ns() - t;
+
+		pthread_mutex_lock(&out->wmtx);
+		out->wstats.write_ns += t;
+		out->wstats.buffers++;
+		if (error == 0)
+			out->wstats.bytes += out->wlen;
+		else if (out->werror == 0)
+			out->werror = error;
+		out->wlen = 0;
+		pthread_cond_signal(&out->wcv);
+	}
+	pthread_mutex_unlock(&out->wmtx);
+
+	return (NULL);
+}
+
+/*
+ * Takes pointer to `struct cmb_out' with a writer thread. Waits until the
+ * writer is idle, then (unless there was a write error) swaps the pending
+ * output into wbuf for it to write, starting the thread on first use. Returns
+ * zero on success, -1 if the thread could not be started, otherwise errno.
+ */
+static int
+cmb_out_pass(struct cmb_out *out)
+{
+	int error;
+	uint64_t t;
+	char *buf;
+
+	if (out->len == 0)
+		return (0);
+	if (!out->wrunning) {
+		if (pthread_create(&out->wtid, NULL, cmb_out_writer,
+		    out) != 0) {
+			out->writer = FALSE; /* write without the thread */
+			return (-1);
+		}
+		out->wrunning = TRUE;
+	}
+
+	pthread_mutex_lock(&out->wmtx);
+	if (out->wlen != 0) {
+		out->wstats.stalls++;
+		t = cmb_out_ns();
+		while (out->wlen != 0)
+			pthread_cond_wait(&out->wcv, &out->wmtx);
+		out->wstats.stall_ns += cmb_out_ns() - t;
+	}
+	if ((error = out->werror) == 0) {
+		buf = out->wbuf;
+		out->wbuf = out->buf;
+		out->wlen = out->len;
+		out->buf = buf;
+		pthread_cond_signal(&out->wcv);
+	}
+	out->len = 0;
+	pthread_mutex_unlock(&out->wmtx);
+
+	return (error);
+}
+
+/*
+ * Takes pointer to `struct cmb_out'. Waits for the writer thread (if started)
+ * to write its last buffer and exit, then adds the metrics of the run to
+ * config writer.
+ */
+static void
+cmb_out_stop(struct cmb_out *out)
+{
+	struct cmb_writer_stats *total = out->wtotal;
+
+	if (!out->wrunning)
+		return;
+	pthread_mutex_lock(&out->wmtx);
+	out->wdone = TRUE;
+	pthread_cond_signal(&out->wcv);
+	pthread_mutex_unlock(&out->wmtx);
+	pthread_join(out->wtid, NULL);
+	out->wrunning = FALSE;
+
+	total->buffers += out->wstats.buffers;
+	total->bytes += out->wstats.bytes;
+	total->writes += out->wstats.writes;
+	total->stalls += out->wstats.stalls;
+	total->stall_ns += out->wstats.stall_ns;
+	total->write_ns += out->wstats.write_ns;
+	total->idle_ns += out->wstats.idle_ns;
+	memset(&out->wstats, 0, sizeof(out->wstats));
+}
+
+/*
+ * Takes pointer to `struct cmb_out' and an optional line (with length) too
+ * long to fit in the buffer. Writes pending output, followed by line, to
+ * stdout (or to the stream given in config, with stdio(3) and no lock). With
+ * a writer thread, pending output alone is passed to it instead; a line is
+ * written directly once the thread is idle. Returns zero on success,
+ * otherwise errno.
+ */
+static int
+cmb_out_flush(struct cmb_out *out, char *line, size_t linelen)
+{
+	int error;
+	size_t len;
+	struct iovec iov[2];
+
+	if (out->stream != stdout) {
+		len = out->len;
+		out->len = 0;
+		if (fwrite(out->buf, 1, len, out->stream) != len ||
+		    fwrite(line, 1, linelen, out->stream) != linelen)
+			return (errno != 0 ? errno : EIO);
+		return (0);
+	}
+
+	if (out->writer) {
+		if (line == NULL && (error = cmb_out_pass(out)) != -1)
+			return (error);
+		if (out->wrunning) {
+			pthread_mutex_lock(&out->wmtx);
+			while (out->wlen != 0)
+				pthread_cond_wait(&out->wcv, &out->wmtx);
+			error = out->werror;
+			pthread_mutex_unlock(&out->wmtx);
+			if (error != 0)
+				return (error);
+		}
+	}
+
+	iov[0].iov_base = out->buf;
+	iov[0].iov_len = out->len;
+	iov[1].iov_base = line;
+	iov[1].iov_len = linelen;
+	out->len = 0;
+
+	return (cmb_out_write(iov, line != NULL ? 2 : 1, NULL));
+}
+
+/*
+ * Takes pointer to `struct cmb_out'. Writes all pending output and stops the
+ * writer thread (if any). Returns zero on success, otherwise errno.
+ */
+static int
+cmb_out_close(struct cmb_out *out)
+{
+	int error;
+
+	if (out->writer && !out->wrunning)
+		out->writer = FALSE; /* too little output to need the thread */
+	error = cmb_out_flush(out, NULL, 0);
+	if (out->wrunning) {
+		cmb_out_stop(out);
+		if (error == 0)
+			error = out->werror;
+	}
+
+	return (error);
+}
+
+/*
+ * Takes pointer to `struct cmb_out' and sequence number of the combination
+ * about to be passed to cmb_out_put().
+ */
+static inline void
+cmb_out_seq(struct cmb_out *out, uint64_t seq)
+{
+	size_t n;
+
+	if (!out->numbers)
+		return;
+	if (out->binary) {
+		out->rank = seq;
+		return;
+	}
+
+	/* Only the first (or an out of order) number needs converting */
+	if (seq != out->numnext) {
+		out->numlen = cmb_utoa(seq, out->num);
+		out->numnext = seq + 1;
+		return;
+	}
+	out->numnext++;
+
+	/* Increment the decimal digits in place */
+	for (n = out->numlen; n > 0 && out->num[n - 1] == '9'; n--)
+		out->num[n - 1] = '0';
+	if (n > 0) {
+		out->num[n - 1]++;
+		return;
+	}
+
+	/* Carry out of the most significant digit */
+	if (out->numlen + 1 > out->numsize) {
+		out->numsize *= 2;
+		if ((out->num = realloc(out->num, out->numsize)) == NULL)
+			errx(EXIT_FAILURE, "Out of memory?!");
+	}
+	memmove(out->num + 1, out->num, out->numlen++);
+	out->num[0] = '1';
+}
+
+/*
+ * CMB_FORMAT_BIN equivalent of cmb_out_put(). Item numbers are updated in line
+ * from the first position that changed; unused positions are only filled when
+ * the set size changes.
+ */
+static int
+cmb_out_put_bin(struct cmb_out *out, uint32_t setsize, uint32_t setnums[],
+    uint32_t changed)
+{
+	int error;
+	uint32_t n;
+	char *cp;
+
+	if (out->rankbig)
+		return (ERANGE);
+	if (setsize != out->setsize) {
+		memset(out->line + (size_t)setsize * out->width, 0xff,
+		    (size_t)(out->slots - setsize) * out->width);
+		out->setsize = setsize;
+		changed = 0;
+	}
+	switch (out->width) {
+	case 1:
+		for (n = changed; n < setsize; n++)
+			((uint8_t *)out->line)[n] = (uint8_t)setnums[n];
+		break;
+	case 2:
+		for (n = changed; n < setsize; n++)
+			((uint16_t *)out->line)[n] = (uint16_t)setnums[n];
+		break;
+	default:
+		for (n = changed; n < setsize; n++)
+			((uint32_t *)out->line)[n] = setnums[n];
+	}
+
+	if (out->len + out->recsize > out->bufsize &&
+	    (error = cmb_out_flush(out, NULL, 0)) != 0)
+		return (error);
+	cp = out->buf + out->len;
+	if (out->numbers) {
+		memcpy(cp, &out->rank, sizeof(uint64_t));
+		cp += sizeof(uint64_t);
+	}
+	memcpy(cp, out->line, (size_t)out->slots * out->width);
+	out->len += out->recsize;
+
+	return (0);
+}
+
+/*
+ * Takes pointer to `struct cmb_out', number of items in the set, array of
+ * item numbers, and the lowest position that changed since the last call.
+ * Adds the combination to the output buffer, flushing it when full. Returns
+ * zero on success, otherwise errno.
+ */
+static int
+cmb_out_put(struct cmb_out *out, uint32_t setsize, uint32_t setnums[],
+    uint32_t changed)
+{
+	int error;
+	uint32_t n;
+	size_t len;
+	size_t pos;
+	char *cp;
+
+	if (out->binary)
+		return (cmb_out_put_bin(out, setsize, setnums, changed));
+
+	/* Rebuild the line from the first position that changed */
+	pos = out->offs[changed];
+	for (n = changed; n < setsize; n++) {
+		out->offs[n] = pos;
+		if (n > 0) {
+			memcpy(out->line + pos, out->delimiter, out->delimlen);
+			pos += out->delimlen;
+		}
+		len = out->lens[setnums[n]];
+		memcpy(out->line + pos, out->items[setnums[n]], len);
+		pos += len;
+	}
+	if (out->suffixlen > 0) {
+		memcpy(out->line + pos, out->suffix, out->suffixlen);
+		pos += out->suffixlen;
+	}
+	out->line[pos++] = out->eol;
+
+	/* Make room in the buffer */
+	len = pos;
+	if (out->numbers)
+		len += out->numlen + 1;
+	if (out->len + len > out->bufsize &&
+	    (error = cmb_out_flush(out, NULL, 0)) != 0)
+		return (error);
+
+	cp = out->buf + out->len;
+	if (out->numbers) {
+		memcpy(cp, out->num, out->numlen);
+		cp += out->numlen;
+		*cp++ = ' ';
+		out->len += out->numlen + 1;
+	}
+	if (len > out->bufsize)
+		return (cmb_out_flush(out, out->line, pos));
+	memcpy(cp, out->line, pos);
+	out->len += pos;
+
+	return (0);
+}
+
+/*
+ * Matrix of combinations (as item numbers) pending for action_batch()
+ */
+struct cmb_batch {
+	uint32_t *matrix;	/* size rows by setsize columns */
+	uint32_t nrows;		/* Number of rows pending */
+	uint32_t size;		/* Maximum number of rows */
+	uint64_t seq;		/* Sequence number of first row */
+#ifdef HAVE_OPENSSL_BN_H
+	BIGNUM *seq_bn;		/* Sequence number of first row (cmb_bn) */
+#endif
+};
+
+/*
+ * Takes pointer to `struct cmb_config' options and number of items in the
+ * largest set. Returns an allocated batch matrix for action_batch().
+ */
+static struct cmb_batch *
+cmb_batch_alloc(struct cmb_config *config, uint32_t setmax)
+{
+	struct cmb_batch *batch;
+
+	if ((batch = calloc(1, sizeof(struct cmb_batch))) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	batch->size = config->batch_size;
+	if (batch->size == 0)
+		batch->size = CMB_BATCH_SIZE;
+	if (setmax == 0)
+		setmax = 1;
+	if ((batch->matrix = (uint32_t *)malloc(sizeof(uint32_t) *
+	    batch->size * setmax)) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+
+	return (batch);
+}
+
+static void
+cmb_batch_free(struct cmb_batch *batch)
+{
+	if (batch == NULL)
+		return;
+	free(batch->matrix);
+#ifdef HAVE_OPENSSL_BN_H
+	BN_free(batch->seq_bn);
+#endif
+	free(batch);
+}
+
+/*
+ * Takes pointer to `struct cmb_config' options, pointer to `struct cmb_batch'
+ * matrix, and number of items per row. Passes pending rows to action_batch().
+ */
+static inline int
+cmb_batch_flush(struct cmb_config *config, struct cmb_batch *batch,
+    uint32_t setsize)
+{
+	uint32_t nrows = batch->nrows;
+
+	if (nrows == 0)
+		return (0);
+	batch->nrows = 0;
+
+	return (config->action_batch(config, batch->seq, setsize,
+	    batch->matrix, nrows));
+}
+
+/*
+ * Takes pointer to `struct cmb_config' options, pointer to `struct cmb_batch'
+ * matrix, sequence number, number of items, and array of item numbers.
+ * Appends a row to the matrix, flushing it to action_batch() when full.
+ */
+static inline int
+cmb_batch_add(struct cmb_config *config, struct cmb_batch *batch,
+    uint64_t seq, uint32_t setsize, uint32_t setnums[])
+{
+	if (batch->nrows == 0)
+		batch->seq = seq;
+	memcpy(&batch->matrix[(size_t)batch->nrows * setsize], setnums,
+	    sizeof(uint32_t) * setsize);
+	if (++batch->nrows < batch->size)
+		return (0);
+
+	return (cmb_batch_flush(config, batch, setsize));
+}
+
+/*
+ * Specialized enumeration kernels for sets of up-to CMB_KERNEL_MAX items.
+ * Each is a plain nested loop per position, innermost varying the last item,
+ * in place of cmb_next_lex() and cmb_next_mask() rescanning setnums for every
+ * combination. The loops resume from the combination last produced (which may
+ * have been unranked when seeking); each restarts one past the loop enclosing
+ * it and records the lowest position changed for CMB_OPT_INDICES and
+ * cmb_out_put().
+ */
+#define CMB_KERNEL_MAX 8
+
+/* Only loop, resuming one past the last item produced */
+#define CMB_KFOR_ONLY                                                        \
+	for (s[0] = resume ? (resume = FALSE, s[0] + 1) : 0;                 \
+	    s[0] < nitems; s[0]++, changed = 0)
+
+/* Outermost loop, resuming at the first item produced */
+#define CMB_KFOR_FIRST                                                       \
+	for (; s[0] <= nitems - setsize; s[0]++, changed = 0)
+
+/* Middle loops, resuming at the item produced in position d */
+#define CMB_KFOR(d)                                                          \
+	for (s[d] = resume ? s[d] : s[(d) - 1] + 1;                          \
+	    s[d] <= nitems - setsize + (d); s[d]++, changed = (d))
+
+/* Innermost loop, resuming one past the last item produced */
+#define CMB_KFOR_LAST(d)                                                     \
+	for (s[d] = resume ? (resume = FALSE, s[d] + 1) : s[(d) - 1] + 1;    \
+	    s[d] < nitems; s[d]++, changed = (d))
+
+#define CMB_KLOOPS_1 CMB_KFOR_ONLY
+#define CMB_KLOOPS_2 CMB_KFOR_FIRST CMB_KFOR_LAST(1)
+#define CMB_KLOOPS_3 CMB_KFOR_FIRST CMB_KFOR(1) CMB_KFOR_LAST(2)
+#define CMB_KLOOPS_4 CMB_KFOR_FIRST CMB_KFOR(1) CMB_KFOR(2) CMB_KFOR_LAST(3)
+#define CMB_KLOOPS_5 CMB_KFOR_FIRST CMB_KFOR(1) CMB_KFOR(2) CMB_KFOR(3)      \
+	CMB_KFOR_LAST(4)
+#define CMB_KLOOPS_6 CMB_KFOR_FIRST CMB_KFOR(1) CMB_KFOR(2) CMB_KFOR(3)      \
+	CMB_KFOR(4) CMB_KFOR_LAST(5)
+#define CMB_KLOOPS_7 CMB_KFOR_FIRST CMB_KFOR(1) CMB_KFOR(2) CMB_KFOR(3)      \
+	CMB_KFOR(4) CMB_KFOR(5) CMB_KFOR_LAST(6)
+#define CMB_KLOOPS_8 CMB_KFOR_FIRST CMB_KFOR(1) CMB_KFOR(2) CMB_KFOR(3)      \
+	CMB_KFOR(4) CMB_KFOR(5) CMB_KFOR(6) CMB_KFOR_LAST(7)
+
+/*
+ * State shared by cmb() or cmb_bn() and the kernels. Sequence number and count
+ * are updated as combinations are produced; done is set when count reaches
+ * zero (or on error).
+ */
+struct cmb_kernel {
+	uint8_t	docount;
+	uint8_t	doindices;
+	uint8_t	doprint;
+	uint8_t	done;
+	uint32_t nitems;
+	uint32_t *setnums;
+	uint64_t count;
+	uint64_t seq;
+	char	**actitems;
+	char	**curitems;
+	char	**items;
+	struct cmb_config *config;
+	struct cmb_out *out;
+	CMB_ACTION((*action));
+#ifdef HAVE_OPENSSL_BN_H
+	struct cmb_ctr *count_bn;
+	struct cmb_ctr *seq_bn;
+	CMB_ACTION_BN((*action_bn));
+#endif
+};
+
+/*
+ * Defines kernel x for sets of k items, producing each combination with emit.
+ * Returns the first non-zero return from action() (or cmb_out_put()).
+ */
+#define CMB_KERNEL_EQ(x, k, emit)                                            \
+    static int                                                               \
+    x(struct cmb_kernel *kn)                                                 \
+    {                                                                        \
+    	uint8_t resume = TRUE;                                               \
+    	uint32_t changed = (k) - 1;                                          \
+    	uint32_t n;                                                          \
+    	uint32_t nitems = kn->nitems;                                        \
+    	const uint32_t setsize = (k);                                        \
+    	uint32_t *s = kn->setnums;                                           \
+    	int retval;                                                          \
+                                                                             \
+    	(void)setsize;                                                       \
+    	CMB_KLOOPS_##k {                                                     \
+    		if (kn->doindices)                                           \
+    			kn->config->changed = changed;                       \
+    		else if (!kn->doprint) {                                     \
+    			for (n = changed; n < (k); n++)                      \
+    				kn->curitems[n] = kn->items[s[n]];           \
+    		}                                                            \
+    		emit(k);                                                     \
+    	}                                                                    \
+    	return (0);                                                          \
+    }
+
+#define CMB_KERNEL_EMIT(k)                                                   \
+    	if (kn->doprint) {                                                   \
+    		cmb_out_seq(kn->out, kn->seq++);                             \
+    		retval = cmb_out_put(kn->out, (k), s, changed);              \
+    	} else                                                               \
+    		retval = kn->action(kn->config, kn->seq++, (k),              \
+    		    kn->actitems);                                           \
+    	if (retval != 0)                                                     \
+    		return (retval);                                             \
+    	if (kn->docount && --kn->count == 0) {                               \
+    		kn->done = TRUE;                                             \
+    		return (0);                                                  \
+    	}
+#define CMB_KERNEL(k) CMB_KERNEL_EQ(cmb_kernel_##k, k, CMB_KERNEL_EMIT)
+
+CMB_KERNEL(1)
+CMB_KERNEL(2)
+CMB_KERNEL(3)
+CMB_KERNEL(4)
+CMB_KERNEL(5)
+CMB_KERNEL(6)
+CMB_KERNEL(7)
+CMB_KERNEL(8)
+
+static int (*const cmb_kernels[CMB_KERNEL_MAX + 1])(struct cmb_kernel *) = {
+	NULL, cmb_kernel_1, cmb_kernel_2, cmb_kernel_3, cmb_kernel_4,
+	cmb_kernel_5, cmb_kernel_6, cmb_kernel_7, cmb_kernel_8,
+};
+
+#ifdef HAVE_OPENSSL_BN_H
+/*
+ * Takes openssl bn(3) BIGNUM (written-to) and cmb_count_t value. Returns zero
+ * on error, non-zero on success.
+ */
+static int
+cmb_count_to_bn(BIGNUM *bn, cmb_count_t v)
+{
+	size_t n;
+	unsigned char buf[sizeof(cmb_count_t)];
+
+	for (n = sizeof(buf); n > 0; n--) {
+		buf[n - 1] = (unsigned char)(v & 0xff);
+		v >>= 8;
+	}
+	return (BN_bin2bn(buf, (int)sizeof(buf), bn) != NULL);
+}
+
+/*
+ * Takes openssl bn(3) BIGNUM and pointer to cmb_count_t (written-to). Returns
+ * non-zero if the value fits in cmb_count_t, zero otherwise.
+ */
+static int
+cmb_bn_get_count(const BIGNUM *bn, cmb_count_t *v)
+{
+	int len;
+	int n;
+	unsigned char buf[sizeof(cmb_count_t)];
+
+	if ((len = BN_num_bytes(bn)) > (int)sizeof(buf))
+		return (FALSE);
+	BN_bn2bin(bn, buf);
+	for (*v = 0, n = 0; n < len; n++)
+		*v = *v << 8 | buf[n];
+	return (TRUE);
+}
+#endif
+
+/*
+ * State shared by cmb_dfs() and cmb_dfs_emit().
+ */
+struct cmb_dfs {
+	uint8_t	usebn;		/* Call action_bn() rather than action() */
+	cmb_count_t seq;	/* Sequence number of the next combination */
+	cmb_count_t start;	/* First sequence number to produce */
+	cmb_count_t end;	/* Sequence number to stop at */
+	struct cmb_config *config;
+	CMB_ACTION((*action));
+#ifdef HAVE_OPENSSL_BN_H
+	BIGNUM	*seqbn;
+	CMB_ACTION_BN((*action_bn));
+#endif
+};
+
+/*
+ * Takes pointer to `struct cmb_dfs' state, number of items, and array of
+ * `char *' items (NULL for the empty set). Passes the combination to the
+ * action unless it falls before the first sequence number to produce.
+ */
+static int
+cmb_dfs_emit(struct cmb_dfs *dfs, uint32_t setsize, char *items[])
+{
+	int retval;
+
+	if (dfs->seq < dfs->start) {
+		dfs->seq++;
+		return (0);
+	}
+#ifdef HAVE_OPENSSL_BN_H
+	if (dfs->usebn) {
+		if (!cmb_count_to_bn(dfs->seqbn, dfs->seq))
+			return (errno = ENOMEM);
+		retval = dfs->action_bn(dfs->config, dfs->seqbn, setsize,
+		    items);
+	} else
+#endif
+	if (dfs->seq > UINT64_MAX)
+		return (errno = ERANGE);
+	else
+		retval = dfs->action(dfs->config, (uint64_t)dfs->seq, setsize,
+		    items);
+	dfs->seq++;
+
+	return (retval);
+}
+
+/*
+ * Takes pointer to `struct cmb_config' options, number of items, array of
+ * `char *' items, first sequence number, number of combinations (zero for
+ * all), and whether to call action_bn() rather than action(). Used by cmb()
+ * and cmb_bn() when bound() is set; combinations are produced in the same
+ * order with the same sequence numbers. Before descending into each prefix,
+ * bound() may skip the C(m,r) combinations beginning with it, where m is the
+ * number of items after the last item of the prefix and r the number of
+ * positions left, advancing the sequence number past them. Prefixes falling
+ * entirely before the first sequence number are skipped without asking.
+ */
+static int
+cmb_dfs(struct cmb_config *config, uint32_t nitems, char *items[],
+    cmb_count_t start, cmb_count_t count, uint8_t usebn)
+{
+	uint8_t doindices = FALSE;
+	uint8_t show_empty = FALSE;
+	int8_t nextset = 1;
+	int b;
+	int retval = 0;
+	uint32_t c;
+	uint32_t curset;
+	uint32_t low;
+	uint32_t m;
+	uint32_t n;
+	uint32_t p;
+	uint32_t r;
+	uint32_t setdone = nitems;
+	uint32_t setinit = 1;
+	uint32_t setmax;
+	cmb_count_t ncombos;
+	char **actitems;
+	char **curitems = NULL;
+	uint32_t *setnums = NULL;
+	cmb_count_t *sub = NULL;
+	struct cmb_dfs dfs = {
+		.usebn = usebn,
+		.seq = 1,
+		.start = start < 1 ? 1 : start,
+		.end = CMB_COUNT_MAX,
+		.config = config,
+		.action = cmb_print,
+#ifdef HAVE_OPENSSL_BN_H
+		.seqbn = NULL,
+		.action_bn = cmb_print_bn,
+#endif
+	};
+
+	/* Process config options */
+	if (config->order != CMB_ORDER_LEX || config->action_batch != NULL ||
+	    config->action_mask != NULL)
+		return (errno = EINVAL);
+	if (config->action != NULL)
+		dfs.action = config->action;
+#ifdef HAVE_OPENSSL_BN_H
+	if (usebn && (config->action_batch_bn != NULL ||
+	    config->action_mask_bn != NULL))
+		return (errno = EINVAL);
+	if (config->action_bn != NULL)
+		dfs.action_bn = config->action_bn;
+	if (usebn && (dfs.seqbn = BN_new()) == NULL)
+		return (errno = ENOMEM);
+#endif
+	if ((config->options & CMB_OPT_EMPTY) != 0)
+		show_empty = TRUE;
+	if ((config->options & CMB_OPT_INDICES) != 0) {
+		doindices = TRUE;
+		config->indices = NULL;
+		config->changed = 0;
+	}
+	if (config->size_min != 0 || config->size_max != 0) {
+		setinit = config->size_min;
+		setdone = config->size_max;
+	}
+	if (count != 0 && count <= CMB_COUNT_MAX - dfs.start)
+		dfs.end = dfs.start + count;
+
+	/* Adjust values to be non-zero (mathematical constraint) */
+	if (setinit == 0)
+		setinit = 1;
+	if (setdone == 0)
+		setdone = 1;
+
+	/* Enforce limits so we don't run over bounds */
+	if (setinit > nitems)
+		setinit = nitems;
+	if (setdone > nitems)
+		setdone = nitems;
+
+	/* Set the direction of flow (incrementing vs. decrementing) */
+	if (setinit > setdone)
+		nextset = -1;
+
+	/* Show the empty set consisting of a single combination of no-items */
+	if (nextset > 0 && show_empty &&
+	    (retval = cmb_dfs_emit(&dfs, 0, NULL)) != 0)
+		goto cmb_dfs_return;
+
+	if (nitems == 0)
+		goto cmb_dfs_return;
+
+	/* Allocate memory */
+	setmax = setdone > setinit ? setdone : setinit;
+	if ((curitems = (char **)malloc(sizeof(char *) * setmax)) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	if ((setnums = (uint32_t *)malloc(sizeof(uint32_t) * setmax)) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	if ((sub = malloc(sizeof(cmb_count_t) * setmax)) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	if (doindices)
+		config->indices = setnums;
+	actitems = doindices ? items : curitems;
+
+	for (curset = setinit;
+	    nextset > 0 ? curset <= setdone : curset >= setdone;
+	    curset += (uint32_t)nextset)
+	{
+		if (dfs.seq >= dfs.end)
+			goto cmb_dfs_return;
+		if ((ncombos = cmb_pascal(nitems, curset)) == 0) {
+			retval = errno = ERANGE;
+			goto cmb_dfs_return;
+		}
+		if (dfs.seq + ncombos <= dfs.start) {
+			dfs.seq += ncombos;
+			continue;
+		}
+
+		/*
+		 * p is the position being chosen, c the item number there,
+		 * sub[p] the number of combinations beginning with
+		 * setnums[0..p], C(m,r), and low the lowest position changed
+		 * since the last combination was produced
+		 */
+		p = low = 0;
+		setnums[0] = 0;
+		sub[0] = cmb_count_muldiv(ncombos, curset, nitems);
+		while (dfs.seq < dfs.end) {
+			c = setnums[p];
+			r = curset - p - 1;
+
+			/* Ascend when there are not enough items after c */
+			if (c + r >= nitems) {
+				if (p-- == 0)
+					break;
+				m = nitems - 1 - setnums[p];
+				sub[p] = cmb_count_muldiv(sub[p], m - r - 1, m);
+				setnums[p]++;
+				if (low > p)
+					low = p;
+				continue;
+			}
+
+			m = nitems - 1 - c;
+			if (dfs.seq + sub[p] <= dfs.start)
+				b = CMB_BOUND_SKIP;
+			else
+				b = config->bound(config, curset, p + 1,
+				    setnums);
+			if (b == CMB_BOUND_SKIPALL) {
+				/* C(m+1,r+1) with c or greater at p */
+				dfs.seq += cmb_count_muldiv(sub[p], m + 1,
+				    r + 1);
+				setnums[p] = nitems;
+				continue;
+			} else if (b == CMB_BOUND_DESCEND && r > 0) {
+				/* C(m-1,r-1) beginning with c+1 at p+1 */
+				sub[p + 1] = cmb_count_muldiv(sub[p], r, m);
+				setnums[++p] = c + 1;
+				continue;
+			} else if (b == CMB_BOUND_DESCEND) {
+				if (doindices)
+					config->changed = low;
+				else for (n = low; n <= p; n++)
+					curitems[n] = items[setnums[n]];
+				if ((retval = cmb_dfs_emit(&dfs, curset,
+				    actitems)) != 0)
+					goto cmb_dfs_return;
+				low = curset;
+			} else
+				dfs.seq += sub[p];
+
+			/* Next item at p; C(m-1,r) */
+			sub[p] = m == 0 ? 0 :
+			    cmb_count_muldiv(sub[p], m - r, m);
+			setnums[p]++;
+			if (low > p)
+				low = p;
+		}
+	}
+
+	/* Show the empty set consisting of a single combination of no-items */
+	if (nextset < 0 && show_empty && dfs.seq < dfs.end) {
+		if (doindices) {
+			config->indices = NULL;
+			config->changed = 0;
+		}
+		retval = cmb_dfs_emit(&dfs, 0, NULL);
+	}
+
+cmb_dfs_return:
+#ifdef HAVE_OPENSSL_BN_H
+	BN_free(dfs.seqbn);
+#endif
+	free(curitems);
+	free(setnums);
+	free(sub);
+
+	return (retval);
+}
+
+/*
+ * Takes pointer to `struct cmb_config' options, number of items, and array of
+ * `char *' items. Calculates combinations according to options and either
+ * prints combinations to stdout (default) or runs `action' if passed-in as
+ * function pointer member of `config' argument.
+ */
+int
+cmb(struct cmb_config *config, uint32_t nitems, char *items[])
+{
+#if CMB_DEBUG
+	uint8_t debug = FALSE;
+#endif
+	uint8_t dobatch = FALSE;
+	uint8_t docount = FALSE;
+	uint8_t doindices = FALSE;
+	uint8_t dokernel = FALSE;
+	uint8_t domask = FALSE;
+	uint8_t doprint = FALSE;
+	uint8_t doseek = FALSE;
+	uint8_t order = CMB_ORDER_LEX;
+	uint8_t show_empty = FALSE;
+	uint8_t usemask = FALSE;
+	int8_t nextset = 1;
+	int error;
+	int retval = 0;
+	uint32_t curset = 0;
+	uint32_t n;
+	uint32_t p;
+	uint32_t setdone = nitems;
+	uint32_t setinit = 1;
+	uint32_t setmax;
+	uint32_t setnums_last;
+	uint64_t combo;
+	uint64_t count = 0;
+	uint64_t mask = 0;
+	uint64_t ncombos;
+	uint64_t seek = 0;
+	uint64_t seq = 1;
+	cmb_count_t first;
+	cmb_count_t span;
+	cmb_count_t z;
+	char **actitems;
+	char **curitems = NULL;
+	uint32_t *setnums = NULL;
+	uint32_t *setnums_backend = NULL;
+	struct cmb_batch *batch = NULL;
+	struct cmb_kernel kn;
+	struct cmb_out *out = NULL;
+	CMB_ACTION((*action)) = cmb_print;
+
+	errno = 0;
+
+	/* Process config options */
+	if (config != NULL) {
+		if (config->action != NULL)
+			action = config->action;
+		if (config->action_mask != NULL)
+			domask = TRUE;
+		else if (config->action_batch != NULL)
+			dobatch = TRUE;
+		if (config->count != 0) {
+			docount = TRUE;
+			count = config->count;
+		}
+		if ((config->options & CMB_OPT_DEBUG) != 0) {
+#if CMB_DEBUG
+			debug = TRUE;
+#else
+			warnx("libcmb not compiled with debug support!");
+#endif
+		}
+		if ((config->options & CMB_OPT_EMPTY) != 0)
+			show_empty = TRUE;
+		if (config->order == CMB_ORDER_REVDOOR) {
+			order = CMB_ORDER_REVDOOR;
+			config->left = config->entered = UINT32_MAX;
+		}
+		if ((config->options & CMB_OPT_INDICES) != 0) {
+			doindices = TRUE;
+			config->indices = NULL;
+			config->changed = 0;
+		}
+		if (config->size_min != 0 || config->size_max != 0) {
+			setinit = config->size_min;
+			setdone = config->size_max;
+		}
+		if (config->start > 1) {
+			doseek = TRUE;
+			seq = seek = config->start;
+		}
+	}
+
+	/* Combinations as bitmasks are limited to 64 items */
+	if (domask && nitems > 64)
+		return (errno = EINVAL);
+	usemask = nitems <= 64 && (domask || order == CMB_ORDER_LEX);
+
+	if (!show_empty) {
+		if (nitems == 0)
+			return (0);
+		else if (cmb_count(config, nitems) == 0)
+			return (errno);
+	}
+
+	/* Narrow the range to the requested shard */
+	if (config != NULL && config->nshards > 1) {
+		if ((error = cmb_shard_span(config, nitems, &first,
+		    &span)) != 0)
+			return (errno = error);
+		if (span == 0)
+			return (0);
+		if (first > UINT64_MAX)
+			return (errno = ERANGE);
+		docount = TRUE;
+		count = (uint64_t)span;
+		doseek = first > 1;
+		seq = seek = (uint64_t)first;
+	}
+
+	/* Depth-first, skipping prefixes rejected by bound() */
+	if (config != NULL && config->bound != NULL)
+		return (cmb_dfs(config, nitems, items, seq,
+		    docount ? count : 0, FALSE));
+
+	/* Adjust values to be non-zero (mathematical constraint) */
+	if (setinit == 0)
+		setinit = 1;
+	if (setdone == 0)
+		setdone = 1;
+
+	/* Enforce limits so we don't run over bounds */
+	if (setinit > nitems)
+		setinit = nitems;
+	if (setdone > nitems)
+		setdone = nitems;
+
+	/* Set the direction of flow (incrementing vs. decrementing) */
+	if (setinit > setdone)
+		nextset = -1;
+
+	/* Assemble output directly instead of calling cmb_print() */
+	setmax = setdone > setinit ? setdone : setinit;
+	if (action == cmb_print && !dobatch && !domask) {
+		doprint = TRUE;
+		out = cmb_out_alloc(config, nitems, items,
+		    MIN(setinit, setdone), setmax);
+	}
+
+	/* Show the empty set consisting of a single combination of no-items */
+	if (nextset > 0 && show_empty) {
+#if CMB_DEBUG
+		if (debug)
+			cmb_debug(">>> 0-item combinations <<<");
+#endif
+		if (!doseek) {
+			if (domask)
+				retval = config->action_mask(config, seq++, 0,
+				    0);
+			else if (dobatch)
+				retval = config->action_batch(config, seq++, 0,
+				    NULL, 1);
+			else if (doprint) {
+				cmb_out_seq(out, seq++);
+				retval = cmb_out_put(out, 0, NULL, 0);
+			} else
+				retval = action(config, seq++, 0, NULL);
+			if (retval != 0)
+				goto cmb_return;
+			if (docount && --count == 0)
+				goto cmb_return;
+		} else {
+			seek--;
+			if (seek == 1)
+				doseek = FALSE;
+		}
+	}
+
+	if (nitems == 0)
+		goto cmb_return;
+
+	/* Allocate memory */
+	if (dobatch)
+		batch = cmb_batch_alloc(config, setmax);
+	if ((curitems = (char **)malloc(sizeof(char *) * setmax)) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	if ((setnums = (uint32_t *)malloc(sizeof(uint32_t) * setmax)) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	if ((setnums_backend =
+	    (uint32_t *)malloc(sizeof(uint32_t) * setmax)) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	if (doindices)
+		config->indices = setnums;
+	actitems = doindices ? items : curitems;
+
+	/* Nested loops for small sets in lexicographic order */
+	dokernel = order == CMB_ORDER_LEX && !dobatch && !domask;
+#if CMB_DEBUG
+	if (debug)
+		dokernel = FALSE;
+#endif
+	if (dokernel) {
+		bzero(&kn, sizeof(kn));
+		kn.docount = docount;
+		kn.doindices = doindices;
+		kn.doprint = doprint;
+		kn.nitems = nitems;
+		kn.setnums = setnums;
+		kn.actitems = actitems;
+		kn.curitems = curitems;
+		kn.items = items;
+		kn.config = config;
+		kn.out = out;
+		kn.action = action;
+	}
+
+	/*
+	 * Loop over each `set' in the configured direction until we are done.
+	 * NB: Each `set' can represent a single item or multiple items.
+	 */
+	for (curset = setinit;
+	    nextset > 0 ? curset <= setdone : curset >= setdone;
+	    curset += (uint32_t)nextset)
+	{
+#if CMB_DEBUG
+		if (debug)
+			cmb_debug(">>> %u-item combinations <<<", curset);
+#endif
+
+		/* Calculate number of combinations in set (exactly) */
+		if ((z = cmb_pascal(nitems, curset)) == 0 || z > UINT64_MAX) {
+			retval = errno = ERANGE;
+			goto cmb_return;
+		}
+		ncombos = (uint64_t)z;
+
+		/* Jump to next set if requested start is beyond this one */
+		if (doseek && seek > ncombos) {
+			seek -= ncombos;
+			continue;
+		}
+
+		/*
+		 * Prefill two arrays used for matrix calculations.
+		 *
+		 * The first array (setnums) is a linear sequence starting at
+		 * one (1) and ending at N (where N is the same integer as the
+		 * current set we're operating on). For example, if we are
+		 * currently on a set-of-2, setnums is 1, 2. If seeking, the
+		 * starting combination is instead unranked directly into
+		 * setnums (see cmb_unrank_set()) rather than enumerating every
+		 * combination that precedes it.
+		 *
+		 * The second array (setnums_backend) is a linear sequence
+		 * starting at nitems-N and ending at nitems (again, N is the
+		 * same integer as the current set we are operating on; nitems
+		 * is the total number of items). For example, if we are
+		 * operating on a set-of-2, and nitems is 8, setnums_backend is
+		 * set to 7, 8.
+		 */
+		if (doseek) {
+			combo = seek - 1;
+			cmb_unrank_set(order, nitems, curset, combo, setnums);
+			doseek = FALSE;
+		} else {
+			combo = 0;
+			for (n = 0; n < curset; n++)
+				setnums[n] = n;
+		}
+		p = 0;
+		for (n = curset; n > 0; n--)
+			setnums_backend[p++] = nitems - n;
+
+		/* Map the initial positional arguments into curitems */
+#if CMB_DEBUG
+		if (debug)
+			fprintf(stderr, CMB_DEBUG_PREFIX "setnums=[");
+#endif
+		mask = 0;
+		for (n = 0; n < curset; n++) {
+#if CMB_DEBUG
+			if (debug) {
+				if (n == curset - 1)
+					fprintf(stderr, "\033[31m%u\033[m",
+					    setnums[n]);
+				else
+					fprintf(stderr, "%u", setnums[n]);
+				if (n + 1 < curset)
+					fprintf(stderr, ",");
+			}
+#endif
+			if (usemask)
+				mask |= (uint64_t)1 << setnums[n];
+			if (!dobatch && !doindices && !domask && !doprint)
+				curitems[n] = items[setnums[n]];
+		}
+#if CMB_DEBUG
+		if (debug)
+			fprintf(stderr, "] seq=%"PRIu64"\n", seq);
+#endif
+
+		/* Produce results with the first set of items */
+		if (order == CMB_ORDER_REVDOOR)
+			config->left = config->entered = UINT32_MAX;
+		if (domask)
+			retval = config->action_mask(config, seq++, curset,
+			    mask);
+		else if (dobatch)
+			retval = cmb_batch_add(config, batch, seq++, curset,
+			    setnums);
+		else if (doprint) {
+			cmb_out_seq(out, seq++);
+			retval = cmb_out_put(out, curset, setnums, 0);
+		} else {
+			if (doindices)
+				config->changed = 0;
+			retval = action(config, seq++, curset, actitems);
+		}
+		if (retval != 0)
+			break;
+		if (docount && --count == 0)
+			break;
+
+		/* Remaining combinations by kernel (see CMB_KERNEL) */
+		if (dokernel && curset <= CMB_KERNEL_MAX) {
+			kn.count = count;
+			kn.seq = seq;
+			retval = cmb_kernels[curset](&kn);
+			count = kn.count;
+			seq = kn.seq;
+			if (retval != 0 || kn.done)
+				goto cmb_return;
+			continue;
+		}
+
+		/*
+		 * Process remaining self-similar combinations in the set.
+		 */
+		for (combo++; combo < ncombos; combo++) {
+			if (order == CMB_ORDER_REVDOOR) {
+				setnums_last = cmb_next_revdoor(nitems, curset,
+				    setnums, &config->left, &config->entered);
+				if (usemask)
+					mask ^= (uint64_t)1 << config->left |
+					    (uint64_t)1 << config->entered;
+			} else if (usemask)
+				setnums_last = cmb_next_mask(nitems, curset,
+				    &mask, setnums);
+			else
+				setnums_last = cmb_next_lex(curset, setnums,
+				    setnums_backend);
+#if CMB_DEBUG
+			if (debug) {
+				fprintf(stderr, CMB_DEBUG_PREFIX "setnums=[");
+				for (n = 0; n < curset; n++) {
+					if (n == setnums_last) {
+						fprintf(stderr,
+						    "\033[31m%u\033[m",
+						    setnums[n]);
+					} else {
+						fprintf(stderr, "%u",
+						    setnums[n]);
+					}
+					if (n + 1 < curset)
+						fprintf(stderr, ",");
+				}
+				fprintf(stderr, "] seq=%"PRIu64"\n", seq);
+			}
+#endif
+
+			/* Pass bitmask directly to action_mask() */
+			if (domask) {
+				retval = config->action_mask(config, seq++,
+				    curset, mask);
+				if (retval != 0)
+					goto cmb_return;
+				if (docount && --count == 0)
+					goto cmb_return;
+				continue;
+			}
+
+			/* Pass item numbers directly to action_batch() */
+			if (dobatch) {
+				retval = cmb_batch_add(config, batch, seq++,
+				    curset, setnums);
+				if (retval != 0)
+					goto cmb_return;
+				if (docount && --count == 0)
+					goto cmb_return;
+				continue;
+			}
+
+			/* Now map new setnums into values stored in items */
+			if (doindices)
+				config->changed = setnums_last;
+			else if (!doprint) {
+				for (n = setnums_last; n < curset; n++)
+					curitems[n] = items[setnums[n]];
+			}
+
+			/* Produce results with this set of items */
+			if (doprint) {
+				cmb_out_seq(out, seq++);
+				retval = cmb_out_put(out, curset, setnums,
+				    setnums_last);
+			} else
+				retval = action(config, seq++, curset,
+				    actitems);
+			if (retval != 0)
+				goto cmb_return;
+			if (docount && --count == 0)
+				goto cmb_return;
+
+		} /* for combo */
+
+		/* Rows passed to action_batch() must all be the same size */
+		if (dobatch && (retval = cmb_batch_flush(config, batch,
+		    curset)) != 0)
+			goto cmb_return;
+
+	} /* for curset */
+
+	/* Show the empty set consisting of a single combination of no-items */
+	if (nextset < 0 && show_empty) {
+		if ((!doseek || seek == 1) && (!docount || count > 0)) {
+			if (doindices) {
+				config->indices = NULL;
+				config->changed = 0;
+			}
+			if (domask)
+				retval = config->action_mask(config, seq++, 0,
+				    0);
+			else if (dobatch)
+				retval = config->action_batch(config, seq++, 0,
+				    NULL, 1);
+			else if (doprint) {
+				cmb_out_seq(out, seq++);
+				retval = cmb_out_put(out, 0, NULL, 0);
+			} else
+				retval = action(config, seq++, 0, NULL);
+		}
+	}
+
+cmb_return:
+	if (dobatch && retval == 0 && batch != NULL)
+		retval = cmb_batch_flush(config, batch, curset);
+	if (doprint && (error = cmb_out_close(out)) != 0 &&
+	    retval == 0)
+		retval = error;
+	cmb_batch_free(batch);
+	cmb_out_free(out);
+	free(curitems);
+	free(setnums);
+	free(setnums_backend);
+
+	return (retval);
+}
+
+CMB_ACTION(cmb_print)
+{
+	uint8_t nul = FALSE;
+	uint8_t show_numbers = FALSE;
+	uint32_t n;
+	size_t len;
+	char buf[21];
+	const char *delimiter = " ";
+	const char *prefix = NULL;
+	const char *suffix = NULL;
+	FILE *stream = stdout;
+
+	/* Process config options */
+	if (config != NULL) {
+		if (config->delimiter != NULL)
+			delimiter = config->delimiter;
+		if ((config->options & CMB_OPT_NULPRINT) != 0)
+			nul = TRUE;
+		if ((config->options & CMB_OPT_NUMBERS) != 0)
+			show_numbers = TRUE;
+		prefix = config->prefix;
+		suffix = config->suffix;
+		if (config->stream != NULL)
+			stream = config->stream;
+		if (config->format != CMB_FORMAT_TEXT)
+			return (errno = EINVAL); /* needs item numbers */
+	}
+
+	if (show_numbers) {
+		len = cmb_utoa(seq, buf);
+		buf[len++] = ' ';
+		fwrite(buf, 1, len, stream);
+	}
+	if (prefix != NULL)
+		fputs(prefix, stream);
+	for (n = 0; n < nitems; n++) {
+		fputs(items[n], stream);
+		if (n < nitems - 1)
+			fputs(delimiter, stream);
+	}
+	if (suffix != NULL)
+		fputs(suffix, stream);
+	putc(nul ? '\0' : '\n', stream);
+
+	return (0);
+}
+
+/*
+ * State of a pull-based enumeration (see cmb_iter_init()). Combinations are
+ * produced in the same order and with the same sequence numbers as cmb().
+ */
+#define CMB_ITER_EMPTY	0	/* Empty set is next (ascending) */
+#define CMB_ITER_SET	1	/* First combination of curset is next */
+#define CMB_ITER_COMBO	2	/* Following combination in curset is next */
+#define CMB_ITER_LAST	3	/* Empty set is next (descending) */
+#define CMB_ITER_DONE	4	/* No more combinations */
+
+struct cmb_iter {
+	struct cmb_config *config;	/* Caller's config (may be NULL) */
+	char	**items;		/* Caller's items */
+	uint32_t nitems;		/* Number of items */
+	uint8_t	state;			/* CMB_ITER_* */
+	uint8_t	order;			/* CMB_ORDER_* */
+	uint8_t	docount;		/* Limited to count combinations */
+	uint8_t	doindices;		/* CMB_OPT_INDICES given */
+	uint8_t	doseek;			/* Seeking to seek */
+	uint8_t	remap;			/* curitems must be mapped from zero */
+	uint8_t	show_empty;		/* CMB_OPT_EMPTY given */
+	uint8_t	usemask;		/* Lexicographic order via bitmask */
+	int8_t	nextset;		/* Direction (1 or -1) */
+	uint32_t setdone;		/* Last set size */
+	uint32_t curset;		/* Current set size */
+	uint32_t setsize;		/* Items in current combination */
+	uint32_t changed;		/* Lowest position changed */
+	uint32_t left;			/* Item removed (CMB_ORDER_REVDOOR) */
+	uint32_t entered;		/* Item added (CMB_ORDER_REVDOOR) */
+	uint64_t combo;			/* Combination number within curset */
+	uint64_t ncombos;		/* Number of combinations in curset */
+	uint64_t count;			/* Combinations remaining if docount */
+	uint64_t seek;			/* Combination to seek to if doseek */
+	uint64_t seq;			/* Sequence number of next combination */
+	uint64_t mask;			/* Combination as bitmask if usemask */
+	char	**curitems;		/* Current combination (mapped) */
+	uint32_t *setnums;		/* Current combination (item numbers) */
+	uint32_t *setnums_backend;	/* Final item numbers of curset */
+};
+
+/*
+ * Takes pointer to `struct cmb_config' options, number of items, and array of
+ * `char *' items. Returns an allocated iterator over the combinations that
+ * cmb() would produce, or NULL with errno set on error. The action members of
+ * config are ignored. config and items must remain valid until the iterator
+ * is released with cmb_iter_free().
+ */
+struct cmb_iter *
+cmb_iter_init(struct cmb_config *config, uint32_t nitems, char *items[])
+{
+	uint32_t setinit = 1;
+	uint32_t setmax;
+	struct cmb_iter *iter;
+
+	errno = 0;
+
+	if ((iter = calloc(1, sizeof(struct cmb_iter))) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	iter->config = config;
+	iter->items = items;
+	iter->nitems = nitems;
+	iter->order = CMB_ORDER_LEX;
+	iter->nextset = 1;
+	iter->setdone = nitems;
+	iter->left = iter->entered = UINT32_MAX;
+	iter->seq = 1;
+
+	/* Process config options */
+	if (config != NULL) {
+		if (config->count != 0) {
+			iter->docount = TRUE;
+			iter->count = config->count;
+		}
+		if ((config->options & CMB_OPT_EMPTY) != 0)
+			iter->show_empty = TRUE;
+		if (config->order == CMB_ORDER_REVDOOR)
+			iter->order = CMB_ORDER_REVDOOR;
+		if ((config->options & CMB_OPT_INDICES) != 0) {
+			iter->doindices = TRUE;
+			config->indices = NULL;
+			config->changed = 0;
+		}
+		if (config->size_min != 0 || config->size_max != 0) {
+			setinit = config->size_min;
+			iter->setdone = config->size_max;
+		}
+		if (config->start > 1) {
+			iter->doseek = TRUE;
+			iter->seq = iter->seek = config->start;
+		}
+	}
+	iter->usemask = nitems <= 64 && iter->order == CMB_ORDER_LEX;
+
+	iter->state = CMB_ITER_DONE;
+	if (!iter->show_empty) {
+		if (nitems == 0)
+			return (iter);
+		else if (cmb_count(config, nitems) == 0) {
+			if (errno != 0) {
+				free(iter);
+				return (NULL);
+			}
+			return (iter);
+		}
+	}
+
+	/* Adjust values to be non-zero (mathematical constraint) */
+	if (setinit == 0)
+		setinit = 1;
+	if (iter->setdone == 0)
+		iter->setdone = 1;
+
+	/* Enforce limits so we don't run over bounds */
+	if (setinit > nitems)
+		setinit = nitems;
+	if (iter->setdone > nitems)
+		iter->setdone = nitems;
+
+	/* Set the direction of flow (incrementing vs. decrementing) */
+	if (setinit > iter->setdone)
+		iter->nextset = -1;
+	iter->curset = setinit;
+	iter->state = iter->nextset > 0 && iter->show_empty ?
+	    CMB_ITER_EMPTY : CMB_ITER_SET;
+
+	/* Allocate memory */
+	setmax = iter->setdone > setinit ? iter->setdone : setinit;
+	if (setmax == 0)
+		setmax = 1;
+	if ((iter->curitems = (char **)malloc(sizeof(char *) * setmax))
+	    == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	if ((iter->setnums = (uint32_t *)malloc(sizeof(uint32_t) * setmax))
+	    == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	if ((iter->setnums_backend =
+	    (uint32_t *)malloc(sizeof(uint32_t) * setmax)) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+
+	return (iter);
+}
+
+/*
+ * Takes pointer to `struct cmb_iter'. Advances setnums to the next
+ * combination, setting setsize (zero for the empty set) and changed.
+ * Returns FALSE when there are no more combinations (errno set on error).
+ */
+static int
+cmb_iter_step(struct cmb_iter *iter)
+{
+	uint32_t curset;
+	uint32_t n;
+	uint32_t p;
+	cmb_count_t z;
+
+	if (iter->docount && iter->count == 0)
+		iter->state = CMB_ITER_DONE;
+
+	for (;;) {
+		switch (iter->state) {
+		case CMB_ITER_EMPTY:
+			iter->state = CMB_ITER_SET;
+			if (iter->doseek) {
+				if (--iter->seek == 1)
+					iter->doseek = FALSE;
+				continue;
+			}
+			iter->setsize = 0;
+			break;
+		case CMB_ITER_SET:
+			curset = iter->curset;
+			if (iter->nitems == 0 || (iter->nextset > 0 ?
+			    curset > iter->setdone : curset < iter->setdone)) {
+				iter->state = iter->nextset < 0 &&
+				    iter->show_empty ? CMB_ITER_LAST :
+				    CMB_ITER_DONE;
+				continue;
+			}
+
+			/* Calculate number of combinations in set (exactly) */
+			if ((z = cmb_pascal(iter->nitems, curset)) == 0 ||
+			    z > UINT64_MAX) {
+				errno = ERANGE;
+				iter->state = CMB_ITER_DONE;
+				return (FALSE);
+			}
+			iter->ncombos = (uint64_t)z;
+
+			/* Jump to next set if requested start is beyond */
+			if (iter->doseek && iter->seek > iter->ncombos) {
+				iter->seek -= iter->ncombos;
+				iter->curset += (uint32_t)iter->nextset;
+				continue;
+			}
+
+			/* Prefill setnums and setnums_backend (see cmb()) */
+			if (iter->doseek) {
+				iter->combo = iter->seek - 1;
+				cmb_unrank_set(iter->order, iter->nitems,
+				    curset, iter->combo, iter->setnums);
+				iter->doseek = FALSE;
+			} else {
+				iter->combo = 0;
+				for (n = 0; n < curset; n++)
+					iter->setnums[n] = n;
+			}
+			p = 0;
+			for (n = curset; n > 0; n--)
+				iter->setnums_backend[p++] = iter->nitems - n;
+			iter->mask = 0;
+			if (iter->usemask) {
+				for (n = 0; n < curset; n++)
+					iter->mask |=
+					    (uint64_t)1 << iter->setnums[n];
+			}
+			iter->left = iter->entered = UINT32_MAX;
+			iter->setsize = curset;
+			iter->changed = 0;
+			iter->state = CMB_ITER_COMBO;
+			break;
+		case CMB_ITER_COMBO:
+			if (++iter->combo >= iter->ncombos) {
+				iter->curset += (uint32_t)iter->nextset;
+				iter->state = CMB_ITER_SET;
+				continue;
+			}
+			if (iter->order == CMB_ORDER_REVDOOR)
+				iter->changed = cmb_next_revdoor(iter->nitems,
+				    iter->curset, iter->setnums, &iter->left,
+				    &iter->entered);
+			else if (iter->usemask)
+				iter->changed = cmb_next_mask(iter->nitems,
+				    iter->curset, &iter->mask, iter->setnums);
+			else
+				iter->changed = cmb_next_lex(iter->curset,
+				    iter->setnums, iter->setnums_backend);
+			break;
+		case CMB_ITER_LAST:
+			iter->state = CMB_ITER_DONE;
+			if (iter->doseek && iter->seek != 1)
+				continue;
+			iter->setsize = 0;
+			break;
+		default:
+			return (FALSE);
+		}
+		break;
+	}
+
+	if (iter->docount)
+		iter->count--;
+
+	return (TRUE);
+}
+
+/*
+ * Takes pointer to `struct cmb_iter' and pointers to uint64_t, uint32_t, and
+ * `char **' (written-to, containing the sequence number, number of items, and
+ * items of the next combination). Returns TRUE if a combination was produced
+ * or FALSE when there are no more combinations (errno set on error).
+ *
+ * If CMB_OPT_INDICES was given, items is set to the original array and the
+ * indices and changed members of config describe the combination as for
+ * action(). In revolving-door order, left and entered are also updated.
+ */
+int
+cmb_iter_next(struct cmb_iter *iter, uint64_t *seq, uint32_t *nitems,
+    char ***items)
+{
+	struct cmb_config *config = iter->config;
+	uint32_t n;
+
+	errno = 0;
+	if (!cmb_iter_step(iter))
+		return (FALSE);
+	*seq = iter->seq++;
+	*nitems = iter->setsize;
+
+	if (iter->order == CMB_ORDER_REVDOOR) {
+		config->left = iter->left;
+		config->entered = iter->entered;
+	}
+	if (iter->doindices) {
+		config->indices = iter->setsize > 0 ? iter->setnums : NULL;
+		config->changed = iter->changed;
+		*items = iter->items;
+		return (TRUE);
+	}
+
+	/* Map only the positions that changed */
+	n = iter->remap ? 0 : iter->changed;
+	for (; n < iter->setsize; n++)
+		iter->curitems[n] = iter->items[iter->setnums[n]];
+	iter->remap = FALSE;
+	*items = iter->curitems;
+
+	return (TRUE);
+}
+
+/*
+ * Takes pointer to `struct cmb_iter', pointers to uint64_t and uint32_t
+ * (written-to, containing the sequence number of the first row and the
+ * number of items in each row), matrix of maxrows rows of item numbers
+ * (written-to), and maximum number of rows. Rows are laid out as for
+ * action_batch() and are all from the same set; indices must have room for
+ * maxrows times the largest set size. Returns the number of rows produced,
+ * zero when there are no more combinations (errno set on error).
+ */
+uint32_t
+cmb_iter_next_batch(struct cmb_iter *iter, uint64_t *seq, uint32_t *nitems,
+    uint32_t *indices, uint32_t maxrows)
+{
+	uint32_t nrows = 0;
+	size_t setsize;
+
+	errno = 0;
+	if (maxrows == 0 || !cmb_iter_step(iter))
+		return (0);
+	*seq = iter->seq;
+	*nitems = iter->setsize;
+	setsize = iter->setsize;
+	iter->remap = TRUE;
+
+	for (;;) {
+		if (setsize > 0)
+			memcpy(&indices[nrows * setsize], iter->setnums,
+			    sizeof(uint32_t) * setsize);
+		nrows++;
+		iter->seq++;
+
+		/* Stop at the end of the set */
+		if (nrows == maxrows || iter->state != CMB_ITER_COMBO ||
+		    iter->combo + 1 >= iter->ncombos ||
+		    (iter->docount && iter->count == 0))
+			break;
+		(void)cmb_iter_step(iter);
+	}
+
+	return (nrows);
+}
+
+/*
+ * Takes pointer to `struct cmb_iter' returned by cmb_iter_init(). Releases
+ * the iterator.
+ */
+void
+cmb_iter_free(struct cmb_iter *iter)
+{
+	if (iter == NULL)
+		return;
+	free(iter->curitems);
+	free(iter->setnums);
+	free(iter->setnums_backend);
+	free(iter);
+}
+
+/*
+ * State of a reader of CMB_FORMAT_BIN output (see cmb_bin_open()). Records are
+ * read ahead into buf, a whole number of records at a time.
+ */
+struct cmb_bin {
+	struct cmb_bin_header header;	/* In host byte order */
+	int	fd;			/* Caller's file descriptor */
+	uint8_t	swap;			/* Written in the other byte order */
+	uint32_t slots;			/* Item numbers per record */
+	uint32_t unused;		/* Item number of an unused slot */
+	off_t	base;			/* Offset of header in fd (-1 if pipe) */
+	char	*table;			/* Items, each NUL terminated */
+	char	**items;		/* Pointers into table */
+	char	*buf;			/* Records read ahead */
+	size_t	bufsize;		/* Size of buf (whole records) */
+	size_t	len;			/* Bytes in buf */
+	size_t	pos;			/* Offset in buf of the next record */
+};
+
+static inline uint16_t
+cmb_bswap16(uint16_t x)
+{
+	return ((uint16_t)((x << 8) | (x >> 8)));
+}
+
+static inline uint32_t
+cmb_bswap32(uint32_t x)
+{
+	return ((x << 24) | ((x << 8) & 0xff0000) | ((x >> 8) & 0xff00) |
+	    (x >> 24));
+}
+
+static inline uint64_t
+cmb_bswap64(uint64_t x)
+{
+	return ((uint64_t)cmb_bswap32((uint32_t)x) << 32 |
+	    cmb_bswap32((uint32_t)(x >> 32)));
+}
+
+/*
+ * Takes file descriptor, buffer, size of buffer, and record size. Reads until
+ * the buffer is full, holds a non-zero number of whole records, or at end of
+ * file. Returns number of bytes read, or -1 with errno set.
+ */
+static ssize_t
+cmb_bin_fill(int fd, char *buf, size_t size, size_t recsize)
+{
+	size_t len = 0;
+	ssize_t r;
+
+	while (len < size && (len == 0 || len % recsize != 0)) {
+		if ((r = read(fd, buf + len, size - len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return (-1);
+		}
+		if (r == 0)
+			break;
+		len += (size_t)r;
+	}
+
+	return ((ssize_t)len);
+}
+
+/*
+ * Takes file descriptor and number of bytes to read and discard (works on
+ * pipes). Returns zero on success, EINVAL at end of file, otherwise errno.
+ */
+static int
+cmb_bin_skip(int fd, uint64_t len)
+{
+	size_t n;
+	ssize_t r;
+	char buf[512];
+
+	while (len > 0) {
+		n = (size_t)MIN(len, sizeof(buf));
+		if ((r = cmb_bin_fill(fd, buf, n, n)) == -1)
+			return (errno);
+		if ((size_t)r != n)
+			return (EINVAL);
+		len -= n;
+	}
+
+	return (0);
+}
+
+/*
+ * Takes file descriptor positioned at the start of CMB_FORMAT_BIN output and
+ * optional pointers to a header and `char **' (written-to). Reads the header
+ * (converted to host byte order) and items. Returns a reader for
+ * cmb_bin_read(), or NULL with errno set (EINVAL if the input is not
+ * CMB_FORMAT_BIN output). Items remain valid until cmb_bin_free().
+ */
+struct cmb_bin *
+cmb_bin_open(int fd, struct cmb_bin_header *header, char ***items)
+{
+	int error;
+	uint32_t n;
+	size_t len;
+	size_t size;
+	ssize_t r;
+	char *cp;
+	char *end;
+	struct cmb_bin *bin;
+	struct cmb_bin_header *h;
+
+	if ((bin = calloc(1, sizeof(struct cmb_bin))) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	bin->fd = fd;
+	bin->base = lseek(fd, 0, SEEK_CUR);
+	errno = 0;
+	h = &bin->header;
+
+	/* Read and check the header */
+	if ((r = cmb_bin_fill(fd, (char *)h, sizeof(*h), sizeof(*h))) == -1)
+		goto cmb_bin_open_error;
+	if ((size_t)r != sizeof(*h) ||
+	    memcmp(h->magic, CMB_BIN_MAGIC, sizeof(h->magic)) != 0)
+		goto cmb_bin_open_invalid;
+	if (h->byteorder != CMB_BIN_BYTEORDER) {
+		if (cmb_bswap32(h->byteorder) != CMB_BIN_BYTEORDER)
+			goto cmb_bin_open_invalid;
+		bin->swap = TRUE;
+		h->version = cmb_bswap16(h->version);
+		h->byteorder = CMB_BIN_BYTEORDER;
+		h->nitems = cmb_bswap32(h->nitems);
+		h->size_min = cmb_bswap32(h->size_min);
+		h->size_max = cmb_bswap32(h->size_max);
+		h->recsize = cmb_bswap32(h->recsize);
+		h->reserved = cmb_bswap32(h->reserved);
+		h->items_off = cmb_bswap64(h->items_off);
+		h->items_len = cmb_bswap64(h->items_len);
+		h->records_off = cmb_bswap64(h->records_off);
+	}
+	bin->slots = MAX(h->size_max, 1);
+	bin->unused = h->width == 1 ? UINT8_MAX :
+	    h->width == 2 ? UINT16_MAX : UINT32_MAX;
+	if (h->version != CMB_BIN_VERSION ||
+	    (h->width != 1 && h->width != 2 && h->width != 4) ||
+	    (h->flags & ~CMB_BIN_RANK) != 0 || h->nitems > bin->unused ||
+	    h->size_max > MAX(h->nitems, 1) ||
+	    (uint64_t)h->recsize != (uint64_t)bin->slots * h->width +
+	    ((h->flags & CMB_BIN_RANK) != 0 ? sizeof(uint64_t) : 0) ||
+	    h->items_off < sizeof(*h) || h->nitems > h->items_len ||
+	    h->items_len >= SIZE_MAX ||
+	    h->items_len > UINT64_MAX - h->items_off ||
+	    h->records_off < h->items_off + h->items_len)
+		goto cmb_bin_open_invalid;
+
+	/* Read the items (growing the table only as they arrive) */
+	if ((error = cmb_bin_skip(fd, h->items_off - sizeof(*h))) != 0)
+		goto cmb_bin_open_errno;
+	size = (size_t)MIN(h->items_len, CMB_PRINT_BUFSIZE);
+	if ((bin->table = malloc(MAX(size, 1))) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	for (len = 0; len < h->items_len; len += (size_t)r) {
+		if (len == size) {
+			size = (size_t)MIN(h->items_len, (uint64_t)size * 2);
+			if ((bin->table = realloc(bin->table, size)) == NULL)
+				errx(EXIT_FAILURE, "Out of memory?!");
+		}
+		if ((r = cmb_bin_fill(fd, bin->table + len, size - len,
+		    size - len)) == -1)
+			goto cmb_bin_open_error;
+		if ((size_t)r != size - len)
+			goto cmb_bin_open_invalid;
+	}
+	if ((bin->items = malloc(sizeof(char *) * (h->nitems + 1))) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	cp = bin->table;
+	end = bin->table + h->items_len;
+	for (n = 0; n < h->nitems; n++) {
+		bin->items[n] = cp;
+		if ((cp = memchr(cp, '\0', (size_t)(end - cp))) == NULL)
+			goto cmb_bin_open_invalid;
+		cp++;
+	}
+	bin->items[n] = NULL;
+	if (cp != end)
+		goto cmb_bin_open_invalid;
+	if ((error = cmb_bin_skip(fd,
+	    h->records_off - h->items_off - h->items_len)) != 0)
+		goto cmb_bin_open_errno;
+
+	/* Read ahead as many records as fit in a print buffer */
+	bin->bufsize = MAX(CMB_PRINT_BUFSIZE / h->recsize, 1) * h->recsize;
+	if ((bin->buf = malloc(bin->bufsize)) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+
+	if (header != NULL)
+		*header = *h;
+	if (items != NULL)
+		*items = bin->items;
+	return (bin);
+
+cmb_bin_open_invalid:
+	error = EINVAL;
+	goto cmb_bin_open_errno;
+cmb_bin_open_error:
+	error = errno;
+cmb_bin_open_errno:
+	cmb_bin_free(bin);
+	errno = error;
+	return (NULL);
+}
+
+/*
+ * Takes pointer to `struct cmb_bin' and pointers to uint64_t (may be NULL),
+ * uint32_t, and an array of at least MAX(size_max, 1) item numbers (written-
+ * to, containing the sequence number, number of items, and item numbers of the
+ * next record). The sequence number is zero unless the header has
+ * CMB_BIN_RANK. Returns TRUE if a record was read or FALSE at end of input
+ * (errno set on error; EINVAL if the record is invalid or truncated).
+ */
+int
+cmb_bin_read(struct cmb_bin *bin, uint64_t *seq, uint32_t *setsize,
+    uint32_t setnums[])
+{
+	uint16_t u16;
+	uint32_t n;
+	uint32_t num;
+	ssize_t r;
+	const char *cp;
+	struct cmb_bin_header *h = &bin->header;
+
+	errno = 0;
+
+	if (bin->pos == bin->len) {
+		bin->pos = bin->len = 0;
+		if ((r = cmb_bin_fill(bin->fd, bin->buf, bin->bufsize,
+		    h->recsize)) <= 0)
+			return (FALSE);
+		if ((size_t)r % h->recsize != 0) {
+			errno = EINVAL; /* truncated */
+			return (FALSE);
+		}
+		bin->len = (size_t)r;
+	}
+	cp = bin->buf + bin->pos;
+	bin->pos += h->recsize;
+
+	if (seq != NULL)
+		*seq = 0;
+	if ((h->flags & CMB_BIN_RANK) != 0) {
+		if (seq != NULL) {
+			memcpy(seq, cp, sizeof(uint64_t));
+			if (bin->swap)
+				*seq = cmb_bswap64(*seq);
+		}
+		cp += sizeof(uint64_t);
+	}
+	for (n = 0; n < bin->slots; n++) {
+		switch (h->width) {
+		case 1:
+			num = (uint8_t)cp[n];
+			break;
+		case 2:
+			memcpy(&u16, cp + n * 2, sizeof(u16));
+			num = bin->swap ? cmb_bswap16(u16) : u16;
+			break;
+		default:
+			memcpy(&num, cp + n * 4, sizeof(num));
+			if (bin->swap)
+				num = cmb_bswap32(num);
+		}
+		if (num == bin->unused)
+			break;
+		if (num >= h->nitems) {
+			errno = EINVAL;
+			return (FALSE);
+		}
+		setnums[n] = num;
+	}
+	*setsize = n;
+
+	return (TRUE);
+}
+
+/*
+ * Takes pointer to `struct cmb_bin' and record number (zero-based). Positions
+ * the reader so that the next cmb_bin_read() returns that record. Requires a
+ * seekable file descriptor. Returns zero on success, otherwise errno (ESPIPE
+ * if the input is a pipe).
+ */
+int
+cmb_bin_seek(struct cmb_bin *bin, uint64_t record)
+{
+	uint64_t off;
+	struct cmb_bin_header *h = &bin->header;
+
+	if (bin->base == -1)
+		return (errno = ESPIPE);
+	if (h->records_off > (uint64_t)INT64_MAX - (uint64_t)bin->base)
+		return (errno = EINVAL);
+	off = (uint64_t)bin->base + h->records_off;
+	if (record > ((uint64_t)INT64_MAX - off) / h->recsize)
+		return (errno = EINVAL);
+	if (lseek(bin->fd, (off_t)(off + record * h->recsize), SEEK_SET) == -1)
+		return (errno);
+	bin->pos = bin->len = 0;
+
+	return (0);
+}
+
+void
+cmb_bin_free(struct cmb_bin *bin)
+{
+	if (bin == NULL)
+		return;
+	free(bin->buf);
+	free(bin->items);
+	free(bin->table);
+	free(bin);
+}
+
+/*
+ * Pseudo-random number generator for cmb_sample(); xoshiro256** seeded with
+ * splitmix64 so that a given seed draws the same samples on every platform.
+ */
+struct cmb_rand {
+	uint64_t s[4];
+};
+
+static inline uint64_t
+cmb_rand_rotl(uint64_t x, int k)
+{
+	return ((x << k) | (x >> (64 - k)));
+}
+
+static void
+cmb_rand_seed(struct cmb_rand *rng, uint64_t seed)
+{
+	int n;
+	uint64_t z;
+
+	for (n = 0; n < 4; n++) {
+		z = (seed += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		rng->s[n] = z ^ (z >> 31);
+	}
+}
+
+static inline uint64_t
+cmb_rand_next(struct cmb_rand *rng)
+{
+	uint64_t *s = rng->s;
+	uint64_t r = cmb_rand_rotl(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = cmb_rand_rotl(s[3], 45);
+
+	return (r);
+}
+
+/*
+ * Takes pointer to `struct cmb_rand' and non-zero range. Returns uniformly
+ * distributed integer in range 0 <= return < range (multiply-shift, with
+ * rejection of the biased low products).
+ */
+static inline uint32_t
+cmb_rand_u32(struct cmb_rand *rng, uint32_t range)
+{
+	uint32_t t;
+	uint64_t m;
+
+	m = (cmb_rand_next(rng) >> 32) * range;
+	if ((uint32_t)m < range) {
+		t = -range % range;
+		while ((uint32_t)m < t)
+			m = (cmb_rand_next(rng) >> 32) * range;
+	}
+
+	return ((uint32_t)(m >> 32));
+}
+
+/*
+ * Same as cmb_rand_u32() but for cmb_count_t (masked rejection sampling).
+ */
+static cmb_count_t
+cmb_rand_count(struct cmb_rand *rng, cmb_count_t range)
+{
+	size_t b;
+	cmb_count_t mask = range - 1;
+	cmb_count_t r;
+
+	for (b = 1; b < CMB_COUNT_BITS; b <<= 1)
+		mask |= mask >> b;
+	do {
+		r = cmb_rand_next(rng);
+		r = (r << 32 << 32) | cmb_rand_next(rng);
+	} while ((r &= mask) >= range);
+
+	return (r);
+}
+
+/*
+ * Sets of at most this many items are drawn by insertion into a sorted array;
+ * larger sets use a per-item generation stamp (allocated once per call).
+ */
+#ifndef CMB_SAMPLE_SMALL
+#define CMB_SAMPLE_SMALL 16
+#endif
+
+/*
+ * State of cmb_sample(). Without replacement, each combination drawn is kept
+ * (as its size followed by its item numbers) in an arena, indexed by an open-
+ * addressing hash table of arena offsets.
+ */
+struct cmb_sampler {
+	struct cmb_rand rng;
+	uint32_t nitems;	/* Number of items */
+	uint32_t *stamp;	/* Generation in which each item was drawn */
+	uint32_t gen;		/* Current generation */
+	uint64_t *hashes;	/* Hash of each slot */
+	size_t	*slots;		/* Arena offset + 1 of each slot (0 if free) */
+	size_t	nslots;		/* Number of slots (power of two) */
+	size_t	nused;		/* Number of slots in use */
+	uint32_t *arena;	/* Combinations drawn */
+	size_t	arenalen;	/* Elements used in arena */
+	size_t	arenasize;	/* Elements allocated in arena */
+};
+
+static int
+cmb_u32cmp(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return (x < y ? -1 : x > y);
+}
+
+/*
+ * Takes pointer to `struct cmb_sampler', number of items in the set, and array
+ * to be populated with positional arguments. Draws a uniformly random set of
+ * distinct item numbers in ascending order with Floyd's algorithm; O(setsize)
+ * draws, choosing the complement instead if that is smaller.
+ */
+static void
+cmb_sample_set(struct cmb_sampler *s, uint32_t setsize, uint32_t setnums[])
+{
+	uint8_t marked;
+	uint32_t j;
+	uint32_t m;
+	uint32_t n = 0;
+	uint32_t nitems = s->nitems;
+	uint32_t p;
+	uint32_t t;
+
+	if (setsize <= CMB_SAMPLE_SMALL) {
+		for (j = nitems - setsize; j < nitems; j++) {
+			t = cmb_rand_u32(&s->rng, j + 1);
+			for (p = n; p > 0 && setnums[p - 1] > t; p--)
+				;
+			if (p > 0 && setnums[p - 1] == t) {
+				/* Drawn before; take j (larger than any) */
+				t = j;
+				p = n;
+			}
+			memmove(&setnums[p + 1], &setnums[p],
+			    sizeof(uint32_t) * (n - p));
+			setnums[p] = t;
+			n++;
+		}
+		return;
+	}
+
+	if (++s->gen == 0) {
+		memset(s->stamp, 0, sizeof(uint32_t) * nitems);
+		s->gen = 1;
+	}
+	m = MIN(setsize, nitems - setsize);
+	for (j = nitems - m; j < nitems; j++) {
+		t = cmb_rand_u32(&s->rng, j + 1);
+		if (s->stamp[t] == s->gen)
+			t = j;
+		s->stamp[t] = s->gen;
+		if (m == setsize)
+			setnums[n++] = t;
+	}
+
+	/* Sort what was drawn unless scanning every item is cheaper */
+	marked = m == setsize;
+	if (marked && (uint64_t)setsize * 8 < nitems) {
+		qsort(setnums, setsize, sizeof(uint32_t), cmb_u32cmp);
+		return;
+	}
+	for (t = 0, n = 0; t < nitems; t++)
+		if ((s->stamp[t] == s->gen) == marked)
+			setnums[n++] = t;
+}
+
+/*
+ * Takes pointer to `struct cmb_sampler', number of items in the set, and array
+ * of positional arguments. Returns TRUE if the combination was drawn before,
+ * otherwise remembers it and returns FALSE.
+ */
+static int
+cmb_sample_seen(struct cmb_sampler *s, uint32_t setsize, uint32_t setnums[])
+{
+	uint32_t n;
+	uint64_t h = 0x9e3779b97f4a7c15ULL * (setsize + 1);
+	size_t i;
+	size_t mask;
+	size_t nslots;
+	size_t off;
+	size_t *slots;
+	uint64_t *hashes;
+
+	for (n = 0; n < setsize; n++)
+		h = (h ^ setnums[n]) * 0xff51afd7ed558ccdULL;
+	h ^= h >> 32;
+
+	/* Look for the combination */
+	mask = s->nslots - 1;
+	for (i = h & mask; s->slots[i] != 0; i = (i + 1) & mask) {
+		if (s->hashes[i] != h)
+			continue;
+		off = s->slots[i] - 1;
+		if (s->arena[off] == setsize && memcmp(&s->arena[off + 1],
+		    setnums, sizeof(uint32_t) * setsize) == 0)
+			return (TRUE);
+	}
+
+	/* Remember it */
+	if (s->arenalen + setsize + 1 > s->arenasize) {
+		s->arenasize = MAX(s->arenasize * 2,
+		    s->arenalen + setsize + 1);
+		if ((s->arena = realloc(s->arena,
+		    sizeof(uint32_t) * s->arenasize)) == NULL)
+			errx(EXIT_FAILURE, "Out of memory?!");
+	}
+	off = s->arenalen;
+	s->arena[off] = setsize;
+	memcpy(&s->arena[off + 1], setnums, sizeof(uint32_t) * setsize);
+	s->arenalen += setsize + 1;
+	s->hashes[i] = h;
+	s->slots[i] = off + 1;
+
+	/* Keep the table at most half full */
+	if (++s->nused * 2 <= s->nslots)
+		return (FALSE);
+	nslots = s->nslots * 2;
+	mask = nslots - 1;
+	if ((hashes = malloc(sizeof(uint64_t) * nslots)) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	if ((slots = calloc(nslots, sizeof(size_t))) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	for (n = 0; n < s->nslots; n++) {
+		if (s->slots[n] == 0)
+			continue;
+		for (i = s->hashes[n] & mask; slots[i] != 0;
+		    i = (i + 1) & mask)
+			;
+		hashes[i] = s->hashes[n];
+		slots[i] = s->slots[n];
+	}
+	free(s->hashes);
+	free(s->slots);
+	s->hashes = hashes;
+	s->slots = slots;
+	s->nslots = nslots;
+
+	return (FALSE);
+}
+
+/*
+ * Takes pointer to `struct cmb_config' options, number of items, array of
+ * `char *' items, number of samples, and seed. Draws nsamples uniformly random
+ * combinations (every combination that cmb() would produce is equally likely)
+ * and either prints them to stdout (default) or runs `action' for each. The
+ * sequence number passed is that of the sample (1 to nsamples). Given
+ * config->unique, no combination is drawn twice and at most the total number
+ * of combinations are drawn. Returns the first non-zero result from action(),
+ * otherwise zero; on error, returns and sets errno.
+ */
+int
+cmb_sample(struct cmb_config *config, uint32_t nitems, char *items[],
+    uint64_t nsamples, uint64_t seed)
+{
+#if CMB_DEBUG
+	uint8_t debug = FALSE;
+#endif
+	uint8_t dobatch = FALSE;
+	uint8_t doindices = FALSE;
+	uint8_t domask = FALSE;
+	uint8_t doprint = FALSE;
+	uint8_t dorank = FALSE;
+	uint8_t show_empty = FALSE;
+	uint8_t unique = FALSE;
+	int error;
+	int retval = 0;
+	uint32_t batchset = 0;
+	uint32_t i;
+	uint32_t lo;
+	uint32_t n;
+	uint32_t nsizes;
+	uint32_t setdone = nitems;
+	uint32_t setinit = 1;
+	uint32_t setmax;
+	uint32_t setsize;
+	uint32_t t;
+	uint64_t mask;
+	uint64_t nsampled = 0;
+	uint64_t seq = 0;
+	long double lmax;
+	long double u;
+	cmb_count_t r;
+	cmb_count_t z;
+	char **actitems;
+	char **curitems = NULL;
+	uint32_t *setnums = NULL;
+	cmb_count_t *cum = NULL;
+	long double *cuml = NULL;
+	struct cmb_batch *batch = NULL;
+	struct cmb_out *out = NULL;
+	struct cmb_sampler s;
+	CMB_ACTION((*action)) = cmb_print;
+
+	errno = 0;
+	memset(&s, 0, sizeof(struct cmb_sampler));
+
+	/* Process config options */
+	if (config != NULL) {
+		if (config->action != NULL)
+			action = config->action;
+		if (config->action_mask != NULL)
+			domask = TRUE;
+		else if (config->action_batch != NULL)
+			dobatch = TRUE;
+#if CMB_DEBUG
+		if ((config->options & CMB_OPT_DEBUG) != 0)
+			debug = TRUE;
+#endif
+		if ((config->options & CMB_OPT_EMPTY) != 0)
+			show_empty = TRUE;
+		if ((config->options & CMB_OPT_NUMBERS) != 0)
+			dorank = TRUE;
+		if ((config->options & CMB_OPT_INDICES) != 0) {
+			doindices = TRUE;
+			config->indices = NULL;
+			config->changed = 0;
+		}
+		if (config->order == CMB_ORDER_REVDOOR)
+			config->left = config->entered = UINT32_MAX;
+		if (config->size_min != 0 || config->size_max != 0) {
+			setinit = config->size_min;
+			setdone = config->size_max;
+		}
+		unique = config->unique;
+	}
+
+	/* Combinations as bitmasks are limited to 64 items */
+	if (domask && nitems > 64)
+		return (errno = EINVAL);
+
+	if (!show_empty) {
+		if (nitems == 0)
+			return (0);
+		else if (cmb_count(config, nitems) == 0 && errno == 0)
+			return (0);
+		errno = 0;
+	}
+
+	/* Adjust values to be non-zero and ascending (order does not matter) */
+	if (setinit == 0)
+		setinit = 1;
+	if (setdone == 0)
+		setdone = 1;
+	if (setinit > setdone) {
+		t = setinit;
+		setinit = setdone;
+		setdone = t;
+	}
+
+	/* Enforce limits so we don't run over bounds */
+	if (setinit > nitems)
+		setinit = nitems;
+	if (setdone > nitems)
+		setdone = nitems;
+	/* Set sizes by index (following the empty set at index zero) */
+	lo = setinit;
+	nsizes = nitems == 0 ? 0 : setdone - setinit + 1;
+	if (show_empty) {
+		lo--;
+		nsizes++;
+	}
+	setmax = MAX(setdone, 1);
+#if CMB_DEBUG
+	if (debug)
+		cmb_debug("%s: nsamples=%"PRIu64" seed=%"PRIu64" sizes=%u",
+		    __func__, nsamples, seed, nsizes);
+#endif
+
+	/*
+	 * Cumulative number of combinations through each set size (the empty
+	 * set first), so that the set size is drawn with probability
+	 * proportional to its number of combinations. If the total does not
+	 * fit in cmb_count_t, relative weights are used instead.
+	 */
+	if (nsizes > 1) {
+		if ((cum = malloc(sizeof(cmb_count_t) * nsizes)) == NULL)
+			errx(EXIT_FAILURE, "Out of memory?!");
+		for (i = 0, z = 0; i < nsizes; i++) {
+			setsize = show_empty && i == 0 ? 0 : lo + i;
+			r = setsize == 0 ? 1 : cmb_pascal(nitems, setsize);
+			if (r == 0 || r > CMB_COUNT_MAX - z)
+				break;
+			cum[i] = z += r;
+		}
+		if (i < nsizes) {
+			errno = 0;
+			free(cum);
+			cum = NULL;
+			if ((cuml = malloc(sizeof(long double) * nsizes)) ==
+			    NULL)
+				errx(EXIT_FAILURE, "Out of memory?!");
+			t = MIN(MAX(nitems / 2, setinit), setdone);
+			lmax = lgammal((long double)t + 1) +
+			    lgammal((long double)(nitems - t) + 1);
+			for (i = 0, u = 0; i < nsizes; i++) {
+				setsize = show_empty && i == 0 ? 0 : lo + i;
+				cuml[i] = u += expl(lmax -
+				    lgammal((long double)setsize + 1) -
+				    lgammal((long double)(nitems - setsize) +
+				    1));
+			}
+		}
+	}
+
+	/* Without replacement, draw at most every combination once */
+	if (unique) {
+		if (cum != NULL && nsamples > cum[nsizes - 1])
+			nsamples = (uint64_t)cum[nsizes - 1];
+		else if (nsizes == 1 && (z = show_empty ? 1 :
+		    cmb_pascal(nitems, lo)) != 0 && nsamples > z)
+			nsamples = (uint64_t)z;
+		errno = 0;
+		s.nslots = 1024;
+		if ((s.hashes = malloc(sizeof(uint64_t) * s.nslots)) == NULL)
+			errx(EXIT_FAILURE, "Out of memory?!");
+		if ((s.slots = calloc(s.nslots, sizeof(size_t))) == NULL)
+			errx(EXIT_FAILURE, "Out of memory?!");
+	}
+
+	/* Allocate memory */
+	cmb_rand_seed(&s.rng, seed);
+	s.nitems = nitems;
+	if (setdone > CMB_SAMPLE_SMALL &&
+	    (s.stamp = calloc(nitems, sizeof(uint32_t))) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	if (dobatch)
+		batch = cmb_batch_alloc(config, setmax);
+	else if (action == cmb_print && !domask) {
+		doprint = TRUE;
+		out = cmb_out_alloc(config, nitems, items, setinit, setmax);
+	}
+	if ((curitems = (char **)malloc(sizeof(char *) * setmax)) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	if ((setnums = (uint32_t *)malloc(sizeof(uint32_t) * setmax)) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	actitems = doindices ? items : curitems;
+
+	while (nsampled < nsamples) {
+		/* Draw set size (binary search of cumulative weights) */
+		i = 0;
+		if (cum != NULL) {
+			r = cmb_rand_count(&s.rng, cum[nsizes - 1]);
+			for (i = 0, n = nsizes - 1; i < n;) {
+				t = i + (n - i) / 2;
+				if (cum[t] > r)
+					n = t;
+				else
+					i = t + 1;
+			}
+		} else if (cuml != NULL) {
+			u = (long double)(cmb_rand_next(&s.rng) >> 11) *
+			    0x1p-53L * cuml[nsizes - 1];
+			for (i = 0, n = nsizes - 1; i < n;) {
+				t = i + (n - i) / 2;
+				if (cuml[t] > u)
+					n = t;
+				else
+					i = t + 1;
+			}
+		}
+		setsize = show_empty && i == 0 ? 0 : lo + i;
+
+		/* Draw combination */
+		cmb_sample_set(&s, setsize, setnums);
+		if (unique && cmb_sample_seen(&s, setsize, setnums))
+			continue;
+		nsampled++;
+
+		/* Number by sequence (as cmb() would) or by sample */
+		if (dorank) {
+			seq = cmb_rank(config, nitems, setsize, setnums);
+			if (errno != 0) {
+				retval = errno;
+				break;
+			}
+		} else
+			seq = nsampled;
+
+		if (domask) {
+			for (mask = 0, n = 0; n < setsize; n++)
+				mask |= (uint64_t)1 << setnums[n];
+			retval = config->action_mask(config, seq, setsize,
+			    mask);
+		} else if (dobatch) {
+			if (setsize != batchset || (dorank &&
+			    seq != batch->seq + batch->nrows)) {
+				if ((retval = cmb_batch_flush(config, batch,
+				    batchset)) != 0)
+					break;
+				batchset = setsize;
+			}
+			if (setsize == 0)
+				retval = config->action_batch(config, seq, 0,
+				    NULL, 1);
+			else
+				retval = cmb_batch_add(config, batch, seq,
+				    setsize, setnums);
+		} else if (doprint) {
+			cmb_out_seq(out, seq);
+			retval = cmb_out_put(out, setsize, setnums, 0);
+		} else {
+			if (doindices) {
+				config->indices = setsize > 0 ? setnums : NULL;
+				config->changed = 0;
+			} else {
+				for (n = 0; n < setsize; n++)
+					curitems[n] = items[setnums[n]];
+			}
+			retval = action(config, seq, setsize, actitems);
+		}
+		if (retval != 0)
+			break;
+	}
+
+	if (dobatch && retval == 0)
+		retval = cmb_batch_flush(config, batch, batchset);
+	if (doprint && (error = cmb_out_close(out)) != 0 &&
+	    retval == 0)
+		retval = error;
+	cmb_batch_free(batch);
+	cmb_out_free(out);
+	free(curitems);
+	free(setnums);
+	free(cum);
+	free(cuml);
+	free(s.stamp);
+	free(s.hashes);
+	free(s.slots);
+	free(s.arena);
+
+	return (retval);
+}
+
+/*
+ * Range of sequence numbers [lo, hi) owned by a cmb_parallel() worker. Other
+ * workers steal from the end of the range when their own runs dry.
+ */
+struct cmb_prange {
+	pthread_mutex_t mtx;
+	uint64_t lo;
+	uint64_t hi;
+};
+
+/*
+ * State shared by all cmb_parallel() workers
+ */
+struct cmb_pool {
+	struct cmb_config *config;	/* Caller's config */
+	char **items;			/* Caller's items */
+	uint32_t nitems;		/* Number of items */
+	uint32_t nthreads;		/* Number of workers */
+	uint64_t grain;			/* Combinations per work unit */
+	struct cmb_prange *ranges;	/* Per-worker sequence ranges */
+	pthread_mutex_t mtx;		/* Protects retval */
+	int retval;			/* First non-zero result */
+	atomic_int stop;		/* Non-zero if workers should exit */
+	CMB_ACTION((*action));		/* Caller's action */
+	CMB_ACTION_BATCH((*action_batch)); /* Caller's action_batch */
+	CMB_ACTION_MASK((*action_mask)); /* Caller's action_mask */
+};
+
+/*
+ * Per-worker state. The config member must be first; action() is called
+ * with a pointer to it and cmb_parallel_action() casts it back.
+ */
+struct cmb_worker {
+	struct cmb_config config;	/* Per-thread copy of caller's config */
+	struct cmb_pool *pool;		/* Shared state */
+	pthread_t tid;			/* Thread handle */
+};
+
+/*
+ * Trampoline for action() in cmb_parallel() workers. Stops early if another
+ * worker has already produced a non-zero result.
+ */
+static
+CMB_ACTION(cmb_parallel_action)
+{
+	struct cmb_worker *worker = (struct cmb_worker *)config;
+
+	if (atomic_load_explicit(&worker->pool->stop, memory_order_relaxed))
+		return (-1);
+	return (worker->pool->action(config, seq, nitems, items));
+}
+
+/*
+ * Trampoline for action_batch() in cmb_parallel() workers
+ */
+static
+CMB_ACTION_BATCH(cmb_parallel_action_batch)
+{
+	struct cmb_worker *worker = (struct cmb_worker *)config;
+
+	if (atomic_load_explicit(&worker->pool->stop, memory_order_relaxed))
+		return (-1);
+	return (worker->pool->action_batch(config, seq, nitems, indices,
+	    nrows));
+}
+
+/*
+ * Trampoline for action_mask() in cmb_parallel() workers
+ */
+static
+CMB_ACTION_MASK(cmb_parallel_action_mask)
+{
+	struct cmb_worker *worker = (struct cmb_worker *)config;
+
+	if (atomic_load_explicit(&worker->pool->stop, memory_order_relaxed))
+		return (-1);
+	return (worker->pool->action_mask(config, seq, nitems, mask));
+}
+
+/*
+ * Takes pointer to `struct cmb_pool', worker number, and pointers to
+ * uint64_t (written-to). Claims the next unit of work for the worker,
+ * stealing half of the largest remaining range from another worker when the
+ * worker's own range is exhausted. Returns zero when no work remains.
+ */
+static int
+cmb_parallel_claim(struct cmb_pool *pool, uint32_t id, uint64_t *lo,
+    uint64_t *hi)
+{
+	uint32_t n;
+	uint64_t mid;
+	uint64_t rem;
+	uint64_t steal_hi;
+	uint64_t steal_lo;
+	struct cmb_prange *own = &pool->ranges[id];
+	struct cmb_prange *victim;
+
+	for (;;) {
+		if (atomic_load(&pool->stop))
+			return (FALSE);
+
+		/* Take from the front of our own range */
+		pthread_mutex_lock(&own->mtx);
+		if (own->lo < own->hi) {
+			*lo = own->lo;
+			*hi = own->hi - own->lo > pool->grain ?
+			    own->lo + pool->grain : own->hi;
+			own->lo = *hi;
+			pthread_mutex_unlock(&own->mtx);
+			return (TRUE);
+		}
+		pthread_mutex_unlock(&own->mtx);
+
+		/* Steal the back half of another worker's range */
+		steal_lo = steal_hi = 0;
+		for (n = 1; n < pool->nthreads && steal_lo == steal_hi; n++) {
+			victim = &pool->ranges[(id + n) % pool->nthreads];
+			pthread_mutex_lock(&victim->mtx);
+			if ((rem = victim->hi - victim->lo) > 0) {
+				mid = victim->lo + rem / 2;
+				steal_lo = mid;
+				steal_hi = victim->hi;
+				victim->hi = mid;
+			}
+			pthread_mutex_unlock(&victim->mtx);
+		}
+		if (steal_lo == steal_hi)
+			return (FALSE);
+
+		pthread_mutex_lock(&own->mtx);
+		own->lo = steal_lo;
+		own->hi = steal_hi;
+		pthread_mutex_unlock(&own->mtx);
+	}
+	/* NOTREACHED */
+}
+
+/*
+ * cmb_parallel() worker thread. Runs cmb() over each claimed unit of work.
+ */
+static void *
+cmb_parallel_worker(void *arg)
+{
+	int retval;
+	uint64_t hi;
+	uint64_t lo;
+	struct cmb_worker *worker = arg;
+	struct cmb_pool *pool = worker->pool;
+
+	while (cmb_parallel_claim(pool, worker->config.thread, &lo, &hi)) {
+		worker->config.start = lo;
+		worker->config.count = hi - lo;
+		retval = cmb(&worker->config, pool->nitems, pool->items);
+		if (retval == 0)
+			continue;
+		pthread_mutex_lock(&pool->mtx);
+		if (pool->retval == 0 && !atomic_load(&pool->stop))
+			pool->retval = retval;
+		atomic_store(&pool->stop, TRUE);
+		pthread_mutex_unlock(&pool->mtx);
+		break;
+	}
+
+	return (NULL);
+}
+
+/*
+ * Takes pointer to `struct cmb_config' options, number of items, array of
+ * `char *' items, and number of threads (zero for one per online CPU). Same
+ * as cmb() but the combinations are divided among threads; action() is called
+ * concurrently with a per-thread copy of config (see `thread'). Combinations
+ * are not produced in order, but each receives its proper sequence number.
+ */
+int
+cmb_parallel(struct cmb_config *config, uint32_t nitems, char *items[],
+    uint32_t nthreads)
+{
+	int error;
+	uint32_t n;
+	uint64_t count;
+	uint64_t first = 1;
+	uint64_t last;
+	uint64_t share;
+	long ncpu;
+	cmb_count_t shard_count;
+	cmb_count_t shard_first;
+	struct cmb_pool pool;
+	struct cmb_worker *workers;
+	struct cmb_config defconfig;
+
+	errno = 0;
+
+	if (config == NULL) {
+		bzero(&defconfig, sizeof(defconfig));
+		config = &defconfig;
+	}
+	if (config->format != CMB_FORMAT_TEXT)
+		return (errno = EINVAL); /* one header per worker */
+	if (nthreads == 0) {
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = ncpu > 0 ? (uint32_t)ncpu : 1;
+	}
+
+	/* Determine the range of sequence numbers to produce */
+	if ((count = cmb_count(config, nitems)) == 0) {
+		if (errno != 0)
+			return (errno);
+		return (cmb(config, nitems, items)); /* Nothing to divide */
+	}
+	if (config->nshards > 1) {
+		if ((error = cmb_shard_span(config, nitems, &shard_first,
+		    &shard_count)) != 0)
+			return (errno = error);
+		if (shard_count == 0)
+			return (0);
+		first = (uint64_t)shard_first;
+		last = first + (uint64_t)shard_count;
+	} else {
+		if (config->start > 1)
+			first = config->start;
+		if (first > count)
+			return (0);
+		last = count + 1;
+		if (config->count != 0 && config->count < last - first)
+			last = first + config->count;
+	}
+	if (nthreads > last - first)
+		nthreads = (uint32_t)(last - first);
+	if (nthreads <= 1)
+		return (cmb(config, nitems, items));
+
+	/* Initialize shared state */
+	bzero(&pool, sizeof(pool));
+	pool.config = config;
+	pool.items = items;
+	pool.nitems = nitems;
+	pool.nthreads = nthreads;
+	pool.action = config->action != NULL ? config->action : cmb_print;
+	pool.action_batch = config->action_batch;
+	pool.action_mask = config->action_mask;
+	atomic_init(&pool.stop, FALSE);
+	pool.grain = (last - first) / ((uint64_t)nthreads * CMB_PARALLEL_SPLIT);
+	if (pool.grain < 1)
+		pool.grain = 1;
+	else if (pool.grain > CMB_PARALLEL_GRAIN_MAX)
+		pool.grain = CMB_PARALLEL_GRAIN_MAX;
+	if ((pool.ranges = calloc(nthreads, sizeof(*pool.ranges))) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	if ((workers = calloc(nthreads, sizeof(*workers))) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	pthread_mutex_init(&pool.mtx, NULL);
+
+	/* Divide the sequence range evenly as a starting point */
+	share = (last - first) / nthreads;
+	for (n = 0; n < nthreads; n++) {
+		pthread_mutex_init(&pool.ranges[n].mtx, NULL);
+		pool.ranges[n].lo = first + share * n;
+		pool.ranges[n].hi = n == nthreads - 1 ? last :
+		    first + share * (n + 1);
+	}
+
+	/* Launch workers */
+	for (n = 0; n < nthreads; n++) {
+#ifdef HAVE_OPENSSL_BN_H
+		/* bn(3) members are absent in consumers built without */
+		memcpy(&workers[n].config, config,
+		    offsetof(struct cmb_config, count_bn));
+#else
+		memcpy(&workers[n].config, config, sizeof(struct cmb_config));
+#endif
+		/* cmb() writes whole lines for cmb_print() under a lock */
+		workers[n].config.action = pool.action == cmb_print ?
+		    cmb_print : cmb_parallel_action;
+		if (pool.action_batch != NULL)
+			workers[n].config.action_batch =
+			    cmb_parallel_action_batch;
+		if (pool.action_mask != NULL)
+			workers[n].config.action_mask =
+			    cmb_parallel_action_mask;
+		workers[n].config.thread = n;
+		workers[n].config.nshards = 0; /* ranges are already narrowed */
+		workers[n].config.writer = NULL;
+		workers[n].pool = &pool;
+		if ((error = pthread_create(&workers[n].tid, NULL,
+		    cmb_parallel_worker, &workers[n])) != 0) {
+			/* Stop the workers already started */
+			pthread_mutex_lock(&pool.mtx);
+			pool.retval = error;
+			atomic_store(&pool.stop, TRUE);
+			pthread_mutex_unlock(&pool.mtx);
+			break;
+		}
+	}
+	nthreads = n;
+	for (n = 0; n < nthreads; n++)
+		pthread_join(workers[n].tid, NULL);
+
+	/* Clean up */
+	for (n = 0; n < pool.nthreads; n++)
+		pthread_mutex_destroy(&pool.ranges[n].mtx);
+	pthread_mutex_destroy(&pool.mtx);
+	free(pool.ranges);
+	free(workers);
+
+	return (errno = pool.retval);
+}
+
+/*
+ * A combination kept by cmb_top(), with its score and sequence number
+ */
+struct cmb_scored {
+	long double score;
+	uint64_t seq;
+	uint32_t setsize;
+	uint32_t *setnums;	/* Item numbers (in the heap's arena) */
+};
+
+/*
+ * Bounded max-heap of the best combinations seen by one thread of cmb_top();
+ * the worst of them is at the root, to be replaced by anything better.
+ */
+struct cmb_heap {
+	struct cmb_config config;	/* Caller's config, passed to score() */
+	uint32_t len;			/* Combinations in heap */
+	struct cmb_scored *ents;	/* ntop combinations */
+	uint32_t *arena;		/* ntop rows of item numbers */
+	char **curitems;		/* Items of combination for score() */
+};
+
+/*
+ * State shared by cmb_top() threads, passed as config data
+ */
+struct cmb_top {
+	uint8_t	doindices;		/* CMB_OPT_INDICES given by caller */
+	uint32_t ntop;			/* Combinations to keep */
+	struct cmb_heap *heaps;		/* One per thread */
+	CMB_SCORE((*score));		/* Caller's score */
+};
+
+/*
+ * Returns TRUE if a ranks before b: a lower score (NaN last), or the same
+ * score and a lower sequence number.
+ */
+static inline int
+cmb_scored_before(long double ascore, uint64_t aseq,
+    const struct cmb_scored *b)
+{
+	if (ascore < b->score || (isnan(b->score) && !isnan(ascore)))
+		return (TRUE);
+	if (ascore > b->score || isnan(ascore) != isnan(b->score))
+		return (FALSE);
+	return (aseq < b->seq);
+}
+
+static int
+cmb_scored_cmp(const void *a, const void *b)
+{
+	const struct cmb_scored *x = *(const struct cmb_scored * const *)a;
+	const struct cmb_scored *y = *(const struct cmb_scored * const *)b;
+
+	if (cmb_scored_before(x->score, x->seq, y))
+		return (-1);
+	return (cmb_scored_before(y->score, y->seq, x) ? 1 : 0);
+}
+
+/*
+ * Action for cmb_top(). Scores each combination and keeps it if it ranks
+ * before the worst of the heap (or the heap is not yet full); O(log ntop).
+ */
+static
+CMB_ACTION(cmb_top_action)
+{
+	uint32_t c;
+	uint32_t n;
+	long double score;
+	char **argitems = items;
+	struct cmb_scored ent;
+	struct cmb_scored *ents;
+	struct cmb_top *top = config->data;
+	struct cmb_heap *heap = &top->heaps[config->thread];
+
+	/* Present the combination as the caller asked */
+	heap->config.indices = config->indices;
+	heap->config.changed = config->changed;
+	heap->config.thread = config->thread;
+	if (!top->doindices) {
+		for (n = 0; n < nitems; n++)
+			heap->curitems[n] = items[config->indices[n]];
+		argitems = heap->curitems;
+	}
+	score = top->score(&heap->config, seq, nitems, argitems);
+
+	/* Replace the worst if full, otherwise add */
+	ents = heap->ents;
+	if (heap->len == top->ntop) {
+		if (!cmb_scored_before(score, seq, &ents[0]))
+			return (0);
+		n = 0;
+	} else
+		n = heap->len++;
+	ent = ents[n];
+	ent.score = score;
+	ent.seq = seq;
+	ent.setsize = nitems;
+	if (nitems > 0)
+		memcpy(ent.setnums, config->indices,
+		    sizeof(uint32_t) * nitems);
+
+	/* Sift up from a new leaf, or down from the root */
+	if (n > 0) {
+		for (; n > 0; n = (n - 1) / 2) {
+			if (cmb_scored_before(ents[(n - 1) / 2].score,
+			    ents[(n - 1) / 2].seq, &ent))
+				ents[n] = ents[(n - 1) / 2];
+			else
+				break;
+		}
+	} else {
+		for (; (c = 2 * n + 1) < heap->len; n = c) {
+			if (c + 1 < heap->len && cmb_scored_before(
+			    ents[c].score, ents[c].seq, &ents[c + 1]))
+				c++;
+			if (!cmb_scored_before(ent.score, ent.seq, &ents[c]))
+				break;
+			ents[n] = ents[c];
+		}
+	}
+	ents[n] = ent;
+
+	return (0);
+}
+
+/*
+ * Takes pointer to `struct cmb_config' options, number of items, array of
+ * `char *' items, number of combinations to keep, and number of threads (zero
+ * for one per online CPU). Calls score() for every combination cmb() would
+ * produce, keeping the ntop with the lowest scores (ties going to the lower
+ * sequence number) in a bounded heap per thread, O(log ntop) each. The heaps
+ * are merged at the end and action() is called for each combination kept, in
+ * order of score with its sequence number; nothing else is produced during
+ * the scan.
+ */
+int
+cmb_top(struct cmb_config *config, uint32_t nitems, char *items[],
+    uint32_t ntop, uint32_t nthreads)
+{
+	uint32_t i;
+	uint32_t n;
+	uint32_t nkept = 0;
+	uint32_t setmax;
+	int retval = 0;
+	long ncpu;
+	char **actitems;
+	char **curitems;
+	struct cmb_config resconfig;
+	struct cmb_config topconfig;
+	struct cmb_heap *heap;
+	struct cmb_scored **kept;
+	struct cmb_top top;
+	CMB_ACTION((*action)) = cmb_print;
+
+	errno = 0;
+
+	/* Process config options */
+	if (config == NULL || config->score == NULL || config->bound != NULL)
+		return (errno = EINVAL);
+	if (config->action != NULL)
+		action = config->action;
+	if (ntop == 0)
+		return (0);
+	if (nthreads == 0) {
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = ncpu > 0 ? (uint32_t)ncpu : 1;
+	}
+	setmax = MAX(MAX(config->size_min, config->size_max), 1);
+	if (setmax > nitems || (config->size_min == 0 &&
+	    config->size_max == 0))
+		setmax = MAX(nitems, 1);
+
+	/* One heap per thread */
+	bzero(&top, sizeof(top));
+	top.doindices = (config->options & CMB_OPT_INDICES) != 0;
+	top.ntop = ntop;
+	top.score = config->score;
+	if ((top.heaps = calloc(nthreads, sizeof(struct cmb_heap))) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	for (n = 0; n < nthreads; n++) {
+		heap = &top.heaps[n];
+		memcpy(&heap->config, config, sizeof(struct cmb_config));
+		if ((heap->ents = malloc(sizeof(struct cmb_scored) * ntop)) ==
+		    NULL)
+			errx(EXIT_FAILURE, "Out of memory?!");
+		if ((heap->arena = malloc(sizeof(uint32_t) * setmax * ntop)) ==
+		    NULL)
+			errx(EXIT_FAILURE, "Out of memory?!");
+		if ((heap->curitems = malloc(sizeof(char *) * setmax)) == NULL)
+			errx(EXIT_FAILURE, "Out of memory?!");
+		for (i = 0; i < ntop; i++)
+			heap->ents[i].setnums = &heap->arena[i * setmax];
+	}
+
+	/* Score every combination */
+	memcpy(&topconfig, config, sizeof(struct cmb_config));
+	topconfig.options |= CMB_OPT_INDICES;
+	topconfig.data = &top;
+	topconfig.thread = 0;
+	topconfig.action = cmb_top_action;
+	topconfig.action_batch = NULL;
+	topconfig.action_mask = NULL;
+	if (nthreads > 1)
+		retval = cmb_parallel(&topconfig, nitems, items, nthreads);
+	else
+		retval = cmb(&topconfig, nitems, items);
+
+	/* Merge the heaps */
+	if ((kept = malloc(sizeof(*kept) * ntop * nthreads)) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	for (n = 0; n < nthreads; n++) {
+		for (i = 0; i < top.heaps[n].len; i++)
+			kept[nkept++] = &top.heaps[n].ents[i];
+	}
+	qsort(kept, nkept, sizeof(*kept), cmb_scored_cmp);
+	if (nkept > ntop)
+		nkept = ntop;
+
+	/* Produce the best in order (indices point into the heaps) */
+	memcpy(&resconfig, config, sizeof(struct cmb_config));
+	curitems = top.heaps[0].curitems;
+	actitems = top.doindices ? items : curitems;
+	for (i = 0; i < nkept && retval == 0; i++) {
+		if (top.doindices) {
+			resconfig.indices = kept[i]->setsize > 0 ?
+			    kept[i]->setnums : NULL;
+			resconfig.changed = 0;
+		} else {
+			for (n = 0; n < kept[i]->setsize; n++)
+				curitems[n] = items[kept[i]->setnums[n]];
+		}
+		retval = action(&resconfig, kept[i]->seq, kept[i]->setsize,
+		    actitems);
+	}
+
+	for (n = 0; n < nthreads; n++) {
+		free(top.heaps[n].ents);
+		free(top.heaps[n].arena);
+		free(top.heaps[n].curitems);
+	}
+	free(top.heaps);
+	free(kept);
+
+	return (retval);
+}
+
+#ifdef HAVE_OPENSSL_BN_H
+/*
+ * Takes openssl bn(3) BIGNUM (written-to) and uint64_t value. Returns zero on
+ * error, non-zero on success.
+ */
+static inline int
+cmb_bn_set_u64(BIGNUM *bn, uint64_t v)
+{
+#if BN_BITS2 >= 64
+	return (BN_set_word(bn, (BN_ULONG)v));
+#else
+	return (BN_set_word(bn, (BN_ULONG)(v >> 32)) && BN_lshift(bn, bn, 32) &&
+	    BN_add_word(bn, (BN_ULONG)(v & 0xffffffff)));
+#endif
+}
+
+/*
+ * Takes openssl bn(3) BIGNUM and pointer to uint64_t (written-to). Returns
+ * non-zero if the value fits in uint64_t, zero otherwise.
+ */
+static inline int
+cmb_bn_get_u64(const BIGNUM *bn, uint64_t *v)
+{
+	int len;
+	int n;
+	unsigned char buf[sizeof(uint64_t)];
+
+	if ((len = BN_num_bytes(bn)) > (int)sizeof(buf))
+		return (FALSE);
+	BN_bn2bin(bn, buf);
+	for (*v = 0, n = 0; n < len; n++)
+		*v = *v << 8 | buf[n];
+	return (TRUE);
+}
+
+/*
+ * Hybrid counter for cmb_bn(). The value is kept in native n until it no
+ * longer fits, after which bn(3) arithmetic is used on bn. cmb_ctr_bn()
+ * returns the value as a BIGNUM (in bn) for passing to callbacks.
+ */
+struct cmb_ctr {
+	uint8_t	big;		/* Value is in bn rather than n */
+	uint64_t n;		/* Value if not big */
+	BIGNUM	*bn;		/* Value if big */
+};
+
+static int
+cmb_ctr_init(struct cmb_ctr *ctr)
+{
+	ctr->big = FALSE;
+	ctr->n = 0;
+	return ((ctr->bn = BN_new()) != NULL);
+}
+
+/*
+ * Takes pointer to `struct cmb_ctr' (written-to) and BIGNUM value. Returns
+ * zero on error, non-zero on success.
+ */
+static int
+cmb_ctr_set(struct cmb_ctr *ctr, const BIGNUM *v)
+{
+	if (cmb_bn_get_u64(v, &ctr->n)) {
+		ctr->big = FALSE;
+		return (TRUE);
+	}
+	ctr->big = TRUE;
+	return (BN_copy(ctr->bn, v) != NULL);
+}
+
+static inline BIGNUM *
+cmb_ctr_bn(struct cmb_ctr *ctr)
+{
+	if (!ctr->big && !cmb_bn_set_u64(ctr->bn, ctr->n))
+		return (NULL);
+	return (ctr->bn);
+}
+
+/*
+ * Takes pointer to `struct cmb_ctr'. Adds one, promoting the counter to bn(3)
+ * on overflow. Returns zero on error, non-zero on success.
+ */
+static inline int
+cmb_ctr_incr(struct cmb_ctr *ctr)
+{
+	if (!ctr->big) {
+		if (ctr->n != UINT64_MAX) {
+			ctr->n++;
+			return (TRUE);
+		}
+		if (!cmb_bn_set_u64(ctr->bn, ctr->n))
+			return (FALSE);
+		ctr->big = TRUE;
+	}
+	return (BN_add_word(ctr->bn, 1));
+}
+
+/*
+ * Takes pointer to non-zero `struct cmb_ctr'. Subtracts one. Returns zero on
+ * error, non-zero on success.
+ */
+static inline int
+cmb_ctr_decr(struct cmb_ctr *ctr)
+{
+	if (!ctr->big) {
+		ctr->n--;
+		return (TRUE);
+	}
+	return (BN_sub_word(ctr->bn, 1));
+}
+
+static inline int
+cmb_ctr_is_zero(struct cmb_ctr *ctr)
+{
+	return (ctr->big ? BN_is_zero(ctr->bn) : ctr->n == 0);
+}
+
+/*
+ * Takes pointers to two `struct cmb_ctr'. Returns non-zero if a is less than
+ * b.
+ */
+static inline int
+cmb_ctr_lt(struct cmb_ctr *a, struct cmb_ctr *b)
+{
+	if (!a->big && !b->big)
+		return (a->n < b->n);
+	return (BN_ucmp(cmb_ctr_bn(a), cmb_ctr_bn(b)) < 0);
+}
+
+/*
+ * Takes pointer to `struct cmb_config' options and number of items. Returns
+ * total number of combinations according to config options. Numbers formatted
+ * as openssl bn(3) BIGNUM type.
+ */
+BIGNUM *
+cmb_count_bn(struct cmb_config *config, uint32_t nitems)
+{
+	uint8_t show_empty = FALSE;
+	int8_t nextset = 1;
+	uint32_t curset;
+	uint32_t i = nitems;
+	uint32_t k;
 	uint32_t p;
 	uint32_t setdone = nitems;
 	uint32_t setinit = 1;
-	BIGNUM *count = NULL;
+	cmb_count_t total;
+	BIGNUM *count = NULL;
+	BIGNUM *ncombos = NULL;
+
+	if (nitems == 0)
+		return (NULL);
+
+	/* Count natively unless the total is too large */
+	if (cmb_count_total(config, nitems, &total) == 0) {
+		if (total == 0)
+			return (NULL);
+		if ((count = BN_new()) == NULL)
+			return (NULL);
+		if (!cmb_count_to_bn(count, total)) {
+			BN_free(count);
+			return (NULL);
+		}
+		return (count);
+	}
+	errno = 0;
+
+	/* Process config options */
+	if (config != NULL) {
+		if ((config->options & CMB_OPT_EMPTY) != 0)
+			show_empty = TRUE;
+		if (config->size_min != 0 || config->size_max != 0) {
+			setinit = config->size_min;
+			setdone = config->size_max;
+		}
+	}
+
+	/* Adjust values to be non-zero (mathematical constraint) */
+	if (setinit == 0)
+		setinit = 1;
+	if (setdone == 0)
+		setdone = 1;
+
+	/* Return NULL if the request is out of range */
+	if (setinit > nitems && setdone > nitems)
+		return (NULL);
+
+	/* Enforce limits so we don't run over bounds */
+	if (setinit > nitems)
+		setinit = nitems;
+	if (setdone > nitems)
+		setdone = nitems;
+
+	/* Set the direction of flow (incrementing vs decrementing) */
+	if (setinit > setdone)
+		nextset = -1;
+
+	/* Initialize count */
+	if ((count = BN_new()) == NULL)
+		return (NULL);
+#if defined(LIBRESSL_VERSION_NUMBER) || (OPENSSL_VERSION_NUMBER >= 0x0090800fL)
+	BN_zero(count);
+#else
+	if (!BN_zero(count))
+		goto cmb_count_bn_return;
+#endif
+
+	/* If entire set is requested, return 2^N[-1] */
+	if ((setinit == 1 && setdone == nitems) ||
+	    (setinit == nitems && setdone == 1)) {
+		if (show_empty) {
+			BN_lshift(count, BN_value_one(), (int)nitems);
+			goto cmb_count_bn_return;
+		} else {
+			if (BN_lshift(count, BN_value_one(), (int)nitems))
+				BN_sub_word(count, 1);
+			goto cmb_count_bn_return;
+		}
+	}
+
+	/* Allocate memory */
+	if ((ncombos = BN_new()) == NULL)
+		goto cmb_count_bn_return;
+	if (!BN_one(ncombos))
+		goto cmb_count_bn_return;
+
+	/*
+	 * Loop over each `set' in the configured direction until we are done
+	 */
+	p = nextset > 0 ? setinit - 1 : setinit;
+	for (k = 1; k <= p; k++) {
+		if (!BN_mul_word(ncombos, i--))
+			goto cmb_count_bn_return;
+		if (BN_div_word(ncombos, k) == (BN_ULONG)-1)
+			goto cmb_count_bn_return;
+	}
+	for (curset = setinit;
+	    nextset > 0 ? curset <= setdone : curset >= setdone;
+	    curset += (uint32_t)nextset)
+	{
+		/* Calculate number of combinations (incrementing) */
+		if (nextset > 0) {
+			if (!BN_mul_word(ncombos, i--))
+				break;
+			if (BN_div_word(ncombos, k++) == (BN_ULONG)-1)
+				break;
+		}
+
+		/* Add number of combinations in this set to total */
+		if (!BN_add(count, count, ncombos))
+			break;
+
+		/* Calculate number of combinations (decrementing) */
+		if (nextset < 0) {
+			if (!BN_mul_word(ncombos, --k))
+				break;
+			if (BN_div_word(ncombos, ++i) == (BN_ULONG)-1)
+				break;
+		}
+	}
+
+cmb_count_bn_return:
+	BN_free(ncombos);
+
+	return (count);
+}
+
+/*
+ * Takes n and k. Returns the exact binomial coefficient C(n,k) as a newly
+ * allocated openssl bn(3) BIGNUM, or NULL on error.
+ */
+static BIGNUM *
+cmb_binomial_bn(uint32_t n, uint32_t k)
+{
+	uint32_t i;
+	BIGNUM *b;
+
+	cmb_count_t v = 1;
+
+	if ((b = BN_new()) == NULL)
+		return (NULL);
+	if (k > n) {
+		if (!BN_set_word(b, 0))
+			goto cmb_binomial_bn_error;
+		return (b);
+	}
+	if (k > n - k)
+		k = n - k;
+
+	/* Calculate natively until the coefficient no longer fits */
+	for (i = 1; i <= k; i++) {
+		if ((v = cmb_count_muldiv(v, n - k + i, i)) == 0)
+			break;
+	}
+	if (i > k) {
+		if (!cmb_count_to_bn(b, v))
+			goto cmb_binomial_bn_error;
+		return (b);
+	}
+	errno = 0;
+
+	if (!BN_one(b))
+		goto cmb_binomial_bn_error;
+	for (i = 1; i <= k; i++) {
+		if (!BN_mul_word(b, n - k + i))
+			goto cmb_binomial_bn_error;
+		if (BN_div_word(b, i) == (BN_ULONG)-1)
+			goto cmb_binomial_bn_error;
+	}
+	return (b);
+
+cmb_binomial_bn_error:
+	BN_free(b);
+	return (NULL);
+}
+
+/*
+ * Takes BIGNUM binomial coefficient (modified), multiplier, and divisor.
+ * Replaces b with (b * x) / y where the result is known to be an integer.
+ * Returns zero on error, non-zero on success.
+ */
+static inline int
+cmb_muldiv_bn(BIGNUM *b, uint32_t x, uint32_t y)
+{
+	if (!BN_mul_word(b, x))
+		return (FALSE);
+	return (BN_div_word(b, y) != (BN_ULONG)-1);
+}
+
+/*
+ * Takes number of items, number of items in the set, zero-based rank of a
+ * combination within that set (destroyed), and array to be populated with
+ * positional arguments. Same as cmb_unrank_revdoor() but for sets whose size
+ * is not bounded by 64 bits. Returns zero on error, non-zero on success.
+ */
+static int
+cmb_unrank_revdoor_bn(uint32_t nitems, uint32_t setsize, BIGNUM *rank,
+    uint32_t setnums[])
+{
+	int retval = FALSE;
+	uint32_t m = nitems;
+	uint32_t t = setsize;
+	BIGNUM *b0 = NULL;
+	BIGNUM *b1 = NULL;
+
+	if (t == 0)
+		return (TRUE);
+
+	if ((b1 = cmb_binomial_bn(m - 1, t)) == NULL)
+		goto cmb_unrank_revdoor_bn_return;
+	if ((b0 = cmb_binomial_bn(m - 1, t - 1)) == NULL)
+		goto cmb_unrank_revdoor_bn_return;
+	while (t > 0 && t < m) {
+		if (BN_ucmp(rank, b1) < 0) {
+			if (!cmb_muldiv_bn(b1, m - 1 - t, m - 1))
+				goto cmb_unrank_revdoor_bn_return;
+			if (!cmb_muldiv_bn(b0, m - t, m - 1))
+				goto cmb_unrank_revdoor_bn_return;
+		} else {
+			setnums[t - 1] = m - 1;
+			if (!BN_sub(rank, rank, b1))
+				goto cmb_unrank_revdoor_bn_return;
+			if (!BN_sub(rank, b0, rank))
+				goto cmb_unrank_revdoor_bn_return;
+			if (!BN_sub_word(rank, 1))
+				goto cmb_unrank_revdoor_bn_return;
+			if (BN_copy(b1, b0) == NULL)
+				goto cmb_unrank_revdoor_bn_return;
+			if (!cmb_muldiv_bn(b1, m - t, m - 1))
+				goto cmb_unrank_revdoor_bn_return;
+			if (!cmb_muldiv_bn(b0, t - 1, m - 1))
+				goto cmb_unrank_revdoor_bn_return;
+			t--;
+		}
+		m--;
+	}
+	for (; t > 0; t--)
+		setnums[t - 1] = t - 1;
+	retval = TRUE;
+
+cmb_unrank_revdoor_bn_return:
+	BN_free(b0);
+	BN_free(b1);
+	return (retval);
+}
+
+/*
+ * Takes number of items, number of items in the set, array of positional
+ * arguments, and BIGNUM to add the zero-based rank of the combination to.
+ * Same as cmb_rank_revdoor() but for sets whose size is not bounded by 64
+ * bits. Returns zero on error, non-zero on success.
+ */
+static int
+cmb_rank_revdoor_bn(uint32_t nitems, uint32_t setsize, uint32_t setnums[],
+    BIGNUM *rank)
+{
+	uint8_t reverse = FALSE;
+	int retval = FALSE;
+	uint32_t m = nitems;
+	uint32_t t = setsize;
+	BIGNUM *b0 = NULL;
+	BIGNUM *b1 = NULL;
+	BIGNUM *r = NULL;
+
+	if (t == 0)
+		return (TRUE);
+
+	if ((b1 = cmb_binomial_bn(m - 1, t)) == NULL)
+		goto cmb_rank_revdoor_bn_return;
+	if ((b0 = cmb_binomial_bn(m - 1, t - 1)) == NULL)
+		goto cmb_rank_revdoor_bn_return;
+	if ((r = BN_new()) == NULL)
+		goto cmb_rank_revdoor_bn_return;
+	while (t > 0 && t < m) {
+		if (setnums[t - 1] != m - 1) {
+			if (!cmb_muldiv_bn(b1, m - 1 - t, m - 1))
+				goto cmb_rank_revdoor_bn_return;
+			if (!cmb_muldiv_bn(b0, m - t, m - 1))
+				goto cmb_rank_revdoor_bn_return;
+		} else {
+			if (!BN_add(r, b1, b0) || !BN_sub_word(r, 1))
+				goto cmb_rank_revdoor_bn_return;
+			if (!(reverse ? BN_sub(rank, rank, r) :
+			    BN_add(rank, rank, r)))
+				goto cmb_rank_revdoor_bn_return;
+			reverse = !reverse;
+			if (BN_copy(b1, b0) == NULL)
+				goto cmb_rank_revdoor_bn_return;
+			if (!cmb_muldiv_bn(b1, m - t, m - 1))
+				goto cmb_rank_revdoor_bn_return;
+			if (!cmb_muldiv_bn(b0, t - 1, m - 1))
+				goto cmb_rank_revdoor_bn_return;
+			t--;
+		}
+		m--;
+	}
+	retval = TRUE;
+
+cmb_rank_revdoor_bn_return:
+	BN_free(b0);
+	BN_free(b1);
+	BN_free(r);
+	return (retval);
+}
+
+/*
+ * Takes enumeration order (CMB_ORDER_*), number of items, number of items in
+ * the set, zero-based rank of a combination within that set (destroyed), and
+ * array to be populated with positional arguments. Same as cmb_unrank_set()
+ * but for sets whose size is not bounded by 64 bits. Returns zero on error,
+ * non-zero on success.
+ */
+static int
+cmb_unrank_set_bn(uint8_t order, uint32_t nitems, uint32_t setsize,
+    BIGNUM *rank, uint32_t setnums[])
+{
+	int retval = FALSE;
+	uint32_t c = 0;
+	uint32_t j;
+	uint32_t m;
+	uint32_t n;
+	BIGNUM *b;
+
+	if (order == CMB_ORDER_REVDOOR)
+		return (cmb_unrank_revdoor_bn(nitems, setsize, rank, setnums));
+	if (setsize == 0)
+		return (TRUE);
+
+	if ((b = cmb_binomial_bn(nitems - 1, setsize - 1)) == NULL)
+		return (FALSE);
+	for (n = 0; n < setsize; n++) {
+		j = setsize - 1 - n;
+		while (BN_ucmp(rank, b) >= 0) {
+			if (!BN_sub(rank, rank, b))
+				goto cmb_unrank_set_bn_return;
+			m = nitems - 1 - c++;
+			if (!BN_mul_word(b, m - j))
+				goto cmb_unrank_set_bn_return;
+			if (BN_div_word(b, m) == (BN_ULONG)-1)
+				goto cmb_unrank_set_bn_return;
+		}
+		setnums[n] = c;
+		if (j > 0) {
+			m = nitems - 1 - c;
+			if (!BN_mul_word(b, j))
+				goto cmb_unrank_set_bn_return;
+			if (BN_div_word(b, m) == (BN_ULONG)-1)
+				goto cmb_unrank_set_bn_return;
+		}
+		c++;
+	}
+	retval = TRUE;
+
+cmb_unrank_set_bn_return:
+	BN_free(b);
+	return (retval);
+}
+
+/*
+ * Takes enumeration order (CMB_ORDER_*), number of items, number of items in
+ * the set, array of positional arguments, and BIGNUM to add the zero-based
+ * rank of the combination to. Same as cmb_rank_set() but for sets whose size
+ * is not bounded by 64 bits. Returns zero on error, non-zero on success.
+ */
+static int
+cmb_rank_set_bn(uint8_t order, uint32_t nitems, uint32_t setsize,
+    uint32_t setnums[], BIGNUM *rank)
+{
+	int retval = FALSE;
+	uint32_t c = 0;
+	uint32_t j;
+	uint32_t m;
+	uint32_t n;
+	BIGNUM *b;
+
+	if (order == CMB_ORDER_REVDOOR)
+		return (cmb_rank_revdoor_bn(nitems, setsize, setnums, rank));
+	if (setsize == 0)
+		return (TRUE);
+
+	if ((b = cmb_binomial_bn(nitems - 1, setsize - 1)) == NULL)
+		return (FALSE);
+	for (n = 0; n < setsize; n++) {
+		j = setsize - 1 - n;
+		while (c < setnums[n]) {
+			if (!BN_add(rank, rank, b))
+				goto cmb_rank_set_bn_return;
+			m = nitems - 1 - c++;
+			if (!BN_mul_word(b, m - j))
+				goto cmb_rank_set_bn_return;
+			if (BN_div_word(b, m) == (BN_ULONG)-1)
+				goto cmb_rank_set_bn_return;
+		}
+		if (j > 0) {
+			m = nitems - 1 - c;
+			if (!BN_mul_word(b, j))
+				goto cmb_rank_set_bn_return;
+			if (BN_div_word(b, m) == (BN_ULONG)-1)
+				goto cmb_rank_set_bn_return;
+		}
+		c++;
+	}
+	retval = TRUE;
+
+cmb_rank_set_bn_return:
+	BN_free(b);
+	return (retval);
+}
+
+/*
+ * Takes pointer to `struct cmb_config' options, number of items, sequence
+ * number (as passed to action_bn() by cmb_bn()), pointer to uint32_t
+ * (written-to, containing number of items in the combination), and array of
+ * at least size_max (or nitems) uint32_t to be populated with the positional
+ * arguments of the combination. Returns zero on success, otherwise an errno
+ * value (EINVAL if seq is out of range; ENOMEM on bn(3) failure).
+ */
+int
+cmb_unrank_bn(struct cmb_config *config, uint32_t nitems, BIGNUM *seq,
+    uint32_t *setsize, uint32_t setnums[])
+{
+	uint8_t order = CMB_ORDER_LEX;
+	uint8_t show_empty = FALSE;
+	int8_t nextset = 1;
+	int retval = EINVAL;
+	uint32_t curset;
+	uint32_t setdone = nitems;
+	uint32_t setinit = 1;
 	BIGNUM *ncombos = NULL;
+	BIGNUM *rank = NULL;
 
-	if (nitems == 0)
+	errno = 0;
+	if (setsize == NULL || seq == NULL || BN_is_negative(seq) ||
+	    BN_is_zero(seq))
+		return (errno = EINVAL);
+
+	/* Process config options */
+	if (config != NULL) {
+		if ((config->options & CMB_OPT_EMPTY) != 0)
+			show_empty = TRUE;
+		order = config->order;
+		if (config->size_min != 0 || config->size_max != 0) {
+			setinit = config->size_min;
+			setdone = config->size_max;
+		}
+	}
+
+	/* Adjust values to be non-zero (mathematical constraint) */
+	if (setinit == 0)
+		setinit = 1;
+	if (setdone == 0)
+		setdone = 1;
+
+	/* Enforce limits so we don't run over bounds */
+	if (setinit > nitems)
+		setinit = nitems;
+	if (setdone > nitems)
+		setdone = nitems;
+
+	/* Set the direction of flow (incrementing vs. decrementing) */
+	if (setinit > setdone)
+		nextset = -1;
+
+	/* Work with a zero-based rank */
+	if ((rank = BN_dup(seq)) == NULL || !BN_sub_word(rank, 1)) {
+		retval = ENOMEM;
+		goto cmb_unrank_bn_return;
+	}
+
+	/* The empty set is first when incrementing */
+	if (nextset > 0 && show_empty) {
+		if (BN_is_zero(rank)) {
+			*setsize = 0;
+			retval = 0;
+			goto cmb_unrank_bn_return;
+		}
+		if (!BN_sub_word(rank, 1)) {
+			retval = ENOMEM;
+			goto cmb_unrank_bn_return;
+		}
+	}
+
+	/* Find the set containing seq and unrank within it */
+	for (curset = setinit; nitems > 0 &&
+	    (nextset > 0 ? curset <= setdone : curset >= setdone);
+	    curset += (uint32_t)nextset)
+	{
+		BN_free(ncombos);
+		if ((ncombos = cmb_binomial_bn(nitems, curset)) == NULL) {
+			retval = ENOMEM;
+			goto cmb_unrank_bn_return;
+		}
+		if (BN_ucmp(rank, ncombos) >= 0) {
+			if (!BN_sub(rank, rank, ncombos)) {
+				retval = ENOMEM;
+				goto cmb_unrank_bn_return;
+			}
+			continue;
+		}
+		if (setnums == NULL)
+			goto cmb_unrank_bn_return;
+		if (!cmb_unrank_set_bn(order, nitems, curset, rank, setnums)) {
+			retval = ENOMEM;
+			goto cmb_unrank_bn_return;
+		}
+		*setsize = curset;
+		retval = 0;
+		goto cmb_unrank_bn_return;
+	}
+
+	/* The empty set is last when decrementing */
+	if (nextset < 0 && show_empty && BN_is_zero(rank)) {
+		*setsize = 0;
+		retval = 0;
+	}
+
+cmb_unrank_bn_return:
+	BN_free(ncombos);
+	BN_free(rank);
+
+	return (errno = retval);
+}
+
+/*
+ * Takes pointer to `struct cmb_config' options, number of items, number of
+ * items in the combination, and array of positional arguments. Returns the
+ * sequence number (as passed to action_bn() by cmb_bn()) of the combination
+ * as a newly allocated openssl bn(3) BIGNUM. On error, returns NULL and sets
+ * errno (EINVAL if the combination is invalid or is not part of the
+ * configured sets).
+ */
+BIGNUM *
+cmb_rank_bn(struct cmb_config *config, uint32_t nitems, uint32_t setsize,
+    uint32_t setnums[])
+{
+	uint8_t order = CMB_ORDER_LEX;
+	uint8_t show_empty = FALSE;
+	int8_t nextset = 1;
+	uint32_t curset;
+	uint32_t setdone = nitems;
+	uint32_t setinit = 1;
+	BIGNUM *ncombos = NULL;
+	BIGNUM *seq = NULL;
+
+	errno = 0;
+	if (cmb_setnums_invalid(nitems, setsize, setnums)) {
+		errno = EINVAL;
 		return (NULL);
+	}
 
 	/* Process config options */
 	if (config != NULL) {
 		if ((config->options & CMB_OPT_EMPTY) != 0)
 			show_empty = TRUE;
+		order = config->order;
 		if (config->size_min != 0 || config->size_max != 0) {
 			setinit = config->size_min;
 			setdone = config->size_max;
 		}
 	}
 
-	/* Adjust values to be non-zero (mathematical constraint) */
-	if (setinit == 0)
-		setinit = 1;
-	if (setdone == 0)
-		setdone = 1;
+	/* Adjust values to be non-zero (mathematical constraint) */
+	if (setinit == 0)
+		setinit = 1;
+	if (setdone == 0)
+		setdone = 1;
+
+	/* Enforce limits so we don't run over bounds */
+	if (setinit > nitems)
+		setinit = nitems;
+	if (setdone > nitems)
+		setdone = nitems;
+
+	/* Set the direction of flow (incrementing vs. decrementing) */
+	if (setinit > setdone)
+		nextset = -1;
+
+	if ((seq = BN_new()) == NULL || !BN_one(seq))
+		goto cmb_rank_bn_error;
+
+	/* The empty set is first when incrementing */
+	if (nextset > 0 && show_empty) {
+		if (setsize == 0)
+			return (seq);
+		if (!BN_add_word(seq, 1))
+			goto cmb_rank_bn_error;
+	}
+
+	/* Sum the sizes of all sets preceding the one containing setnums */
+	for (curset = setinit; nitems > 0 &&
+	    (nextset > 0 ? curset <= setdone : curset >= setdone);
+	    curset += (uint32_t)nextset)
+	{
+		if (curset == setsize) {
+			if (!cmb_rank_set_bn(order, nitems, setsize, setnums, seq))
+				goto cmb_rank_bn_error;
+			BN_free(ncombos);
+			return (seq);
+		}
+		BN_free(ncombos);
+		if ((ncombos = cmb_binomial_bn(nitems, curset)) == NULL)
+			goto cmb_rank_bn_error;
+		if (!BN_add(seq, seq, ncombos))
+			goto cmb_rank_bn_error;
+	}
+
+	/* The empty set is last when decrementing */
+	if (nextset < 0 && show_empty && setsize == 0) {
+		BN_free(ncombos);
+		return (seq);
+	}
+
+	errno = EINVAL;
+
+cmb_rank_bn_error:
+	if (errno == 0)
+		errno = ENOMEM;
+	BN_free(ncombos);
+	BN_free(seq);
+	return (NULL);
+}
+
+/*
+ * Same as cmb_batch_flush() but for action_batch_bn()
+ */
+static inline int
+cmb_batch_flush_bn(struct cmb_config *config, struct cmb_batch *batch,
+    uint32_t setsize)
+{
+	uint32_t nrows = batch->nrows;
+
+	if (nrows == 0)
+		return (0);
+	batch->nrows = 0;
+
+	return (config->action_batch_bn(config, batch->seq_bn, setsize,
+	    batch->matrix, nrows));
+}
+
+/*
+ * Same as cmb_batch_add() but for action_batch_bn()
+ */
+static inline int
+cmb_batch_add_bn(struct cmb_config *config, struct cmb_batch *batch,
+    struct cmb_ctr *seq, uint32_t setsize, uint32_t setnums[])
+{
+	if (batch->nrows == 0) {
+		if (batch->seq_bn == NULL && (batch->seq_bn = BN_new()) == NULL)
+			return (errno = ENOMEM);
+		if (cmb_ctr_bn(seq) == NULL ||
+		    BN_copy(batch->seq_bn, seq->bn) == NULL)
+			return (errno = ENOMEM);
+	}
+	memcpy(&batch->matrix[(size_t)batch->nrows * setsize], setnums,
+	    sizeof(uint32_t) * setsize);
+	if (++batch->nrows < batch->size)
+		return (0);
+
+	return (cmb_batch_flush_bn(config, batch, setsize));
+}
+
+/*
+ * Takes pointer to `struct cmb_out' and hybrid sequence number of the
+ * combination about to be passed to cmb_out_put().
+ *
+ * NB: cmb_bn() numbers combinations consecutively, so only the first number
+ * is converted to decimal; the rest are incremented in place.
+ */
+static void
+cmb_out_seq_bn(struct cmb_out *out, struct cmb_ctr *seq)
+{
+	size_t len;
+	char *seq_str;
+
+	if (!out->numbers)
+		return;
+	if (!seq->big) {
+		cmb_out_seq(out, seq->n);
+		return;
+	}
+	if (out->binary) {
+		out->rankbig = TRUE;
+		return;
+	}
+	if (out->numlen != 0) {
+		cmb_out_seq(out, out->numnext);
+		return;
+	}
+
+	if ((seq_str = BN_bn2dec(seq->bn)) == NULL)
+		errx(EXIT_FAILURE, "Out of memory?!");
+	len = strlen(seq_str);
+	if (len + 1 > out->numsize) {
+		out->numsize = len + 1;
+		if ((out->num = realloc(out->num, out->numsize)) == NULL)
+			errx(EXIT_FAILURE, "Out of memory?!");
+	}
+	memcpy(out->num, seq_str, len);
+	out->numlen = len;
+	OPENSSL_free(seq_str);
+}
 
-	/* Return NULL if the request is out of range */
-	if (setinit > nitems && setdone > nitems)
-		return (NULL);
+#define CMB_KERNEL_EMIT_BN(k)                                                \
+    	if (!cmb_ctr_incr(kn->seq_bn)) {                                     \
+    		kn->done = TRUE;                                             \
+    		return (0);                                                  \
+    	}                                                                    \
+    	if (kn->doprint) {                                                   \
+    		cmb_out_seq_bn(kn->out, kn->seq_bn);                         \
+    		retval = cmb_out_put(kn->out, (k), s, changed);              \
+    	} else if (cmb_ctr_bn(kn->seq_bn) == NULL) {                         \
+    		kn->done = TRUE;                                             \
+    		return (0);                                                  \
+    	} else                                                               \
+    		retval = kn->action_bn(kn->config, kn->seq_bn->bn, (k),      \
+    		    kn->actitems);                                           \
+    	if (retval != 0)                                                     \
+    		return (retval);                                             \
+    	if (kn->docount && (!cmb_ctr_decr(kn->count_bn) ||                   \
+    	    cmb_ctr_is_zero(kn->count_bn))) {                                \
+    		kn->done = TRUE;                                             \
+    		return (0);                                                  \
+    	}
+#define CMB_KERNEL_BN(k) CMB_KERNEL_EQ(cmb_kernel_bn_##k, k, CMB_KERNEL_EMIT_BN)
 
-	/* Enforce limits so we don't run over bounds */
-	if (setinit > nitems)
-		setinit = nitems;
-	if (setdone > nitems)
-		setdone = nitems;
+CMB_KERNEL_BN(1)
+CMB_KERNEL_BN(2)
+CMB_KERNEL_BN(3)
+CMB_KERNEL_BN(4)
+CMB_KERNEL_BN(5)
+CMB_KERNEL_BN(6)
+CMB_KERNEL_BN(7)
+CMB_KERNEL_BN(8)
 
-	/* Set the direction of flow (incrementing vs decrementing) */
-	if (setinit > setdone)
-		nextset = -1;
+static int (*const cmb_kernels_bn[CMB_KERNEL_MAX + 1])(struct cmb_kernel *) = {
+	NULL, cmb_kernel_bn_1, cmb_kernel_bn_2, cmb_kernel_bn_3,
+	cmb_kernel_bn_4, cmb_kernel_bn_5, cmb_kernel_bn_6, cmb_kernel_bn_7,
+	cmb_kernel_bn_8,
+};
 
-	/* Initialize count */
-	if ((count = BN_new()) == NULL)
-		return (NULL);
-#if defined(LIBRESSL_VERSION_NUMBER) || (OPENSSL_VERSION_NUMBER >= 0x0090800fL)
-	BN_zero(count);
-#else
-	if (!BN_zero(count))
-		goto cmb_count_bn_return;
-#endif
+/*
+ * Takes pointer to `struct cmb_config' options, number of items, and BIGNUM
+ * pointers (written-to). Same as cmb_shard_span() but for the start_bn and
+ * count_bn of cmb_bn(). Returns zero on success, otherwise an errno value.
+ */
+static int
+cmb_shard_bn(struct cmb_config *config, uint32_t nitems, BIGNUM *first,
+    BIGNUM *count)
+{
+	int error = ENOMEM;
+	uint32_t i = config->shard - 1;
+	BN_ULONG r;
+	BIGNUM *total = NULL;
 
-	/* If entire set is requested, return 2^N[-1] */
-	if ((setinit == 1 && setdone == nitems) ||
-	    (setinit == nitems && setdone == 1)) {
-		if (show_empty) {
-			BN_lshift(count, BN_value_one(), (int)nitems);
-			goto cmb_count_bn_return;
-		} else {
-			if (BN_lshift(count, BN_value_one(), (int)nitems))
-				BN_sub_word(count, 1);
-			goto cmb_count_bn_return;
-		}
+	BN_zero(count);
+	if (!BN_one(first))
+		return (ENOMEM);
+	if (config->shard < 1 || config->shard > config->nshards)
+		return (EINVAL);
+	if ((total = cmb_count_bn(config, nitems)) == NULL) {
+		if (nitems != 0 || (config->options & CMB_OPT_EMPTY) == 0)
+			return (0);
+		if ((total = BN_new()) == NULL || !BN_one(total))
+			goto cmb_shard_bn_return;
 	}
-
-	/* Allocate memory */
-	if ((ncombos = BN_new()) == NULL)
-		goto cmb_count_bn_return;
-	if (!BN_one(ncombos))
-		goto cmb_count_bn_return;
-
-	/*
-	 * Loop over each `set' in the configured direction until we are done
-	 */
-	p = nextset > 0 ? setinit - 1 : setinit;
-	for (k = 1; k <= p; k++) {
-		if (!BN_mul_word(ncombos, i--))
-			goto cmb_count_bn_return;
-		if (BN_div_word(ncombos, k) == (BN_ULONG)-1)
-			goto cmb_count_bn_return;
+	if (config->start_bn != NULL && BN_cmp(config->start_bn, first) > 0 &&
+	    BN_copy(first, config->start_bn) == NULL)
+		goto cmb_shard_bn_return;
+	if (BN_cmp(first, total) > 0) {
+		error = 0;
+		goto cmb_shard_bn_return;
 	}
-	for (curset = setinit;
-	    nextset > 0 ? curset <= setdone : curset >= setdone;
-	    curset += (uint32_t)nextset)
-	{
-		/* Calculate number of combinations (incrementing) */
-		if (nextset > 0) {
-			if (!BN_mul_word(ncombos, i--))
-				break;
-			if (BN_div_word(ncombos, k++) == (BN_ULONG)-1)
-				break;
-		}
 
-		/* Add number of combinations in this set to total */
-		if (!BN_add(count, count, ncombos))
-			break;
+	/* Remaining combinations, limited to count_bn */
+	if (!BN_sub(count, total, first) || !BN_add_word(count, 1))
+		goto cmb_shard_bn_return;
+	if (config->count_bn != NULL && !BN_is_negative(config->count_bn) &&
+	    !BN_is_zero(config->count_bn) &&
+	    BN_cmp(config->count_bn, count) < 0 &&
+	    BN_copy(count, config->count_bn) == NULL)
+		goto cmb_shard_bn_return;
 
-		/* Calculate number of combinations (decrementing) */
-		if (nextset < 0) {
-			if (!BN_mul_word(ncombos, --k))
-				break;
-			if (BN_div_word(ncombos, ++i) == (BN_ULONG)-1)
-				break;
-		}
-	}
+	/* count becomes the quotient, total the offset of this shard */
+	if ((r = BN_div_word(count, config->nshards)) == (BN_ULONG)-1)
+		goto cmb_shard_bn_return;
+	if (BN_copy(total, count) == NULL || !BN_mul_word(total, i) ||
+	    !BN_add(first, first, total) ||
+	    !BN_add_word(first, i < r ? i : (uint32_t)r))
+		goto cmb_shard_bn_return;
+	if (i < r && !BN_add_word(count, 1))
+		goto cmb_shard_bn_return;
+	error = 0;
 
-cmb_count_bn_return:
-	BN_free(ncombos);
+cmb_shard_bn_return:
+	BN_free(total);
 
-	return (count);
+	return (error);
 }
 
 /*
@@ -906,47 +5667,68 @@ cmb_bn(struct cmb_config *config, uint32_t nitems, char *items[])
 #if CMB_DEBUG
 	uint8_t debug = FALSE;
 #endif
+	uint8_t dobatch = FALSE;
 	uint8_t docount = FALSE;
+	uint8_t doindices = FALSE;
+	uint8_t dokernel = FALSE;
+	uint8_t domask = FALSE;
+	uint8_t doprint = FALSE;
 	uint8_t doseek = FALSE;
+	uint8_t order = CMB_ORDER_LEX;
 	uint8_t show_empty = FALSE;
-	uint8_t show_numbers = FALSE;
+	uint8_t usemask = FALSE;
 	int8_t nextset = 1;
+	int error;
 	int retval = 0;
-	uint32_t curset;
-	uint32_t i = nitems;
-	uint32_t k;
+	uint32_t curset = 0;
 	uint32_t n;
 	uint32_t p;
-	uint32_t seed;
 	uint32_t setdone = nitems;
 	uint32_t setinit = 1;
 	uint32_t setmax;
 	uint32_t setnums_last;
-	uint32_t setpos;
-	uint32_t setpos_backend;
-	char **curitems;
+	uint64_t mask = 0;
+	cmb_count_t ndfs = 0;
+	cmb_count_t start = 1;
+	cmb_count_t z;
+	char **actitems;
+	char **curitems = NULL;
 #if CMB_DEBUG
 	char *seq_str;
 #endif
-	uint32_t *setnums;
-	uint32_t *setnums_backend;
-	BIGNUM *combo = NULL;
-	BIGNUM *count = NULL;
-	BIGNUM *ncombos = NULL;
+	uint32_t *setnums = NULL;
+	uint32_t *setnums_backend = NULL;
+	struct cmb_batch *batch = NULL;
+	struct cmb_kernel kn;
+	struct cmb_out *out = NULL;
+	struct cmb_ctr combo = { .bn = NULL };
+	struct cmb_ctr count = { .bn = NULL };
+	struct cmb_ctr ncombos = { .bn = NULL };
+	struct cmb_ctr seq = { .bn = NULL };
 	BIGNUM *seek = NULL;
-	BIGNUM *seq = NULL;
+	BIGNUM *seqbn;
+	BIGNUM *span = NULL;
 	CMB_ACTION_BN((*action_bn)) = cmb_print_bn;
 
+	/* Initialize counters (native until they overflow) */
+	if (!cmb_ctr_init(&combo) || !cmb_ctr_init(&count) ||
+	    !cmb_ctr_init(&ncombos) || !cmb_ctr_init(&seq))
+		goto cmb_bn_return;
+
 	/* Process config options */
 	if (config != NULL) {
 		if (config->action_bn != NULL)
 			action_bn = config->action_bn;
+		if (config->action_mask_bn != NULL)
+			domask = TRUE;
+		else if (config->action_batch_bn != NULL)
+			dobatch = TRUE;
 		if (config->count_bn != NULL &&
 		    !BN_is_negative(config->count_bn) &&
 		    !BN_is_zero(config->count_bn))
 		{
 			docount = TRUE;
-			if ((count = BN_dup(config->count_bn)) == NULL)
+			if (!cmb_ctr_set(&count, config->count_bn))
 				goto cmb_bn_return;
 		}
 		if ((config->options & CMB_OPT_DEBUG) != 0) {
@@ -958,8 +5740,15 @@ cmb_bn(struct cmb_config *config, uint32_t nitems, char *items[])
 		}
 		if ((config->options & CMB_OPT_EMPTY) != 0)
 			show_empty = TRUE;
-		if ((config->options & CMB_OPT_NUMBERS) != 0)
-			show_numbers = TRUE;
+		if (config->order == CMB_ORDER_REVDOOR) {
+			order = CMB_ORDER_REVDOOR;
+			config->left = config->entered = UINT32_MAX;
+		}
+		if ((config->options & CMB_OPT_INDICES) != 0) {
+			doindices = TRUE;
+			config->indices = NULL;
+			config->changed = 0;
+		}
 		if (config->size_min != 0 || config->size_max != 0) {
 			setinit = config->size_min;
 			setdone = config->size_max;
@@ -972,22 +5761,49 @@ cmb_bn(struct cmb_config *config, uint32_t nitems, char *items[])
 			doseek = TRUE;
 			if ((seek = BN_dup(config->start_bn)) == NULL)
 				goto cmb_bn_return;
-#if CMB_DEBUG
-			if (show_numbers || debug) {
-#else
-			if (show_numbers) {
-#endif
-				if ((seq = BN_dup(seek)) == NULL)
-					goto cmb_bn_return;
-				if (!BN_sub_word(seq, 1))
-					goto cmb_bn_return;
-			}
+			if (!cmb_ctr_set(&seq, seek) || !cmb_ctr_decr(&seq))
+				goto cmb_bn_return;
 		}
 	}
 
+	/* Combinations as bitmasks are limited to 64 items */
+	if (domask && nitems > 64) {
+		retval = errno = EINVAL;
+		goto cmb_bn_return;
+	}
+	usemask = nitems <= 64 && (domask || order == CMB_ORDER_LEX);
+
 	if (nitems == 0 && !show_empty)
 		goto cmb_bn_return;
 
+	/* Narrow the range to the requested shard */
+	if (config != NULL && config->nshards > 1) {
+		if ((seek == NULL && (seek = BN_new()) == NULL) ||
+		    (span = BN_new()) == NULL)
+			goto cmb_bn_return;
+		if ((error = cmb_shard_bn(config, nitems, seek, span)) != 0) {
+			retval = errno = error;
+			goto cmb_bn_return;
+		}
+		if (BN_is_zero(span))
+			goto cmb_bn_return;
+		docount = TRUE;
+		doseek = !BN_is_one(seek);
+		if (!cmb_ctr_set(&count, span) || !cmb_ctr_set(&seq, seek) ||
+		    !cmb_ctr_decr(&seq))
+			goto cmb_bn_return;
+	}
+
+	/* Depth-first, skipping prefixes rejected by bound() */
+	if (config != NULL && config->bound != NULL) {
+		if (doseek && !cmb_bn_get_count(seek, &start))
+			goto cmb_bn_return; /* past the last combination */
+		if (docount && !cmb_bn_get_count(cmb_ctr_bn(&count), &ndfs))
+			ndfs = 0; /* all remaining */
+		retval = cmb_dfs(config, nitems, items, start, ndfs, TRUE);
+		goto cmb_bn_return;
+	}
+
 	/* Adjust values to be non-zero (mathematical constraint) */
 	if (setinit == 0)
 		setinit = 1;
@@ -1004,16 +5820,12 @@ cmb_bn(struct cmb_config *config, uint32_t nitems, char *items[])
 	if (setinit > setdone)
 		nextset = -1;
 
-	/* Initialize sequence number */
-	if (seq == NULL) {
-		if ((seq = BN_new()) == NULL)
-			goto cmb_bn_return;
-#if defined(LIBRESSL_VERSION_NUMBER) || (OPENSSL_VERSION_NUMBER >= 0x0090800fL)
-		BN_zero(seq);
-#else
-		if (!BN_zero(seq))
-			goto cmb_bn_return;
-#endif
+	/* Assemble output directly instead of calling cmb_print_bn() */
+	setmax = setdone > setinit ? setdone : setinit;
+	if (action_bn == cmb_print_bn && !dobatch && !domask) {
+		doprint = TRUE;
+		out = cmb_out_alloc(config, nitems, items,
+		    MIN(setinit, setdone), setmax);
 	}
 
 	/* Show the empty set consisting of a single combination of no-items */
@@ -1023,15 +5835,27 @@ cmb_bn(struct cmb_config *config, uint32_t nitems, char *items[])
 			cmb_debug(">>> 0-item combinations <<<");
 #endif
 		if (!doseek) {
-			if (!BN_add_word(seq, 1))
+			if (!cmb_ctr_incr(&seq))
 				goto cmb_bn_return;
-			retval = action_bn(config, seq, 0, NULL);
+			if (doprint) {
+				cmb_out_seq_bn(out, &seq);
+				retval = cmb_out_put(out, 0, NULL, 0);
+			} else if ((seqbn = cmb_ctr_bn(&seq)) == NULL)
+				goto cmb_bn_return;
+			else if (domask)
+				retval = config->action_mask_bn(config, seqbn,
+				    0, 0);
+			else if (dobatch)
+				retval = config->action_batch_bn(config, seqbn,
+				    0, NULL, 1);
+			else
+				retval = action_bn(config, seqbn, 0, NULL);
 			if (retval != 0)
 				goto cmb_bn_return;
 			if (docount) {
-				if (!BN_sub_word(count, 1))
+				if (!cmb_ctr_decr(&count))
 					goto cmb_bn_return;
-				if (BN_is_zero(count))
+				if (cmb_ctr_is_zero(&count))
 					goto cmb_bn_return;
 			}
 		} else {
@@ -1046,13 +5870,8 @@ cmb_bn(struct cmb_config *config, uint32_t nitems, char *items[])
 		goto cmb_bn_return;
 
 	/* Allocate memory */
-	if ((combo = BN_new()) == NULL)
-		goto cmb_bn_return;
-	if ((ncombos = BN_new()) == NULL)
-		goto cmb_bn_return;
-	if (!BN_one(ncombos))
-		goto cmb_bn_return;
-	setmax = setdone > setinit ? setdone : setinit;
+	if (dobatch)
+		batch = cmb_batch_alloc(config, setmax);
 	if ((curitems = (char **)malloc(sizeof(char *) * setmax)) == NULL)
 		errx(EXIT_FAILURE, "Out of memory?!");
 	if ((setnums = (uint32_t *)malloc(sizeof(uint32_t) * setmax)) == NULL)
@@ -1060,18 +5879,37 @@ cmb_bn(struct cmb_config *config, uint32_t nitems, char *items[])
 	if ((setnums_backend =
 	    (uint32_t *)malloc(sizeof(uint32_t) * setmax)) == NULL)
 		errx(EXIT_FAILURE, "Out of memory?!");
+	if (doindices)
+		config->indices = setnums;
+	actitems = doindices ? items : curitems;
+
+	/* Nested loops for small sets in lexicographic order */
+	dokernel = order == CMB_ORDER_LEX && !dobatch && !domask;
+#if CMB_DEBUG
+	if (debug)
+		dokernel = FALSE;
+#endif
+	if (dokernel) {
+		bzero(&kn, sizeof(kn));
+		kn.docount = docount;
+		kn.doindices = doindices;
+		kn.doprint = doprint;
+		kn.nitems = nitems;
+		kn.setnums = setnums;
+		kn.actitems = actitems;
+		kn.curitems = curitems;
+		kn.items = items;
+		kn.config = config;
+		kn.out = out;
+		kn.count_bn = &count;
+		kn.seq_bn = &seq;
+		kn.action_bn = action_bn;
+	}
 
 	/*
 	 * Loop over each `set' in the configured direction until we are done.
 	 * NB: Each `set' can represent a single item or multiple items.
 	 */
-	p = nextset > 0 ? setinit - 1 : setinit;
-	for (k = 1; k <= p; k++) {
-		if (!BN_mul_word(ncombos, i--))
-			goto cmb_bn_return;
-		if (BN_div_word(ncombos, k) == (BN_ULONG)-1)
-			goto cmb_bn_return;
-	}
 	for (curset = setinit;
 	    nextset > 0 ? curset <= setdone : curset >= setdone;
 	    curset += (uint32_t)nextset)
@@ -1081,148 +5919,153 @@ cmb_bn(struct cmb_config *config, uint32_t nitems, char *items[])
 			cmb_debug(">>> %u-item combinations <<<", curset);
 #endif
 
-		/* Calculate number of combinations (incrementing) */
-		if (nextset > 0) {
-			if (!BN_mul_word(ncombos, i--))
+		/* Calculate number of combinations in set (exactly) */
+		if ((z = cmb_pascal(nitems, curset)) != 0 && z <= UINT64_MAX) {
+			ncombos.big = FALSE;
+			ncombos.n = (uint64_t)z;
+		} else if (z != 0) {
+			ncombos.big = TRUE;
+			if (!cmb_count_to_bn(ncombos.bn, z))
 				break;
-			if (BN_div_word(ncombos, k++) == (BN_ULONG)-1)
+		} else {
+			errno = 0;
+			ncombos.big = TRUE;
+			BN_free(ncombos.bn);
+			if ((ncombos.bn = cmb_binomial_bn(nitems, curset)) ==
+			    NULL)
 				break;
 		}
 
 		/* Jump to next set if requested start is beyond this one */
+		if (doseek && BN_ucmp(seek, cmb_ctr_bn(&ncombos)) > 0) {
+			if (!BN_sub(seek, seek, ncombos.bn))
+				break;
+			continue;
+		}
+
+		/*
+		 * Prefill two arrays used for matrix calculations.
+		 *
+		 * The first array (setnums) is a linear sequence starting at
+		 * one (1) and ending at N (where N is the same integer as the
+		 * current set we're operating on). For example, if we are
+		 * currently on a set-of-2, setnums is 1, 2. If seeking, the
+		 * starting combination is instead unranked directly into
+		 * setnums (see cmb_unrank_set_bn()).
+		 *
+		 * The second array (setnums_backend) is a linear sequence
+		 * starting at nitems-N and ending at nitems (again, N is the
+		 * same integer as the current set we are operating on; nitems
+		 * is the total number of items). For example, if we are
+		 * operating on a set-of-2, and nitems is 8, setnums_backend is
+		 * set to 7, 8.
+		 */
 		if (doseek) {
-			if (BN_ucmp(seek, ncombos) > 0) {
-				if (!BN_sub(seek, seek, ncombos))
-					break;
-				if (nextset < 0) {
-					if (!BN_mul_word(ncombos, --k))
-						break;
-					if (BN_div_word(ncombos, ++i) ==
-					    (BN_ULONG)-1)
-						break;
-				}
-				continue;
-			} else if (BN_is_one(seek)) {
-				doseek = FALSE;
-			}
+			if (!BN_sub_word(seek, 1))
+				break;
+			if (!cmb_ctr_set(&combo, seek))
+				break;
+			if (!cmb_unrank_set_bn(order, nitems, curset, seek,
+			    setnums))
+				break;
+			doseek = FALSE;
+		} else {
+			combo.big = FALSE;
+			combo.n = 0;
+			for (n = 0; n < curset; n++)
+				setnums[n] = n;
 		}
+		p = 0;
+		for (n = curset; n > 0; n--)
+			setnums_backend[p++] = nitems - n;
 
-		/* Fill array with the initial positional arguments */
+		/* Map the initial positional arguments into curitems */
 #if CMB_DEBUG
 		if (debug)
 			fprintf(stderr, CMB_DEBUG_PREFIX "setnums=[");
 #endif
+		mask = 0;
 		for (n = 0; n < curset; n++) {
 #if CMB_DEBUG
 			if (debug) {
 				if (n == curset - 1)
-					fprintf(stderr, "\033[31m%u\033[m", n);
+					fprintf(stderr, "\033[31m%u\033[m",
+					    setnums[n]);
 				else
-					fprintf(stderr, "%u", n);
+					fprintf(stderr, "%u", setnums[n]);
 				if (n + 1 < curset)
 					fprintf(stderr, ",");
 			}
 #endif
-			curitems[n] = items[n];
+			if (usemask)
+				mask |= (uint64_t)1 << setnums[n];
+			if (!dobatch && !doindices && !domask && !doprint)
+				curitems[n] = items[setnums[n]];
 		}
 #if CMB_DEBUG
 		if (debug) {
-			seq_str = BN_bn2dec(seq);
+			seq_str = BN_bn2dec(cmb_ctr_bn(&seq));
 			fprintf(stderr, "] seq=%s\n", seq_str);
 			OPENSSL_free(seq_str);
 		}
 #endif
 
 		/* Produce results with the first set of items */
-		if (!doseek) {
-			if (!BN_add_word(seq, 1))
-				goto cmb_bn_return;
-			retval = action_bn(config, seq, curset, curitems);
-			if (retval != 0)
+		if (order == CMB_ORDER_REVDOOR)
+			config->left = config->entered = UINT32_MAX;
+		if (!cmb_ctr_incr(&seq))
+			goto cmb_bn_return;
+		if (dobatch)
+			retval = cmb_batch_add_bn(config, batch, &seq, curset,
+			    setnums);
+		else if (doprint) {
+			cmb_out_seq_bn(out, &seq);
+			retval = cmb_out_put(out, curset, setnums, 0);
+		} else if ((seqbn = cmb_ctr_bn(&seq)) == NULL)
+			goto cmb_bn_return;
+		else if (domask)
+			retval = config->action_mask_bn(config, seqbn, curset,
+			    mask);
+		else {
+			if (doindices)
+				config->changed = 0;
+			retval = action_bn(config, seqbn, curset, actitems);
+		}
+		if (retval != 0)
+			break;
+		if (docount) {
+			if (!cmb_ctr_decr(&count))
+				break;
+			if (cmb_ctr_is_zero(&count))
 				break;
-			if (docount) {
-				if (!BN_sub_word(count, 1))
-					break;
-				if (BN_is_zero(count))
-					break;
-			}
 		}
 
-		/*
-		 * Prefill two arrays used for matrix calculations.
-		 *
-		 * The first array (setnums) is a linear sequence starting at
-		 * one (1) and ending at N (where N is the same integer as the
-		 * current set we're operating on). For example, if we are
-		 * currently on a set-of-2, setnums is 1, 2.
-		 *
-		 * The second array (setnums_backend) is a linear sequence
-		 * starting at nitems-N and ending at nitems (again, N is the
-		 * same integer as the current set we are operating on; nitems
-		 * is the total number of items). For example, if we are
-		 * operating on a set-of-2, and nitems is 8, setnums_backend is
-		 * set to 7, 8.
-		 */
-		p = 0;
-		for (n = 0; n < curset; n++)
-			setnums[n] = n;
-		for (n = curset; n > 0; n--)
-			setnums_backend[p++] = nitems - n;
+		/* Remaining combinations by kernel (see CMB_KERNEL) */
+		if (dokernel && curset <= CMB_KERNEL_MAX) {
+			retval = cmb_kernels_bn[curset](&kn);
+			if (retval != 0 || kn.done)
+				goto cmb_bn_return;
+			continue;
+		}
 
 		/*
 		 * Process remaining self-similar combinations in the set.
 		 */
-		if (!BN_one(combo))
+		if (!cmb_ctr_incr(&combo))
 			break;
-		for (; BN_ucmp(combo, ncombos) < 0; ) {
-			setnums_last = curset;
-
-			/*
-			 * Using self-similarity (matrix) theorem, determine
-			 * (by comparing the [sliding] setnums to the stored
-			 * setnums_backend) the number of arguments that remain
-			 * available for shifting into a new setnums value
-			 * (for later mapping into curitems).
-			 *
-			 * In essence, determine when setnums has slid into
-			 * setnums_backend in which case we can mathematically
-			 * use the last item to find the next-new item.
-			 */
-			for (n = curset; n > 0; n--) {
-				setpos = setnums[n - 1];
-				setpos_backend = setnums_backend[n - 1];
-				/*
-				 * If setpos is equal to or greater than
-				 * setpos_backend then we keep iterating over
-				 * the current set's list of argument positions
-				 * until otherwise; each time incrementing the
-				 * amount of numbers we must produce from
-				 * formulae rather than stored position.
-				 */
-				setnums_last = n - 1;
-				if (setpos < setpos_backend)
-					break;
-			}
-
-			/*
-			 * The next few stanzas are dedicated to rebuilding the
-			 * setnums array for mapping positional items
-			 * [immediately following] into curitems.
-			 */
-
-			/*
-			 * Get the generator number used to populate unknown
-			 * positions in the matrix (using self-similarity).
-			 */
-			seed = setnums[setnums_last];
-
-			/*
-			 * Use the generator number to populate any position
-			 * numbers that weren't carried over from previous
-			 * combination run -- using self-similarity theorem.
-			 */
-			for (n = setnums_last; n <= curset; n++)
-				setnums[n] = seed + n - setnums_last + 1;
+		while (cmb_ctr_lt(&combo, &ncombos)) {
+			if (order == CMB_ORDER_REVDOOR) {
+				setnums_last = cmb_next_revdoor(nitems, curset,
+				    setnums, &config->left, &config->entered);
+				if (usemask)
+					mask ^= (uint64_t)1 << config->left |
+					    (uint64_t)1 << config->entered;
+			} else if (usemask)
+				setnums_last = cmb_next_mask(nitems, curset,
+				    &mask, setnums);
+			else
+				setnums_last = cmb_next_lex(curset, setnums,
+				    setnums_backend);
 #if CMB_DEBUG
 			if (debug) {
 				fprintf(stderr, CMB_DEBUG_PREFIX "setnums=[");
@@ -1238,70 +6081,102 @@ cmb_bn(struct cmb_config *config, uint32_t nitems, char *items[])
 					if (n + 1 < curset)
 						fprintf(stderr, ",");
 				}
-				seq_str = BN_bn2dec(seq);
+				seq_str = BN_bn2dec(cmb_ctr_bn(&seq));
 				fprintf(stderr, "] seq=%s\n", seq_str);
 				OPENSSL_free(seq_str);
 			}
 #endif
 
 			/* Now map new setnums into values stored in items */
-			for (n = 0; n < curset; n++)
-				curitems[n] = items[setnums[n]];
+			if (doindices)
+				config->changed = setnums_last;
+			else if (!dobatch && !domask && !doprint) {
+				for (n = setnums_last; n < curset; n++)
+					curitems[n] = items[setnums[n]];
+			}
 
 			/* Produce results with this set of items */
-			if (doseek) {
-				if (!BN_sub_word(seek, 1))
-					goto cmb_bn_return;
-				if (BN_is_one(seek))
-					doseek = FALSE;
-			}
-			if (!doseek || BN_is_one(seek)) {
-				doseek = FALSE;
-				if (!BN_add_word(seq, 1))
+			if (!cmb_ctr_incr(&seq))
+				goto cmb_bn_return;
+			if (dobatch)
+				retval = cmb_batch_add_bn(config, batch, &seq,
+				    curset, setnums);
+			else if (doprint) {
+				cmb_out_seq_bn(out, &seq);
+				retval = cmb_out_put(out, curset, setnums,
+				    setnums_last);
+			} else if ((seqbn = cmb_ctr_bn(&seq)) == NULL)
+				goto cmb_bn_return;
+			else if (domask)
+				retval = config->action_mask_bn(config, seqbn,
+				    curset, mask);
+			else
+				retval = action_bn(config, seqbn, curset,
+				    actitems);
+			if (retval != 0)
+				goto cmb_bn_return;
+			if (docount) {
+				if (!cmb_ctr_decr(&count))
 					goto cmb_bn_return;
-				retval = action_bn(config, seq, curset,
-				    curitems);
-				if (retval != 0)
+				if (cmb_ctr_is_zero(&count))
 					goto cmb_bn_return;
-				if (docount) {
-					if (!BN_sub_word(count, 1))
-						goto cmb_bn_return;
-					if (BN_is_zero(count))
-						goto cmb_bn_return;
-				}
 			}
 
-			if (!BN_add_word(combo, 1))
+			if (!cmb_ctr_incr(&combo))
 				goto cmb_bn_return;
 
 		} /* for combo */
 
-		/* Calculate number of combinations (decrementing) */
-		if (nextset < 0) {
-			if (!BN_mul_word(ncombos, --k))
-				break;
-			if (BN_div_word(ncombos, ++i) == (BN_ULONG)-1)
-				break;
-		}
+		/* Rows passed to action_batch_bn() must all be the same size */
+		if (dobatch && (retval = cmb_batch_flush_bn(config, batch,
+		    curset)) != 0)
+			goto cmb_bn_return;
 
 	} /* for curset */
 
 	/* Show the empty set consisting of a single combination of no-items */
 	if (nextset < 0 && show_empty) {
 		if ((!doseek || BN_is_one(seek)) &&
-		    (!docount || !BN_is_zero(count))) {
-			if (!BN_add_word(seq, 1))
+		    (!docount || !cmb_ctr_is_zero(&count))) {
+			if (!cmb_ctr_incr(&seq))
+				goto cmb_bn_return;
+			if (doindices) {
+				config->indices = NULL;
+				config->changed = 0;
+			}
+			if (doprint) {
+				cmb_out_seq_bn(out, &seq);
+				retval = cmb_out_put(out, 0, NULL, 0);
+			} else if ((seqbn = cmb_ctr_bn(&seq)) == NULL)
 				goto cmb_bn_return;
-			retval = action_bn(config, seq, 0, NULL);
+			else if (domask)
+				retval = config->action_mask_bn(config, seqbn,
+				    0, 0);
+			else if (dobatch)
+				retval = config->action_batch_bn(config, seqbn,
+				    0, NULL, 1);
+			else
+				retval = action_bn(config, seqbn, 0, NULL);
 		}
 	}
 
 cmb_bn_return:
-	BN_free(combo);
-	BN_free(count);
-	BN_free(ncombos);
+	if (dobatch && retval == 0 && batch != NULL)
+		retval = cmb_batch_flush_bn(config, batch, curset);
+	if (doprint && (error = cmb_out_close(out)) != 0 &&
+	    retval == 0)
+		retval = error;
+	cmb_batch_free(batch);
+	cmb_out_free(out);
+	free(curitems);
+	free(setnums);
+	free(setnums_backend);
+	BN_free(combo.bn);
+	BN_free(count.bn);
+	BN_free(ncombos.bn);
 	BN_free(seek);
-	BN_free(seq);
+	BN_free(seq.bn);
+	BN_free(span);
 
 	return (retval);
 }
@@ -1311,10 +6186,14 @@ CMB_ACTION_BN(cmb_print_bn)
 	uint8_t nul = FALSE;
 	uint8_t show_numbers = FALSE;
 	uint32_t n;
+	size_t len;
+	uint64_t seq64;
+	char buf[21];
 	char *seq_str;
 	const char *delimiter = " ";
 	const char *prefix = NULL;
 	const char *suffix = NULL;
+	FILE *stream = stdout;
 
 	/* Process config options */
 	if (config != NULL) {
@@ -1326,26 +6205,32 @@ CMB_ACTION_BN(cmb_print_bn)
 			show_numbers = TRUE;
 		prefix = config->prefix;
 		suffix = config->suffix;
+		if (config->stream != NULL)
+			stream = config->stream;
+		if (config->format != CMB_FORMAT_TEXT)
+			return (errno = EINVAL); /* needs item numbers */
 	}
 
-	if (show_numbers) {
+	/* Only sequence numbers beyond 64 bits need BN_bn2dec() */
+	if (show_numbers && cmb_bn_get_u64(seq, &seq64)) {
+		len = cmb_utoa(seq64, buf);
+		buf[len++] = ' ';
+		fwrite(buf, 1, len, stream);
+	} else if (show_numbers) {
 		seq_str = BN_bn2dec(seq);
-		printf("%s ", seq_str);
+		fprintf(stream, "%s ", seq_str);
 		OPENSSL_free(seq_str);
 	}
 	if (prefix != NULL)
-		printf("%s", prefix);
+		fputs(prefix, stream);
 	for (n = 0; n < nitems; n++) {
-		printf("%s", items[n]);
+		fputs(items[n], stream);
 		if (n < nitems - 1)
-			printf("%s", delimiter);
+			fputs(delimiter, stream);
 	}
 	if (suffix != NULL)
-		printf("%s", suffix);
-	if (nul)
-		printf("%c", 0);
-	else
-		printf("\n");
+		fputs(suffix, stream);
+	putc(nul ? '\0' : '\n', stream);
 
 	return (0);
 }
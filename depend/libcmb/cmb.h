@@ -51,6 +51,15 @@
 #define CMB_DEBUG FALSE
 #endif
 
+/*
+ * Thread-local storage class for per-thread transform state
+ */
+#ifdef __cplusplus
+#define CMB_THREAD_LOCAL thread_local
+#else
+#define CMB_THREAD_LOCAL _Thread_local
+#endif
+
 /*
  * Version constants for cmb_version(3)
  */
@@ -60,9 +69,9 @@
 /*
  * Header version info
  */
-#define CMB_H_VERSION_MAJOR	3
-#define CMB_H_VERSION_MINOR	5
-#define CMB_H_VERSION_PATCH	6
+#define CMB_H_VERSION_MAJOR	4
+#define CMB_H_VERSION_MINOR	0
+#define CMB_H_VERSION_PATCH	0
 
 /*
  * Macros for cmb_config options bitmask
@@ -72,20 +81,63 @@
 #define CMB_OPT_NULPRINT	0x04	/* NUL delimit cmb_print*() */
 #define CMB_OPT_EMPTY		0x08	/* Show empty set with no items */
 #define CMB_OPT_NUMBERS		0x10	/* Show combination sequence numbers */
-#define CMB_OPT_RESERVED	0x20	/* Reserved for future use by cmb(3) */
+#define CMB_OPT_INDICES		0x20	/* Pass item numbers to action() */
+#define CMB_OPT_RESERVED	CMB_OPT_INDICES	/* Deprecated */
 #define CMB_OPT_OPTION1		0x40	/* Available (unused by cmb(3)) */
 #define CMB_OPT_OPTION2		0x80	/* Available (unused by cmb(3)) */
 
+/*
+ * Enumeration orders for cmb_config order
+ */
+#define CMB_ORDER_LEX		0	/* Lexicographic (default) */
+#define CMB_ORDER_REVDOOR	1	/* Revolving-door (minimal change) */
+
+/*
+ * Output formats for cmb_config format
+ */
+#define CMB_FORMAT_TEXT		0	/* Lines of items (default) */
+#define CMB_FORMAT_BIN		1	/* Fixed-size records of item numbers */
+
+/*
+ * Default number of rows per action_batch() call
+ */
+#define CMB_BATCH_SIZE		1024
+
+/*
+ * Return values for bound() callback
+ */
+#define CMB_BOUND_DESCEND	0	/* Continue with the prefix */
+#define CMB_BOUND_SKIP		1	/* Skip combinations with the prefix */
+#define CMB_BOUND_SKIPALL	2	/* Also with a greater last item */
+
 /*
  * Macros for defining call-back functions/pointers
  */
 #define CMB_ACTION(x) \
     int x(struct cmb_config *config, uint64_t seq, uint32_t nitems, \
         char *items[])
+#define CMB_ACTION_BATCH(x) \
+    int x(struct cmb_config *config, uint64_t seq, uint32_t nitems, \
+        uint32_t *indices, uint32_t nrows)
+#define CMB_ACTION_MASK(x) \
+    int x(struct cmb_config *config, uint64_t seq, uint32_t nitems, \
+        uint64_t mask)
+#define CMB_BOUND(x) \
+    int x(struct cmb_config *config, uint32_t setsize, uint32_t depth, \
+        uint32_t *setnums)
+#define CMB_SCORE(x) \
+    long double x(struct cmb_config *config, uint64_t seq, uint32_t nitems, \
+        char *items[])
 #ifdef HAVE_OPENSSL_BN_H
 #define CMB_ACTION_BN(x) \
     int x(struct cmb_config *config, BIGNUM *seq, uint32_t nitems, \
         char *items[])
+#define CMB_ACTION_BATCH_BN(x) \
+    int x(struct cmb_config *config, BIGNUM *seq, uint32_t nitems, \
+        uint32_t *indices, uint32_t nrows)
+#define CMB_ACTION_MASK_BN(x) \
+    int x(struct cmb_config *config, BIGNUM *seq, uint32_t nitems, \
+        uint64_t mask)
 #endif
 
 /*
@@ -96,6 +148,57 @@ struct cmb_build_info {
 };
 extern struct cmb_build_info cmb_build_info;
 
+/*
+ * Opaque state of a pull-based enumeration (see cmb_iter_init())
+ */
+struct cmb_iter;
+
+/*
+ * Header of CMB_FORMAT_BIN output, in the byte order of the writer. It is
+ * followed at items_off by the items, each NUL terminated, and at records_off
+ * by records of recsize bytes: a uint64_t sequence number if flags has
+ * CMB_BIN_RANK, then MAX(size_max, 1) item numbers (zero-based) of width
+ * bytes, with all bits set after the last item of a smaller combination.
+ */
+#define CMB_BIN_MAGIC		"CMBB"
+#define CMB_BIN_VERSION		1
+#define CMB_BIN_BYTEORDER	0x01020304
+#define CMB_BIN_RANK		0x01	/* Records begin with sequence number */
+
+struct cmb_bin_header {
+	char	magic[4];	/* CMB_BIN_MAGIC (not NUL terminated) */
+	uint16_t version;	/* CMB_BIN_VERSION */
+	uint8_t	width;		/* Bytes per item number (1, 2, or 4) */
+	uint8_t	flags;		/* CMB_BIN_* bitmask */
+	uint32_t byteorder;	/* CMB_BIN_BYTEORDER */
+	uint32_t nitems;	/* Number of items */
+	uint32_t size_min;	/* Fewest items in a combination */
+	uint32_t size_max;	/* Most items in a combination */
+	uint32_t recsize;	/* Bytes per record */
+	uint32_t reserved;	/* Zero */
+	uint64_t items_off;	/* Offset of items */
+	uint64_t items_len;	/* Bytes of items (including NULs) */
+	uint64_t records_off;	/* Offset of the first record */
+};
+
+/*
+ * Opaque state of a reader of CMB_FORMAT_BIN output (see cmb_bin_open())
+ */
+struct cmb_bin;
+
+/*
+ * Backpressure metrics of the output writer thread (see cmb_config writer)
+ */
+struct cmb_writer_stats {
+	uint64_t buffers;	/* Buffers passed to the writer thread */
+	uint64_t bytes;		/* Bytes written by the writer thread */
+	uint64_t writes;	/* writev(2) calls (more if partial writes) */
+	uint64_t stalls;	/* Buffers that waited for the previous one */
+	uint64_t stall_ns;	/* Nanoseconds cmb(3) waited for the writer */
+	uint64_t write_ns;	/* Nanoseconds the writer spent in writev(2) */
+	uint64_t idle_ns;	/* Nanoseconds the writer waited for cmb(3) */
+};
+
 /*
  * Anatomy of config option to pass as cmb*() config argument
  */
@@ -120,6 +223,116 @@ struct cmb_config {
 	 */
 	CMB_ACTION((*action));
 
+	/*
+	 * Set by cmb_parallel(3) in the per-thread copy of config passed to
+	 * action(); the worker thread number, 0 to nthreads-1.
+	 */
+	uint32_t thread;
+
+	/*
+	 * cmb(3) batch callback; if non-NULL, called instead of action() with
+	 * up to batch_size combinations at a time (default CMB_BATCH_SIZE).
+	 * Rows of the nrows by nitems indices matrix are item numbers (zero-
+	 * based) of consecutive combinations, the first numbered seq. All rows
+	 * are from the same set; a batch is flushed early at the end of each
+	 * set and of the run. The empty set is a single row of no indices.
+	 */
+	CMB_ACTION_BATCH((*action_batch));
+	uint32_t batch_size;	/* Maximum rows per action_batch() */
+
+	/*
+	 * Set by cmb(3) before each call to action() if CMB_OPT_INDICES is
+	 * given. Instead of mapping each combination into items, action() is
+	 * passed the original items[] unchanged and indices holds the item
+	 * numbers (zero-based) of the combination. Only positions from changed
+	 * onward differ from the previous call (zero for the first combination
+	 * of each set). NULL for the empty set.
+	 */
+	uint32_t *indices;
+	uint32_t changed;
+
+	/*
+	 * Order of combinations within each set (CMB_ORDER_*). In revolving-
+	 * door order, each combination differs from the previous one by
+	 * exactly one item; before each call to action(), left and entered are
+	 * set to the item numbers (zero-based) removed and added (UINT32_MAX
+	 * for the first combination of each set). Sequence numbers (and start
+	 * and count) follow the selected order.
+	 */
+	uint8_t order;
+	uint32_t left;
+	uint32_t entered;
+
+	/*
+	 * cmb(3) mask callback; if non-NULL, called instead of action() and
+	 * action_batch() with each combination as a bitmask of item numbers
+	 * (bit N set if item N is in the combination). Requires at most 64
+	 * items; cmb() returns EINVAL otherwise.
+	 */
+	CMB_ACTION_MASK((*action_mask));
+
+	/*
+	 * If non-zero, cmb_sample(3) draws without replacement; no combination
+	 * is drawn twice.
+	 */
+	uint8_t unique;
+
+	/*
+	 * cmb(3) bound callback; if non-NULL, combinations are enumerated
+	 * depth-first (in the same order and with the same sequence numbers)
+	 * and bound() is called with each prefix of each combination; item
+	 * numbers at positions 0 to depth-1 of setnums, of setsize in all. If
+	 * bound() returns CMB_BOUND_SKIP, no combination beginning with the
+	 * prefix is produced; CMB_BOUND_SKIPALL also skips those with a
+	 * greater item number at position depth-1. A prefix is always passed
+	 * before any combination beginning with it. Requires lexicographic
+	 * order, action_batch() and action_mask() NULL; cmb() returns EINVAL
+	 * otherwise.
+	 */
+	CMB_BOUND((*bound));
+
+	/*
+	 * cmb_top(3) score callback; called like action() for each
+	 * combination, the lowest scores being kept.
+	 */
+	CMB_SCORE((*score));
+
+	/*
+	 * If nshards is greater than one, cmb(3), cmb_bn(3), and
+	 * cmb_parallel(3) produce only shard number shard (1 to nshards) of
+	 * the combinations selected by start and count, divided into nshards
+	 * consecutive ranges differing in length by at most one. Running every
+	 * shard in turn produces the same combinations, with the same
+	 * sequence numbers, as a single run.
+	 */
+	uint32_t shard;
+	uint32_t nshards;
+
+	/*
+	 * Stream written by cmb_print(3), cmb_print_bn(3), and the
+	 * transformations below (default is stdout). Unlike stdout, it is not
+	 * locked against concurrent cmb_parallel(3) workers.
+	 */
+	FILE	*stream;
+
+	/*
+	 * If non-NULL, cmb(3) and cmb_bn(3) printing to stdout fill one output
+	 * buffer while a writer thread writes the other, so that calculation
+	 * continues while the reader of stdout catches up. The metrics of the
+	 * run are added to *writer before returning. Ignored with stream and
+	 * by cmb_parallel(3).
+	 */
+	struct cmb_writer_stats *writer;
+
+	/*
+	 * Output format of cmb(3), cmb_bn(3), and cmb_sample(3) with the
+	 * default action (CMB_FORMAT_*). With CMB_FORMAT_BIN, a header and
+	 * the items are written, followed by one record of item numbers per
+	 * combination (see `struct cmb_bin_header'); CMB_OPT_NUMBERS adds the
+	 * sequence number to each record. Text options are ignored.
+	 */
+	uint8_t	format;
+
 #ifdef HAVE_OPENSSL_BN_H
 	BIGNUM	*count_bn;	/* bn(3) number of combinations */
 	BIGNUM	*start_bn;	/* bn(3) starting combination */
@@ -131,19 +344,51 @@ struct cmb_config {
 	 * first non-zero result from action_bn(), zero otherwise.
 	 */
 	CMB_ACTION_BN((*action_bn));
+
+	/* cmb_bn(3) equivalent of action_batch() */
+	CMB_ACTION_BATCH_BN((*action_batch_bn));
+
+	/* cmb_bn(3) equivalent of action_mask() */
+	CMB_ACTION_MASK_BN((*action_mask_bn));
 #endif
 };
 
 __BEGIN_DECLS
 int		cmb(struct cmb_config *_config, uint32_t _nitems,
 		    char *_items[]);
+void		cmb_bin_free(struct cmb_bin *_bin);
+struct cmb_bin *cmb_bin_open(int _fd, struct cmb_bin_header *_header,
+		    char ***_items);
+int		cmb_bin_read(struct cmb_bin *_bin, uint64_t *_seq,
+		    uint32_t *_setsize, uint32_t _setnums[]);
+int		cmb_bin_seek(struct cmb_bin *_bin, uint64_t _record);
 uint64_t	cmb_count(struct cmb_config *_config, uint32_t _nitems);
+void		cmb_iter_free(struct cmb_iter *_iter);
+struct cmb_iter *cmb_iter_init(struct cmb_config *_config, uint32_t _nitems,
+		    char *_items[]);
+int		cmb_iter_next(struct cmb_iter *_iter, uint64_t *_seq,
+		    uint32_t *_nitems, char ***_items);
+uint32_t	cmb_iter_next_batch(struct cmb_iter *_iter, uint64_t *_seq,
+		    uint32_t *_nitems, uint32_t *_indices, uint32_t _maxrows);
+int		cmb_parallel(struct cmb_config *_config, uint32_t _nitems,
+		    char *_items[], uint32_t _nthreads);
 char **		cmb_parse(struct cmb_config *_config, int _fd,
 		    uint32_t *_nitems, uint32_t _max);
 char **		cmb_parse_file(struct cmb_config *_config, char *_path,
 		    uint32_t *_nitems, uint32_t _max);
+void		cmb_parse_free(char **_items);
 int		cmb_print(struct cmb_config *_config, uint64_t _seq,
 		    uint32_t _nitems, char *_items[]);
+uint64_t	cmb_rank(struct cmb_config *_config, uint32_t _nitems,
+		    uint32_t _setsize, uint32_t _setnums[]);
+int		cmb_sample(struct cmb_config *_config, uint32_t _nitems,
+		    char *_items[], uint64_t _nsamples, uint64_t _seed);
+int		cmb_shard_range(struct cmb_config *_config, uint32_t _nitems,
+		    uint64_t *_first, uint64_t *_count);
+int		cmb_top(struct cmb_config *_config, uint32_t _nitems,
+		    char *_items[], uint32_t _ntop, uint32_t _nthreads);
+int		cmb_unrank(struct cmb_config *_config, uint32_t _nitems,
+		    uint64_t _seq, uint32_t *_setsize, uint32_t _setnums[]);
 const char *	cmb_version(int _type);
 #ifdef HAVE_OPENSSL_BN_H
 int		cmb_bn(struct cmb_config *_config, uint32_t _nitems,
@@ -151,15 +396,29 @@ int		cmb_bn(struct cmb_config *_config, uint32_t _nitems,
 BIGNUM *	cmb_count_bn(struct cmb_config *_config, uint32_t _nitems);
 int		cmb_print_bn(struct cmb_config *_config, BIGNUM *_seq,
 		    uint32_t _nitems, char *_items[]);
+BIGNUM *	cmb_rank_bn(struct cmb_config *_config, uint32_t _nitems,
+		    uint32_t _setsize, uint32_t _setnums[]);
+int		cmb_unrank_bn(struct cmb_config *_config, uint32_t _nitems,
+		    BIGNUM *_seq, uint32_t *_setsize, uint32_t _setnums[]);
 #endif
 
 /* Inline functions */
-static inline void cmb_print_seq(uint64_t seq) { printf("%"PRIu64" ", seq); }
+static inline void cmb_fprint_seq(FILE *fp, uint64_t seq) {
+    fprintf(fp, "%"PRIu64" ", seq);
+}
+static inline void cmb_print_seq(uint64_t seq) { cmb_fprint_seq(stdout, seq); }
 #ifdef HAVE_OPENSSL_BN_H
-static inline void cmb_print_seq_bn(BIGNUM *seq) { char *seq_str;
-    printf("%s ", seq_str = BN_bn2dec(seq));
+static inline void cmb_fprint_seq_bn(FILE *fp, BIGNUM *seq) { char *seq_str;
+    if (BN_num_bytes(seq) <= (int)sizeof(BN_ULONG)) {
+	fprintf(fp, "%"PRIu64" ", (uint64_t)BN_get_word(seq));
+	return;
+    }
+    fprintf(fp, "%s ", seq_str = BN_bn2dec(seq));
     OPENSSL_free(seq_str);
 }
+static inline void cmb_print_seq_bn(BIGNUM *seq) {
+    cmb_fprint_seq_bn(stdout, seq);
+}
 #endif /* HAVE_OPENSSL_BN_H */
 __END_DECLS
 
@@ -167,7 +426,13 @@ __END_DECLS
  * Transformations
  */
 
+/*
+ * NB: The running totals of CMB_OPT_INDICES and the text of find results are
+ * kept per thread, so that transformations may run in several at once.
+ */
 extern int cmb_transform_precision;
+extern CMB_THREAD_LOCAL long double *cmb_transform_totals;
+extern CMB_THREAD_LOCAL uint32_t cmb_transform_totals_size;
 struct cmb_xitem {
 	char *cp;			/* original item */
 	union cmb_xitem_type {
@@ -175,17 +440,66 @@ struct cmb_xitem {
 	} as;
 };
 
+/*
+ * Get the `struct cmb_xitem' at position n of the combination. When cmb(3) is
+ * given CMB_OPT_INDICES, items is the original array and indices (from
+ * config) selects from it.
+ */
+#define CMB_TRANSFORM_XITEM(n)                                               \
+    	memcpy(&xitem, &items[indices == NULL ? (n) : indices[n]],           \
+    	    sizeof(struct cmb_xitem *))
+
+/*
+ * Fold eq over the items of the combination into total. With CMB_OPT_INDICES
+ * the running total at each position is kept between calls and only positions
+ * from config->changed onward are recalculated; amortized O(1) rather than
+ * O(nitems) per combination. The result is identical to folding every item
+ * (no floating point drift from backing out items that left).
+ */
+#define CMB_TRANSFORM_TOTAL(eq)                                              \
+    	if (indices == NULL) {                                               \
+    		for (n = 0; n < nitems; n++) {                               \
+    			CMB_TRANSFORM_XITEM(n);                              \
+    			ld = xitem->as.ld;                                   \
+    			total = n == 0 ? ld : (eq);                          \
+    		}                                                            \
+    	} else {                                                             \
+    		if (nitems > cmb_transform_totals_size) {                    \
+    			cmb_transform_totals = realloc(cmb_transform_totals, \
+    			    sizeof(long double) * nitems);                   \
+    			if (cmb_transform_totals == NULL) {                  \
+    				errx(EXIT_FAILURE, "Out of memory?!");       \
+    				/* NOTREACHED */                             \
+    			}                                                    \
+    			cmb_transform_totals_size = nitems;                  \
+    		}                                                            \
+    		for (n = config->changed; n < nitems; n++) {                 \
+    			CMB_TRANSFORM_XITEM(n);                              \
+    			ld = xitem->as.ld;                                   \
+    			if (n > 0) {                                         \
+    				total = cmb_transform_totals[n - 1];         \
+    				total = (eq);                                \
+    			} else                                               \
+    				total = ld;                                  \
+    			cmb_transform_totals[n] = total;                     \
+    		}                                                            \
+    		if (nitems > 0)                                              \
+    			total = cmb_transform_totals[nitems - 1];            \
+    	}
+
 #define CMB_TRANSFORM_EQ(eq, op, x, seqt, seqp) \
     int                                                                      \
     x(struct cmb_config *config, seqt seq, uint32_t nitems, char *items[])   \
     {                                                                        \
     	uint8_t show_numbers = FALSE;                                        \
     	uint32_t n;                                                          \
+    	uint32_t *indices = NULL;                                            \
     	long double ld;                                                      \
     	long double total = 0;                                               \
     	const char *delimiter = " ";                                         \
     	const char *prefix = NULL;                                           \
     	const char *suffix = NULL;                                           \
+    	FILE *stream = stdout;                                               \
     	struct cmb_xitem *xitem = NULL;                                      \
     	                                                                     \
     	if (config != NULL) {                                                \
@@ -193,53 +507,46 @@ struct cmb_xitem {
     			delimiter = config->delimiter;                       \
     		if ((config->options & CMB_OPT_NUMBERS) != 0)                \
     			show_numbers = TRUE;                                 \
+    		if ((config->options & CMB_OPT_INDICES) != 0)                \
+    			indices = config->indices;                           \
     		prefix = config->prefix;                                     \
     		suffix = config->suffix;                                     \
+    		if (config->stream != NULL)                                  \
+    			stream = config->stream;                             \
     	}                                                                    \
+    	CMB_TRANSFORM_TOTAL(eq);                                             \
     	if (!opt_silent) {                                                   \
     		if (show_numbers)                                            \
-    			seqp(seq);                                           \
+    			seqp(stream, seq);                                   \
     		if (prefix != NULL && !opt_quiet)                            \
-    			printf("%s", prefix);                                \
-    	}                                                                    \
-    	if (nitems > 0) {                                                    \
-    		memcpy(&xitem, &items[0], sizeof(struct cmb_xitem *));       \
-    		total = xitem->as.ld;                                        \
-    		if (!opt_silent && !opt_quiet) {                             \
-    			printf("%s", xitem->cp);                             \
-    			if (nitems > 1)                                      \
-    				printf("%s" #op "%s", delimiter, delimiter); \
-    		}                                                            \
+    			fprintf(stream, "%s", prefix);                       \
     	}                                                                    \
-    	for (n = 1; n < nitems; n++) {                                       \
-    		memcpy(&xitem, &items[n], sizeof(struct cmb_xitem *));       \
-    		ld = xitem->as.ld;                                           \
-    		total = eq;                                                  \
-    		if (!opt_silent && !opt_quiet) {                             \
-    			printf("%s", xitem->cp);                             \
-    			if (n < nitems - 1)                                  \
-    				printf("%s" #op "%s", delimiter, delimiter); \
-    		}                                                            \
+    	for (n = 0; n < nitems && !opt_silent && !opt_quiet; n++) {          \
+    		CMB_TRANSFORM_XITEM(n);                                      \
+    		fprintf(stream, "%s", xitem->cp);                            \
+    		if (n < nitems - 1)                                          \
+    			fprintf(stream, "%s" #op "%s", delimiter,            \
+    			    delimiter);                                      \
     	}                                                                    \
     	if (!opt_silent) {                                                   \
     		if (suffix != NULL && !opt_quiet)                            \
-    			printf("%s", suffix);                                \
-    		printf("%s%.*Lf\n", opt_quiet ? "" : " = ",                  \
+    			fprintf(stream, "%s", suffix);                       \
+    		fprintf(stream, "%s%.*Lf\n", opt_quiet ? "" : " = ",          \
     			cmb_transform_precision, total);                     \
     	}                                                                    \
     	return (0);                                                          \
     }
 
 #define CMB_TRANSFORM_OP(op, x) \
-	CMB_TRANSFORM_EQ(total op ld, op, x, uint64_t, cmb_print_seq)
+	CMB_TRANSFORM_EQ(total op ld, op, x, uint64_t, cmb_fprint_seq)
 #define CMB_TRANSFORM_FN(op, fn, x) \
-	CMB_TRANSFORM_EQ(fn(total, ld), op, x, uint64_t, cmb_print_seq)
+	CMB_TRANSFORM_EQ(fn(total, ld), op, x, uint64_t, cmb_fprint_seq)
 
 #if defined(HAVE_LIBCRYPTO) && defined(HAVE_OPENSSL_BN_H)
 #define CMB_TRANSFORM_OP_BN(op, x) \
-	CMB_TRANSFORM_EQ(total op ld, op, x, BIGNUM *, cmb_print_seq_bn)
+	CMB_TRANSFORM_EQ(total op ld, op, x, BIGNUM *, cmb_fprint_seq_bn)
 #define CMB_TRANSFORM_FN_BN(op, fn, x) \
-	CMB_TRANSFORM_EQ(fn(total, ld), op, x, BIGNUM *, cmb_print_seq_bn)
+	CMB_TRANSFORM_EQ(fn(total, ld), op, x, BIGNUM *, cmb_fprint_seq_bn)
 #endif
 
 /*
@@ -259,34 +566,46 @@ CMB_TRANSFORM_FN_BN(/, div, cmb_div_bn);	/* creates cmb_div_bn() */
  * Find transformations
  */
 
-extern char *cmb_transform_find_buf;
-extern int cmb_transform_find_buf_size;
+extern CMB_THREAD_LOCAL char *cmb_transform_find_buf;
+extern CMB_THREAD_LOCAL int cmb_transform_find_buf_size;
 extern struct cmb_xitem *cmb_transform_find;
+extern long double cmb_transform_find_tolerance;
 
+/*
+ * NB: When cmb_transform_precision is non-zero, results are compared to the
+ * find value as text rounded to that precision. If cmb_transform_find_tolerance
+ * is non-zero (e.g., 2 * 10^-precision), results further than that from the
+ * find value are rejected without formatting them; such results cannot round
+ * to the same text.
+ */
 #define CMB_TRANSFORM_EQ_FIND(eq, op, x, seqt, seqp) \
     int                                                                      \
     x(struct cmb_config *config, seqt seq, uint32_t nitems, char *items[])   \
     {                                                                        \
     	uint8_t show_numbers = FALSE;                                        \
     	uint32_t n;                                                          \
+    	uint32_t *indices = NULL;                                            \
     	int len;                                                             \
     	long double ld;                                                      \
     	long double total = 0;                                               \
     	const char *delimiter = " ";                                         \
     	const char *prefix = NULL;                                           \
     	const char *suffix = NULL;                                           \
+    	FILE *stream = stdout;                                               \
     	struct cmb_xitem *xitem = NULL;                                      \
     	                                                                     \
-    	for (n = 0; n < nitems; n++) {                                       \
-    		memcpy(&xitem, &items[n], sizeof(struct cmb_xitem *));       \
-    		ld = xitem->as.ld;                                           \
-    		total = eq;                                                  \
-    	}                                                                    \
+    	if (config != NULL && (config->options & CMB_OPT_INDICES) != 0)      \
+    		indices = config->indices;                                   \
+    	CMB_TRANSFORM_TOTAL(eq);                                             \
     	if (cmb_transform_precision == 0) {                                  \
     		if (total != cmb_transform_find->as.ld) {                    \
     			return (0);                                          \
     		}                                                            \
     	} else {                                                             \
+    		if (cmb_transform_find_tolerance > 0 &&                      \
+    		    fabsl(total - cmb_transform_find->as.ld) >               \
+    		    cmb_transform_find_tolerance)                            \
+    			return (0);                                          \
     		len = snprintf(NULL, 0, "%.*Lf",                             \
     		    cmb_transform_precision, total) + 1;                     \
     		if (len > cmb_transform_find_buf_size) {                     \
@@ -312,48 +631,41 @@ extern struct cmb_xitem *cmb_transform_find;
     			show_numbers = TRUE;                                 \
     		prefix = config->prefix;                                     \
     		suffix = config->suffix;                                     \
+    		if (config->stream != NULL)                                  \
+    			stream = config->stream;                             \
     	}                                                                    \
     	if (!opt_silent) {                                                   \
     		if (show_numbers)                                            \
-    			seqp(seq);                                           \
+    			seqp(stream, seq);                                   \
     		if (prefix != NULL && !opt_quiet)                            \
-    			printf("%s", prefix);                                \
+    			fprintf(stream, "%s", prefix);                       \
     	}                                                                    \
-    	if (nitems > 0) {                                                    \
-    		memcpy(&xitem, &items[0], sizeof(struct cmb_xitem *));       \
-    		if (!opt_silent && !opt_quiet) {                             \
-    			printf("%s", xitem->cp);                             \
-    			if (nitems > 1)                                      \
-    				printf("%s" #op "%s", delimiter, delimiter); \
-    		}                                                            \
-    	}                                                                    \
-    	for (n = 1; n < nitems; n++) {                                       \
-    		memcpy(&xitem, &items[n], sizeof(struct cmb_xitem *));       \
-    		if (!opt_silent && !opt_quiet) {                             \
-    			printf("%s", xitem->cp);                             \
-    			if (n < nitems - 1)                                  \
-    				printf("%s" #op "%s", delimiter, delimiter); \
-    		}                                                            \
+    	for (n = 0; n < nitems && !opt_silent && !opt_quiet; n++) {          \
+    		CMB_TRANSFORM_XITEM(n);                                      \
+    		fprintf(stream, "%s", xitem->cp);                            \
+    		if (n < nitems - 1)                                          \
+    			fprintf(stream, "%s" #op "%s", delimiter,            \
+    			    delimiter);                                      \
     	}                                                                    \
     	if (!opt_silent) {                                                   \
     		if (suffix != NULL && !opt_quiet)                            \
-    			printf("%s", suffix);                                \
-    		printf("%s%.*Lf\n", opt_quiet ? "" : " = ",                  \
+    			fprintf(stream, "%s", suffix);                       \
+    		fprintf(stream, "%s%.*Lf\n", opt_quiet ? "" : " = ",          \
     			cmb_transform_precision, total);                     \
     	}                                                                    \
     	return (0);                                                          \
     }
 
 #define CMB_TRANSFORM_OP_FIND(op, x) \
-	CMB_TRANSFORM_EQ_FIND(total op ld, op, x, uint64_t, cmb_print_seq)
+	CMB_TRANSFORM_EQ_FIND(total op ld, op, x, uint64_t, cmb_fprint_seq)
 #define CMB_TRANSFORM_FN_FIND(op, fn, x) \
-	CMB_TRANSFORM_EQ_FIND(fn(total, ld), op, x, uint64_t, cmb_print_seq)
+	CMB_TRANSFORM_EQ_FIND(fn(total, ld), op, x, uint64_t, cmb_fprint_seq)
 
 #if defined(HAVE_LIBCRYPTO) && defined(HAVE_OPENSSL_BN_H)
 #define CMB_TRANSFORM_OP_FIND_BN(op, x) \
-	CMB_TRANSFORM_EQ_FIND(total op ld, op, x, BIGNUM *, cmb_print_seq_bn)
+	CMB_TRANSFORM_EQ_FIND(total op ld, op, x, BIGNUM *, cmb_fprint_seq_bn)
 #define CMB_TRANSFORM_FN_FIND_BN(op, fn, x) \
-	CMB_TRANSFORM_EQ_FIND(fn(total, ld), op, x, BIGNUM *, cmb_print_seq_bn)
+	CMB_TRANSFORM_EQ_FIND(fn(total, ld), op, x, BIGNUM *, cmb_fprint_seq_bn)
 #endif
 
 /*
@@ -369,4 +681,39 @@ CMB_TRANSFORM_FN_FIND_BN(/, div, cmb_div_bn);	/* creates cmb_div_bn() */
 #endif
 #endif
 
+/*
+ * Score transformations (see cmb_top(3))
+ */
+#define CMB_TRANSFORM_EQ_SCORE(eq, x) \
+    long double                                                              \
+    x(struct cmb_config *config, uint64_t seq, uint32_t nitems,              \
+        char *items[])                                                       \
+    {                                                                        \
+    	uint32_t n;                                                          \
+    	uint32_t *indices = NULL;                                            \
+    	long double ld;                                                      \
+    	long double total = 0;                                               \
+    	struct cmb_xitem *xitem = NULL;                                      \
+    	                                                                     \
+    	(void)seq;                                                           \
+    	if (config != NULL && (config->options & CMB_OPT_INDICES) != 0)      \
+    		indices = config->indices;                                   \
+    	CMB_TRANSFORM_TOTAL(eq);                                             \
+    	return (total);                                                      \
+    }
+
+#define CMB_TRANSFORM_OP_SCORE(op, x) \
+	CMB_TRANSFORM_EQ_SCORE(total op ld, x)
+#define CMB_TRANSFORM_FN_SCORE(fn, x) \
+	CMB_TRANSFORM_EQ_SCORE(fn(total, ld), x)
+
+/*
+ * Example score transformations
+ */
+
+#if 0
+CMB_TRANSFORM_OP_SCORE(+, cmb_add_score);	/* creates cmb_add_score() */
+CMB_TRANSFORM_FN_SCORE(div, cmb_div_score);	/* creates cmb_div_score() */
+#endif
+
 #endif /* !_CMB_H_ */
@@ -82,6 +82,111 @@ g_callback(struct cmb_config *config, uint64_t seq, uint32_t nitems,
 	return (result);
 }
 
+/*
+ * Populate rows (an array of array refs, reused between calls) with nrows
+ * combinations of nitems items each, taken from array by item number.
+ */
+static void
+_rows(pTHX_ AV *rows, SV **array, uint32_t *indices, uint32_t nitems,
+    uint32_t nrows)
+{
+	uint32_t i, r;
+	AV *row;
+	SV *sv;
+	SV **svp;
+
+	for (r = 0; r < nrows; r++) {
+		if ((svp = av_fetch(rows, r, 0)) != NULL && SvROK(*svp)) {
+			row = (AV *)SvRV(*svp);
+		} else {
+			row = newAV();
+			av_store(rows, r, newRV_noinc((SV *)row));
+		}
+		av_fill(row, (SSize_t)nitems - 1);
+		for (i = 0; i < nitems; i++) {
+			sv = array[indices[(size_t)r * nitems + i]];
+			av_store(row, i, sv != NULL ? SvREFCNT_inc(sv) :
+			    newSV(0));
+		}
+	}
+	av_fill(rows, (SSize_t)nrows - 1);
+}
+
+int
+g_callback_batch(struct cmb_config *config, uint64_t seq, uint32_t nitems,
+    uint32_t *indices, uint32_t nrows)
+{
+	int result = 0;
+	dTHX;
+	dSP;
+	dMULTICALL;
+	HV *stash;
+	GV *gv;
+	U8 gimme = G_SCALAR;
+	CV *cv;
+	SV *perlfunc;
+	AV *perlargs;
+	AV *rows;
+	SV **array;
+
+#ifdef __linux__
+	(void)newsp;
+#endif
+
+	perlfunc = (SV *)((void **)config->data)[0];
+	perlargs = (AV *)((void **)config->data)[1];
+	rows = (AV *)((void **)config->data)[2];
+	array = (SV **)((void **)config->data)[3];
+
+	_rows(aTHX_ rows, array, indices, nitems, nrows);
+
+	cv = sv_2cv(perlfunc, &stash, &gv, 0);
+	PUSH_MULTICALL(cv);
+
+	av_clear(perlargs);
+	if ((config->options & CMB_OPT_NUMBERS) != 0)
+		av_push(perlargs, (SV *)newSVuv(seq));
+	av_push(perlargs, newRV_inc((SV *)rows));
+
+	{
+		GvAV(PL_defgv) = perlargs;
+		MULTICALL;
+	}
+
+	result = SvIV(*PL_stack_sp);
+	POP_MULTICALL;
+
+	return (result);
+}
+
+/*
+ * State behind a Cmb::Iter object
+ */
+struct cmb_perl_iter {
+	struct cmb_config config;	/* Private copy of config */
+	struct cmb_iter *iter;		/* NULL when exhausted */
+	SV **array;			/* Items (references held) */
+	uint32_t narray;		/* Number of elements in array */
+	uint32_t *indices;		/* Batch of item numbers */
+	uint32_t nrows;			/* Maximum rows per batch */
+	AV *rows;			/* Rows returned by next_batch() */
+};
+
+/*
+ * Largest number of items in a combination given config and nitems.
+ */
+static uint32_t
+_setmax(struct cmb_config *c, uint32_t nitems)
+{
+	uint32_t setmax;
+
+	setmax = c->size_max > c->size_min ? c->size_max : c->size_min;
+	if (setmax == 0 || setmax > nitems)
+		setmax = nitems;
+
+	return (setmax > 0 ? setmax : 1);
+}
+
 void
 _config(struct cmb_config *c, SV *hash)
 {
@@ -141,6 +246,7 @@ _config(struct cmb_config *c, SV *hash)
 }
 
 typedef struct cmb_config * Cmb;
+typedef struct cmb_perl_iter * Cmb__Iter;
 
 MODULE = Cmb		PACKAGE = Cmb		
 
@@ -149,6 +255,7 @@ INCLUDE: const-xs.inc
 TYPEMAP: <<EOF
 struct cmb_config *	T_PTROBJ
 Cmb			T_PTROBJ
+Cmb::Iter		T_PTROBJ
 uint32_t		T_U_LONG
 unsigned long long	T_U_LONG_LONG
 uint64_t		T_U_LONG_LONG
@@ -312,3 +419,142 @@ CODE:
 	c->data = _data;
 OUTPUT:
 	RETVAL
+
+int
+cmb_callback_batch(c, nitems, arrayref, name, ...)
+PREINIT:
+	int inum;
+	SV **array;
+	int i;
+	SV **item;
+	void *_data;
+	uint32_t _batch_size;
+	CMB_ACTION_BATCH((*_action_batch));
+INPUT:
+	Cmb c;
+	uint32_t nitems;
+	AV *arrayref;
+	SV *name;
+CODE:
+	/* Set custom batch callback to call referenced subroutine */
+	_action_batch = c->action_batch; /* save current callback */
+	_batch_size = c->batch_size;
+	c->action_batch = g_callback_batch;
+	c->batch_size = items > 4 ? (uint32_t)SvUV(ST(4)) : 0;
+
+	/* Configure which Perl subroutine g_callback_batch() should call */
+	_data = c->data;
+	c->data = (void *)calloc(4, sizeof(void *));
+	((void **)c->data)[0] = name;
+
+	/* Initialize arguments and rows reused by g_callback_batch() */
+	((void **)c->data)[1] = (void *)sv_2mortal((SV *)newAV());
+	((void **)c->data)[2] = (void *)sv_2mortal((SV *)newAV());
+
+	/* Copy elements from arrayref to C array of SV pointers */
+	inum = av_len(arrayref);
+	array = (SV **)calloc(nitems > inum + 1 ? nitems : inum + 1,
+	    sizeof(SV *));
+	for (i = 0; i <= inum; i++) {
+		if ((item = av_fetch(arrayref, i, 0)) && SvOK(*item)) {
+			array[i] = *item;
+		}
+	}
+	((void **)c->data)[3] = (void *)array;
+
+	/* Pass rows of scalar value references to g_callback_batch() */
+	RETVAL = cmb(c, nitems, NULL);
+
+	free(array);
+	free(c->data);
+
+	/* restore previous data */
+	c->action_batch = _action_batch;
+	c->batch_size = _batch_size;
+	c->data = _data;
+OUTPUT:
+	RETVAL
+
+Cmb::Iter
+iter(c, nitems, arrayref, ...)
+PREINIT:
+	int inum;
+	int i;
+	SV **item;
+	struct cmb_perl_iter *it;
+INPUT:
+	Cmb c;
+	uint32_t nitems;
+	AV *arrayref;
+CODE:
+	it = (struct cmb_perl_iter *)calloc(1, sizeof(struct cmb_perl_iter));
+	memcpy(&it->config, c, sizeof(struct cmb_config));
+	it->nrows = items > 3 ? (uint32_t)SvUV(ST(3)) : 0;
+	if (it->nrows == 0)
+		it->nrows = CMB_BATCH_SIZE;
+
+	/* Hold references to items for the life of the iterator */
+	inum = av_len(arrayref);
+	it->narray = nitems > inum + 1 ? nitems : inum + 1;
+	it->array = (SV **)calloc(it->narray, sizeof(SV *));
+	for (i = 0; i <= inum; i++) {
+		if ((item = av_fetch(arrayref, i, 0)) && SvOK(*item)) {
+			it->array[i] = SvREFCNT_inc(*item);
+		}
+	}
+	it->indices = (uint32_t *)malloc(sizeof(uint32_t) * it->nrows *
+	    _setmax(c, nitems));
+	it->rows = newAV();
+	if ((it->iter = cmb_iter_init(&it->config, nitems, NULL)) == NULL) {
+		for (i = 0; i <= inum; i++)
+			SvREFCNT_dec(it->array[i]);
+		SvREFCNT_dec((SV *)it->rows);
+		free(it->array);
+		free(it->indices);
+		free(it);
+		croak("cmb_iter_init: %s", strerror(errno));
+	}
+	RETVAL = it;
+OUTPUT:
+	RETVAL
+
+MODULE = Cmb		PACKAGE = Cmb::Iter
+
+SV *
+next_batch(it)
+PREINIT:
+	uint32_t nitems;
+	uint32_t nrows;
+	uint64_t seq;
+INPUT:
+	Cmb::Iter it;
+CODE:
+	if (it->iter == NULL)
+		XSRETURN_UNDEF;
+	nrows = cmb_iter_next_batch(it->iter, &seq, &nitems, it->indices,
+	    it->nrows);
+	(void)seq;
+	if (nrows == 0) {
+		cmb_iter_free(it->iter);
+		it->iter = NULL;
+		XSRETURN_UNDEF;
+	}
+	_rows(aTHX_ it->rows, it->array, it->indices, nitems, nrows);
+	RETVAL = newRV_inc((SV *)it->rows);
+OUTPUT:
+	RETVAL
+
+void
+DESTROY(it)
+PREINIT:
+	uint32_t i;
+INPUT:
+	Cmb::Iter it;
+CODE:
+	cmb_iter_free(it->iter);
+	for (i = 0; i < it->narray; i++)
+		SvREFCNT_dec(it->array[i]);
+	SvREFCNT_dec((SV *)it->rows);
+	free(it->array);
+	free(it->indices);
+	free(it);
@@ -119,6 +119,19 @@ Cmb - Perl extension for cmb(3) combinatorics library
   a c
   b c
 
+  # Batched callback (receives an array of rows, reused between calls):
+  $cmb->cmb_callback_batch(3, [qw/a b c/], sub {
+	my $rows = pop;
+	print "@$_\n" foreach @$rows;
+	return 0;
+  });
+
+  # Pull-based iterator:
+  my $iter = $cmb->iter(3, [qw/a b c/]);
+  while (defined(my $rows = $iter->next_batch)) {
+	print "@$_\n" foreach @$rows;
+  }
+
 =head1 DESCRIPTION
 
 Stub documentation for Cmb, created by h2xs. It looks like the
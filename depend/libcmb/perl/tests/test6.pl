@@ -0,0 +1,21 @@
+#!/usr/bin/env perl
+use strict;
+use warnings;
+use Cmb;
+
+my @items = qw/a b c d e/;
+my $nitems = $#items + 1;
+my $cmb = new Cmb { size_min => 2, size_max => 3 };
+
+printf "Testing batched callback:\n";
+$cmb->cmb_callback_batch($nitems, \@items, sub {
+	my $rows = pop;
+	printf "%s\n", join(" ", @$_) foreach @$rows;
+	return 0;
+}, 4);
+
+printf "Testing iterator:\n";
+my $iter = $cmb->iter($nitems, \@items, 4);
+while (defined(my $rows = $iter->next_batch)) {
+	printf "%u rows of %u\n", scalar @$rows, scalar @{$rows->[0]};
+}
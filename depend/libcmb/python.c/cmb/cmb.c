@@ -36,6 +36,9 @@ __FBSDID("$FreeBSD$");
 
 #define DEBUG	0
 
+/* Default number of rows per batch returned by cmb_iter() */
+#define BATCH_ROWS	(64 * 1024)
+
 /* Helpers */
 #if PY_MAJOR_VERSION == 2
 #define KeyEq(x)	(strcmp(x, key) == 0)
@@ -87,7 +90,30 @@ typedef struct {
 	uint32_t config_set;
 } PyCmbObject;
 
+typedef struct {
+	PyObject_HEAD
+	PyCmbObject *cmb;	/* Owner of config */
+	struct cmb_iter *iter;	/* NULL when exhausted */
+	uint32_t rows;		/* Maximum rows per batch */
+	uint32_t setmax;	/* Largest number of items per row */
+	uint8_t busy;		/* Enumerating without the GIL */
+} PyCmbIterObject;
+
+typedef struct {
+	PyObject_HEAD
+	uint32_t *indices;	/* nrows by nitems matrix of item numbers */
+	uint64_t seq;		/* Sequence number of first row */
+	uint32_t nitems;	/* Items per row */
+	uint32_t nrows;		/* Number of rows */
+	Py_ssize_t shape[2];
+	Py_ssize_t strides[2];
+} PyCmbBatchObject;
+
 /* Function prototypes */
+static void       CmbBatchDealloc(PyCmbBatchObject *self);
+static int        CmbBatchGetBuffer(PyCmbBatchObject *self, Py_buffer *view,
+                      int flags);
+static Py_ssize_t CmbBatchLength(PyCmbBatchObject *self);
 static void       CmbDealloc(PyCmbObject *self);
 static PyObject * CmbError(PyObject *m);
 #if PY_MAJOR_VERSION == 2
@@ -96,6 +122,8 @@ static PyObject * CmbGet(PyCmbObject *self, const char *key);
 static PyObject * CmbGetO(PyCmbObject *self, PyObject *key);
 #endif
 static int        CmbInit(PyCmbObject *self, PyObject *args, PyObject *kwds);
+static void       CmbIterDealloc(PyCmbIterObject *self);
+static PyObject * CmbIterNext(PyCmbIterObject *self);
 static PyObject * CmbNew(PyTypeObject *type, PyObject *args, PyObject *kwds);
 #if PY_MAJOR_VERSION == 2
 static int        CmbSet(PyCmbObject *self, const char *key, PyObject *value);
@@ -109,6 +137,7 @@ static int        cmb_clear(PyObject *m);
 static PyObject * pycmb(PyObject *obj, PyObject *args);
 static PyObject * pycmb_callback(PyObject *obj, PyObject *args);
 static PyObject * pycmb_count(PyObject *obj, PyObject *args);
+static PyObject * pycmb_iter(PyObject *obj, PyObject *args);
 static PyObject * pycmb_print(PyObject *obj, PyObject *args);
 static PyObject * pycmb_version(PyObject *obj, PyObject *args);
 
@@ -137,10 +166,58 @@ static PyTypeObject PyCmbType = {
 	.tp_new = CmbNew,
 };
 
+static PyTypeObject PyCmbIterType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "cmb.CMBIter",
+	.tp_basicsize = sizeof(PyCmbIterObject),
+	.tp_itemsize = 0,
+	.tp_dealloc = (destructor)CmbIterDealloc,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_doc = "cmb iterator yielding batches of combinations",
+	.tp_iter = PyObject_SelfIter,
+	.tp_iternext = (iternextfunc)CmbIterNext,
+};
+
+static PyMemberDef CmbBatchMembers[] = {
+	{ "seq", T_ULONGLONG, offsetof(PyCmbBatchObject, seq), READONLY,
+	    "sequence number of first row" },
+	{ "nitems", T_UINT, offsetof(PyCmbBatchObject, nitems), READONLY,
+	    "number of items in each row" },
+	{ "nrows", T_UINT, offsetof(PyCmbBatchObject, nrows), READONLY,
+	    "number of rows" },
+	{ NULL },
+};
+
+static PySequenceMethods CmbBatchSequence = {
+	.sq_length = (lenfunc)CmbBatchLength,
+};
+
+static PyBufferProcs CmbBatchBuffer = {
+	.bf_getbuffer = (getbufferproc)CmbBatchGetBuffer,
+};
+
+static PyTypeObject PyCmbBatchType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "cmb.CMBBatch",
+	.tp_basicsize = sizeof(PyCmbBatchObject),
+	.tp_itemsize = 0,
+	.tp_dealloc = (destructor)CmbBatchDealloc,
+	.tp_as_sequence = &CmbBatchSequence,
+	.tp_as_buffer = &CmbBatchBuffer,
+#if PY_MAJOR_VERSION == 2
+	.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER,
+#else
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+#endif
+	.tp_doc = "cmb batch of combinations as rows of item numbers",
+	.tp_members = CmbBatchMembers,
+};
+
 static PyMethodDef cmbMethods[] = {
 	{ "cmb", pycmb, METH_VARARGS },
 	{ "cmb_callback", pycmb_callback, METH_VARARGS },
 	{ "cmb_count", pycmb_count, METH_VARARGS },
+	{ "cmb_iter", pycmb_iter, METH_VARARGS },
 	{ "cmb_print", pycmb_print, METH_VARARGS },
 	{ "cmb_version", pycmb_version, METH_VARARGS },
 	{ "error_out", (PyCFunction)CmbError, METH_NOARGS },
@@ -530,6 +607,116 @@ CmbSetO(PyCmbObject *self, PyObject *key, PyObject *value)
 	return (0);
 }
 
+/*
+ * Batches are 2-D (nrows by nitems) read-only buffers of uint32 item numbers
+ * (zero-based), usable without copying by memoryview() and numpy.
+ */
+
+static void
+CmbBatchDealloc(PyCmbBatchObject *self)
+{
+	free(self->indices);
+	PyObject_Del(self);
+}
+
+static int
+CmbBatchGetBuffer(PyCmbBatchObject *self, Py_buffer *view, int flags)
+{
+	if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+		PyErr_SetString(PyExc_BufferError, "batch is read-only");
+		view->obj = NULL;
+		return (-1);
+	}
+
+	view->obj = (PyObject *)self;
+	Py_INCREF(self);
+	view->buf = self->indices;
+	view->len = (Py_ssize_t)(sizeof(uint32_t) * self->nrows *
+	    self->nitems);
+	view->readonly = 1;
+	view->itemsize = sizeof(uint32_t);
+	view->format = (flags & PyBUF_FORMAT) == PyBUF_FORMAT ? "I" : NULL;
+	view->ndim = 2;
+	view->shape = (flags & PyBUF_ND) == PyBUF_ND ? self->shape : NULL;
+	view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ?
+	    self->strides : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+
+	return (0);
+}
+
+static Py_ssize_t
+CmbBatchLength(PyCmbBatchObject *self)
+{
+	return ((Py_ssize_t)self->nrows);
+}
+
+static void
+CmbIterDealloc(PyCmbIterObject *self)
+{
+	cmb_iter_free(self->iter);
+	Py_XDECREF(self->cmb);
+	PyObject_Del(self);
+}
+
+static PyObject *
+CmbIterNext(PyCmbIterObject *self)
+{
+	int error;
+	uint32_t nitems = 0;
+	uint32_t nrows;
+	uint64_t seq = 0;
+	uint32_t *indices;
+	PyCmbBatchObject *batch;
+
+	if (self->iter == NULL)
+		return (NULL); /* StopIteration */
+	if (self->busy) {
+		PyErr_SetString(PyExc_ValueError, "iterator already executing");
+		return (NULL);
+	}
+	if ((indices = (uint32_t *)malloc(sizeof(uint32_t) * self->rows *
+	    self->setmax)) == NULL)
+		return (PyErr_NoMemory());
+
+	/* Enumerate the next batch without holding the GIL */
+	self->busy = TRUE;
+	Py_BEGIN_ALLOW_THREADS
+	nrows = cmb_iter_next_batch(self->iter, &seq, &nitems, indices,
+	    self->rows);
+	error = errno;
+	Py_END_ALLOW_THREADS
+	self->busy = FALSE;
+
+	if (nrows == 0) {
+		free(indices);
+		cmb_iter_free(self->iter);
+		self->iter = NULL;
+		if (error != 0) {
+			errno = error;
+			return (PyErr_SetFromErrno(PyExc_OSError));
+		}
+		return (NULL); /* StopIteration */
+	}
+
+	batch = PyObject_New(PyCmbBatchObject, &PyCmbBatchType);
+	if (batch == NULL) {
+		free(indices);
+		return (NULL);
+	}
+	batch->indices = indices;
+	batch->seq = seq;
+	batch->nitems = nitems;
+	batch->nrows = nrows;
+	batch->shape[0] = (Py_ssize_t)nrows;
+	batch->shape[1] = (Py_ssize_t)nitems;
+	batch->strides[0] = (Py_ssize_t)(sizeof(uint32_t) * nitems);
+	batch->strides[1] = (Py_ssize_t)sizeof(uint32_t);
+
+	return ((PyObject *)batch);
+}
+
 /*
  * Module implementation
  */
@@ -749,6 +936,52 @@ pycmb_count_error:
 	return (Py_BuildValue("K", i));
 }
 
+static PyObject *
+pycmb_iter(PyObject *obj, PyObject *args)
+{
+	uint32_t nitems;
+	uint32_t rows = BATCH_ROWS;
+	uint32_t setmax;
+	struct cmb_config *config;
+	PyCmbObject *self;
+	PyCmbIterObject *it;
+
+	/* Parse and type-check arguments */
+	if (!PyArg_ParseTuple(args, "OI|I", &self, &nitems, &rows))
+		return NULL;
+	if (!PyObject_TypeCheck((PyObject *)self, &PyCmbType)) {
+		PyErr_SetString(PyExc_TypeError, "Need a CMB object!");
+		return NULL;
+	}
+	if (rows == 0)
+		rows = BATCH_ROWS;
+
+	/* Rows are at most as wide as the largest set */
+	config = self->config;
+	setmax = config->size_max > config->size_min ?
+	    config->size_max : config->size_min;
+	if (setmax == 0 || setmax > nitems)
+		setmax = nitems;
+	if (setmax == 0)
+		setmax = 1;
+	if ((size_t)rows > SIZE_MAX / sizeof(uint32_t) / setmax)
+		return (PyErr_NoMemory());
+
+	if ((it = PyObject_New(PyCmbIterObject, &PyCmbIterType)) == NULL)
+		return NULL;
+	it->rows = rows;
+	it->setmax = setmax;
+	it->busy = FALSE;
+	Py_INCREF(self);
+	it->cmb = self;
+	if ((it->iter = cmb_iter_init(config, nitems, NULL)) == NULL) {
+		Py_DECREF(it);
+		return (PyErr_SetFromErrno(PyExc_OSError));
+	}
+
+	return ((PyObject *)it);
+}
+
 static PyObject *
 pycmb_print(PyObject *obj, PyObject *args)
 {
@@ -852,6 +1085,10 @@ PyInit_cmb(void)
 
 	if (PyType_Ready(&PyCmbType) < 0)
 		goto initcmb_error;
+	if (PyType_Ready(&PyCmbIterType) < 0)
+		goto initcmb_error;
+	if (PyType_Ready(&PyCmbBatchType) < 0)
+		goto initcmb_error;
 
 #if PY_MAJOR_VERSION == 2
 	m = Py_InitModule3("cmb", cmbMethods, "Combinatorics module");
@@ -0,0 +1,18 @@
+#!/usr/bin/env python
+from cmb import *
+
+items = ["a", "b", "c", "d", "e"]
+choose = 3
+nitems = len(items)
+rows = 4
+
+print("Enumerating choose-%u from %u in batches of %u:" % (choose, nitems, rows))
+config = CMB(size_min = choose, size_max = choose)
+for batch in cmb_iter(config, nitems, rows):
+    # Each batch is a read-only nrows by nitems buffer of item numbers;
+    # numpy.frombuffer() or numpy.asarray() can use it without copying
+    view = memoryview(batch)
+    print("seq %u: %u rows of %u (shape %s)" %
+        (batch.seq, batch.nrows, batch.nitems, view.shape))
+    for row in view.tolist():
+        print("\t%s" % " ".join(items[i] for i in row))
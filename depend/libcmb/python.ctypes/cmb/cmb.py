@@ -52,12 +52,36 @@ g_action = None;
 #
 # Library instance
 #
-libcmb = ctypes.CDLL('libcmb.so.0')
+libcmb = ctypes.CDLL('libcmb.so.1')
 
 ############################################################ CLASSES
 
+#
+# Option bits (CMB_OPT_*) of the options member
+#
+CMB_OPT_DEBUG		= 0x01
+CMB_OPT_NULPARSE	= 0x02
+CMB_OPT_NULPRINT	= 0x04
+CMB_OPT_EMPTY		= 0x08
+CMB_OPT_NUMBERS		= 0x10
+
+def _cmb_option(bit):
+    def get(self):
+        return 1 if self.options & bit else 0
+    def set(self, value):
+        if value:
+            self.options |= bit
+        else:
+            self.options &= ~bit & 0xff
+    return property(get, set)
+
 class CMB(ctypes.Structure):
 
+    debug = _cmb_option(CMB_OPT_DEBUG)
+    nul_terminate = _cmb_option(CMB_OPT_NULPRINT)
+    show_empty = _cmb_option(CMB_OPT_EMPTY)
+    show_numbers = _cmb_option(CMB_OPT_NUMBERS)
+
     def keys(self):
         keys = []
         for key in (
@@ -93,11 +117,12 @@ class CMB(ctypes.Structure):
 CMB_CALLBACK = ctypes.CFUNCTYPE(ctypes.c_int, ctypes.POINTER(CMB),
     ctypes.c_uint64, ctypes.c_uint32, ctypes.POINTER(ctypes.c_char_p))
 
+#
+# Layout of struct cmb_config in cmb.h (callbacks other than action are not
+# exposed and must be left NULL)
+#
 CMB._fields_ = [
-        ("debug", ctypes.c_uint8),
-        ("nul_terminate", ctypes.c_uint8),
-        ("show_empty", ctypes.c_uint8),
-        ("show_numbers", ctypes.c_uint8),
+        ("options", ctypes.c_uint8),
         ("delimiter", ctypes.c_char_p),
         ("prefix", ctypes.c_char_p),
         ("suffix", ctypes.c_char_p),
@@ -105,7 +130,30 @@ CMB._fields_ = [
         ("size_max", ctypes.c_uint32),
         ("count", ctypes.c_uint64),
         ("start", ctypes.c_uint64),
+        ("data", ctypes.c_void_p),
         ("action", CMB_CALLBACK),
+        ("thread", ctypes.c_uint32),
+        ("action_batch", ctypes.c_void_p),
+        ("batch_size", ctypes.c_uint32),
+        ("indices", ctypes.POINTER(ctypes.c_uint32)),
+        ("changed", ctypes.c_uint32),
+        ("order", ctypes.c_uint8),
+        ("left", ctypes.c_uint32),
+        ("entered", ctypes.c_uint32),
+        ("action_mask", ctypes.c_void_p),
+        ("unique", ctypes.c_uint8),
+        ("bound", ctypes.c_void_p),
+        ("score", ctypes.c_void_p),
+        ("shard", ctypes.c_uint32),
+        ("nshards", ctypes.c_uint32),
+        ("stream", ctypes.c_void_p),
+        ("writer", ctypes.c_void_p),
+        ("format", ctypes.c_uint8),
+        ("count_bn", ctypes.c_void_p),
+        ("start_bn", ctypes.c_void_p),
+        ("action_bn", ctypes.c_void_p),
+        ("action_batch_bn", ctypes.c_void_p),
+        ("action_mask_bn", ctypes.c_void_p),
     ]
 
 ############################################################ TYPES
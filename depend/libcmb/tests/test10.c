@@ -0,0 +1,56 @@
+/*-
+ * Copyright (c) 2018-2026 Devin Teske <dteske@FreeBSD.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <cmb.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHOICE 3
+#define NITEMS 6
+
+/* Items required to be in each combination shown */
+#define REQUIRED ((1 << 1) | (1 << 4))
+
+static char *items[NITEMS] = { "a", "b", "c", "d", "e", "f" };
+static uint32_t matched;
+
+static int
+mfunc(struct cmb_config *config, uint64_t seq, uint32_t nitems, uint64_t mask)
+{
+	uint32_t n;
+
+	(void)config;
+	(void)nitems;
+
+	if ((mask & REQUIRED) != REQUIRED)
+		return (0);
+	matched++;
+
+	printf("%"PRIu64":", seq);
+	for (n = 0; n < NITEMS; n++)
+		if ((mask & ((uint64_t)1 << n)) != 0)
+			printf(" %s", items[n]);
+	printf("\n");
+
+	return (0);
+}
+
+int
+main(void)
+{
+	static struct cmb_config config = {
+		.size_min = CHOICE,
+		.size_max = CHOICE,
+		.action_mask = mfunc,
+	};
+
+	printf("Choose-%u from %u containing b and e:\n", CHOICE, NITEMS);
+	(void)cmb(&config, NITEMS, items);
+	printf("%u matched\n", matched);
+
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,63 @@
+/*-
+ * Copyright (c) 2018-2026 Devin Teske <dteske@FreeBSD.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <cmb.h>
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHOICE 3
+#define NITEMS 5
+#define NROWS 4
+
+int
+main(void)
+{
+	static struct cmb_config config = {
+		.size_min = CHOICE,
+		.size_max = CHOICE,
+	};
+	char *items[NITEMS] = { "a", "b", "c", "d", "e" };
+	char **curitems;
+	uint32_t indices[NROWS * CHOICE];
+	uint32_t n;
+	uint32_t nitems;
+	uint32_t nrows;
+	uint32_t row;
+	uint64_t seq;
+	struct cmb_iter *iter;
+
+	if ((iter = cmb_iter_init(&config, NITEMS, items)) == NULL)
+		err(EXIT_FAILURE, "cmb_iter_init");
+
+	/* Pull the first few combinations one at a time */
+	printf("Choose-%u from %u, one at a time:\n", CHOICE, NITEMS);
+	for (row = 0; row < NROWS; row++) {
+		if (!cmb_iter_next(iter, &seq, &nitems, &curitems))
+			break;
+		printf("%"PRIu64":", seq);
+		for (n = 0; n < nitems; n++)
+			printf(" %s", curitems[n]);
+		printf("\n");
+	}
+
+	/* Pull the rest in batches of item numbers */
+	printf("Remainder, %u at a time:\n", NROWS);
+	while ((nrows = cmb_iter_next_batch(iter, &seq, &nitems, indices,
+	    NROWS)) > 0) {
+		for (row = 0; row < nrows; row++) {
+			printf("%"PRIu64":", seq + row);
+			for (n = 0; n < nitems; n++)
+				printf(" %s", items[indices[row * nitems + n]]);
+			printf("\n");
+		}
+		printf("--\n");
+	}
+	cmb_iter_free(iter);
+
+	return (EXIT_SUCCESS);
+}
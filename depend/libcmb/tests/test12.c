@@ -0,0 +1,38 @@
+/*-
+ * Copyright (c) 2018-2026 Devin Teske <dteske@FreeBSD.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <cmb.h>
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHOICE 2
+#define NITEMS 4
+#define NSAMPLES 8
+#define SEED 1
+
+int
+main(void)
+{
+	static struct cmb_config config = {
+		.options = CMB_OPT_NUMBERS,
+		.size_min = CHOICE,
+		.size_max = CHOICE,
+	};
+	char *items[NITEMS] = { "a", "b", "c", "d" };
+
+	printf("%u random choose-%u from %u (seed %u):\n", NSAMPLES, CHOICE,
+	    NITEMS, SEED);
+	if (cmb_sample(&config, NITEMS, items, NSAMPLES, SEED) != 0)
+		err(EXIT_FAILURE, "cmb_sample");
+
+	printf("Same again, without replacement:\n");
+	config.unique = TRUE;
+	if (cmb_sample(&config, NITEMS, items, NSAMPLES, SEED) != 0)
+		err(EXIT_FAILURE, "cmb_sample");
+
+	return (EXIT_SUCCESS);
+}
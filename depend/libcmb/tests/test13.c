@@ -0,0 +1,58 @@
+/*-
+ * Copyright (c) 2018-2026 Devin Teske <dteske@FreeBSD.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <cmb.h>
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NITEMS 8
+#define TARGET 10
+
+static int values[NITEMS] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+static int totals[NITEMS];
+
+/*
+ * Values are in ascending order, so the least total beginning with a prefix
+ * completes it with the values immediately following.
+ */
+static
+CMB_BOUND(sum_bound)
+{
+	int least;
+	uint32_t c = setnums[depth - 1];
+	uint32_t n;
+
+	(void)config;
+
+	totals[depth - 1] = values[c];
+	if (depth > 1)
+		totals[depth - 1] += totals[depth - 2];
+	least = totals[depth - 1];
+	for (n = c + 1; n < c + 1 + setsize - depth; n++)
+		least += values[n];
+	if (least > TARGET)
+		return (CMB_BOUND_SKIPALL);
+	if (depth == setsize && least != TARGET)
+		return (CMB_BOUND_SKIP);
+	return (CMB_BOUND_DESCEND);
+}
+
+int
+main(void)
+{
+	static struct cmb_config config = {
+		.options = CMB_OPT_NUMBERS,
+		.bound = sum_bound,
+	};
+	char *items[NITEMS] = { "1", "2", "3", "4", "5", "6", "7", "8" };
+
+	printf("Combinations of 1-%u that sum to %u:\n", NITEMS, TARGET);
+	if (cmb(&config, NITEMS, items) != 0)
+		err(EXIT_FAILURE, "cmb");
+
+	return (EXIT_SUCCESS);
+}
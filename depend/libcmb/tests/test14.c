@@ -0,0 +1,56 @@
+/*-
+ * Copyright (c) 2018-2026 Devin Teske <dteske@FreeBSD.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <cmb.h>
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NITEMS 20
+#define NTOP 5
+#define TARGET 100
+
+/*
+ * Distance of the sum of a combination from TARGET; lowest scores are kept.
+ */
+static
+CMB_SCORE(sum_score)
+{
+	long double sum = 0;
+	uint32_t n;
+
+	(void)config;
+	(void)seq;
+
+	for (n = 0; n < nitems; n++)
+		sum += strtol(items[n], NULL, 10);
+	return (sum > TARGET ? sum - TARGET : TARGET - sum);
+}
+
+int
+main(void)
+{
+	static struct cmb_config config = {
+		.options = CMB_OPT_NUMBERS,
+		.score = sum_score,
+		.size_min = 4,
+		.size_max = 4,
+	};
+	uint32_t n;
+	char *items[NITEMS];
+	char values[NITEMS][4];
+
+	for (n = 0; n < NITEMS; n++) {
+		snprintf(values[n], sizeof(values[n]), "%u", (n + 1) * 3);
+		items[n] = values[n];
+	}
+
+	printf("%u 4-item combinations summing nearest to %u:\n", NTOP, TARGET);
+	if (cmb_top(&config, NITEMS, items, NTOP, 4) != 0)
+		err(EXIT_FAILURE, "cmb_top");
+
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,76 @@
+/*-
+ * Copyright (c) 2018-2026 Devin Teske <dteske@FreeBSD.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <cmb.h>
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NITEMS 5
+
+static void
+print_record(uint64_t seq, uint32_t setsize, uint32_t setnums[], char *items[])
+{
+	uint32_t n;
+
+	printf("%"PRIu64":", seq);
+	for (n = 0; n < setsize; n++)
+		printf(" %s", items[setnums[n]]);
+	printf("\n");
+}
+
+int
+main(void)
+{
+	static struct cmb_config config = {
+		.options = CMB_OPT_NUMBERS,
+		.format = CMB_FORMAT_BIN,
+		.size_min = 2,
+		.size_max = 3,
+	};
+	uint32_t setnums[NITEMS];
+	uint32_t setsize;
+	uint64_t seq;
+	char *items[NITEMS] = { "a", "b", "c", "d", "e" };
+	char **table;
+	FILE *fp;
+	struct cmb_bin *bin;
+	struct cmb_bin_header header;
+
+	/* Write binary output to a temporary file */
+	if ((fp = tmpfile()) == NULL)
+		err(EXIT_FAILURE, "tmpfile");
+	config.stream = fp;
+	if (cmb(&config, NITEMS, items) != 0)
+		err(EXIT_FAILURE, "cmb");
+	if (fflush(fp) != 0)
+		err(EXIT_FAILURE, "fflush");
+	rewind(fp);
+
+	/* Read it back */
+	if ((bin = cmb_bin_open(fileno(fp), &header, &table)) == NULL)
+		err(EXIT_FAILURE, "cmb_bin_open");
+	printf("%u items, %u to %u per record of %u bytes\n", header.nitems,
+	    header.size_min, header.size_max, header.recsize);
+	while (cmb_bin_read(bin, &seq, &setsize, setnums))
+		print_record(seq, setsize, setnums, table);
+	if (errno != 0)
+		err(EXIT_FAILURE, "cmb_bin_read");
+
+	/* Records are fixed-size; jump straight to the last 3-item record */
+	if (cmb_bin_seek(bin, 19) != 0)
+		err(EXIT_FAILURE, "cmb_bin_seek");
+	if (!cmb_bin_read(bin, &seq, &setsize, setnums))
+		errx(EXIT_FAILURE, "cmb_bin_read: no record");
+	printf("Record 19 is ");
+	print_record(seq, setsize, setnums, table);
+
+	cmb_bin_free(bin);
+	fclose(fp);
+
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,65 @@
+/*-
+ * Copyright (c) 2018-2026 Devin Teske <dteske@FreeBSD.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <cmb.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NITEMS 60
+
+static int
+afunc(struct cmb_config *config, uint64_t seq, uint32_t nitems, char *items[])
+{
+	uint32_t i;
+
+	printf("\t%"PRIu64":", seq);
+	for (i = 0; i < nitems; i++)
+		printf(" %s", items[i]);
+	printf("\n");
+
+	return (0);
+}
+
+int
+main(void)
+{
+	uint32_t i;
+	uint32_t setsize;
+	uint64_t seq = 1000000000000;
+	uint32_t setnums[NITEMS];
+	char *items[NITEMS];
+	static struct cmb_config config = {
+		.options = CMB_OPT_NUMBERS,
+		.size_min = 20,
+		.size_max = 20,
+		.count = 3,
+		.action = afunc,
+	};
+
+	for (i = 0; i < NITEMS; i++) {
+		items[i] = (char *)calloc(1, 11);
+		sprintf(items[i], "%u", i);
+	}
+
+	printf("Unranking choose-20 from %u at %"PRIu64":\n", NITEMS, seq);
+	if (cmb_unrank(&config, NITEMS, seq, &setsize, setnums) != 0) {
+		printf("\tERROR\n");
+		return (EXIT_FAILURE);
+	}
+	printf("\t%"PRIu64":", seq);
+	for (i = 0; i < setsize; i++)
+		printf(" %u", setnums[i]);
+	printf("\n");
+	printf("cmb_rank: %"PRIu64"\n",
+	    cmb_rank(&config, NITEMS, setsize, setnums));
+
+	printf("Enumerating from %"PRIu64":\n", seq);
+	config.start = seq;
+	(void)cmb(&config, NITEMS, items);
+
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,56 @@
+/*-
+ * Copyright (c) 2018-2026 Devin Teske <dteske@FreeBSD.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <cmb.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHOICE 3
+#define NITEMS 1000
+#define NTHREADS 8
+
+static uint64_t calls[NTHREADS];
+static uint64_t seqsum[NTHREADS];
+
+static int
+afunc(struct cmb_config *config, uint64_t seq, uint32_t nitems, char *items[])
+{
+	calls[config->thread]++;
+	seqsum[config->thread] += seq;
+	return (0);
+}
+
+int
+main(void)
+{
+	uint32_t i;
+	uint64_t total = 0;
+	uint64_t sum = 0;
+	uint64_t count;
+	static struct cmb_config config = {
+		.size_min = 1,
+		.size_max = CHOICE,
+		.action = afunc,
+	};
+	char *items[NITEMS];
+
+	count = cmb_count(&config, NITEMS);
+	printf("Enumerating choose-1..%u from %u with %u threads:\n",
+	    CHOICE, NITEMS, NTHREADS);
+	(void)cmb_parallel(&config, NITEMS, items, NTHREADS);
+	for (i = 0; i < NTHREADS; i++) {
+		printf("\tthread %u: %"PRIu64" combinations\n", i, calls[i]);
+		total += calls[i];
+		sum += seqsum[i];
+	}
+	printf("%"PRIu64" of %"PRIu64" combinations enumerated\n",
+	    total, count);
+	printf("sequence checksum %s\n",
+	    sum == count * (count + 1) / 2 ? "OK" : "FAILED");
+
+	return (EXIT_SUCCESS);
+}
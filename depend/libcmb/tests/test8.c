@@ -0,0 +1,46 @@
+/*-
+ * Copyright (c) 2018-2026 Devin Teske <dteske@FreeBSD.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <cmb.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static char *items[] = { "a", "b", "c", "d", "e", "f" };
+
+static int
+bfunc(struct cmb_config *config, uint64_t seq, uint32_t nitems,
+    uint32_t *indices, uint32_t nrows)
+{
+	uint32_t n;
+	uint32_t row;
+
+	printf("batch of %u starting at %"PRIu64":\n", nrows, seq);
+	for (row = 0; row < nrows; row++) {
+		printf("\t%"PRIu64":", seq + row);
+		for (n = 0; n < nitems; n++)
+			printf(" %s", items[indices[row * nitems + n]]);
+		printf("\n");
+	}
+	return (0);
+}
+
+int
+main(void)
+{
+	static struct cmb_config config = {
+		.options = CMB_OPT_EMPTY,
+		.size_min = 2,
+		.size_max = 3,
+		.action_batch = bfunc,
+		.batch_size = 4,
+	};
+
+	printf("Batches of up to 4 choose-2..3 from 6 (plus empty set):\n");
+	(void)cmb(&config, sizeof(items) / sizeof(items[0]), items);
+
+	return (EXIT_SUCCESS);
+}
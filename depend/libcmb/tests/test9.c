@@ -0,0 +1,55 @@
+/*-
+ * Copyright (c) 2018-2026 Devin Teske <dteske@FreeBSD.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <cmb.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHOICE 3
+#define NITEMS 6
+
+static int values[NITEMS] = { 1, 2, 4, 8, 16, 32 };
+static int sum;
+
+static int
+afunc(struct cmb_config *config, uint64_t seq, uint32_t nitems, char *items[])
+{
+	uint32_t n;
+
+	/* Update the running sum with only the item that changed */
+	if (config->left == UINT32_MAX) {
+		sum = 0;
+		for (n = 0; n < nitems; n++)
+			sum += values[config->indices[n]];
+	} else
+		sum += values[config->entered] - values[config->left];
+
+	printf("%"PRIu64":", seq);
+	for (n = 0; n < nitems; n++)
+		printf(" %s", items[config->indices[n]]);
+	printf(" (sum %d)\n", sum);
+
+	return (0);
+}
+
+int
+main(void)
+{
+	static struct cmb_config config = {
+		.options = CMB_OPT_INDICES,
+		.size_min = CHOICE,
+		.size_max = CHOICE,
+		.order = CMB_ORDER_REVDOOR,
+		.action = afunc,
+	};
+	char *items[NITEMS] = { "a", "b", "c", "d", "e", "f" };
+
+	printf("Choose-%u from %u in revolving-door order:\n", CHOICE, NITEMS);
+	(void)cmb(&config, NITEMS, items);
+
+	return (EXIT_SUCCESS);
+}